@@ -0,0 +1,82 @@
+#pragma once
+// Sliding window aggregates of every sensor, published at a low rate so that consumers do not have to replay the
+// stream of readings. Every window (5 min, 1 h, 24 h) is a ring of AGGREGATE_BUCKETS buckets of a quarter of the window
+// with the count, sum, minimum and maximum of the temperature (tenths of C) and humidity. A reading updates the newest
+// bucket of each window, and a bucket is cleared when the window slides past it, so an update is O(1). The window slides
+// in steps of a quarter. Minimum, maximum and mean are combined from the buckets when the message is rendered.
+//
+// Derived values: dew point of the last reading (Magnus formula) and rate of change per hour of temperature and
+// humidity, the difference between the newest and the oldest bucket of the 1 h window.
+//
+// Time is an uptime clock in seconds that is kept in RTC memory together with a summary (count, minimum, mean and
+// maximum) of every window. After a soft reset the clock continues and every window is restored as one bucket holding
+// its summary, which ages out like the others. Memory is fixed, AGGREGATE_SENSOR_BYTES per sensor.
+//
+// Messages: one JSON object per sensor on <aggregate_topic>, <mqtt_topic>/aggregates if it is empty, every
+// aggregate_interval seconds:
+//   {"SensorAddress":"a5","Channel":1,"TemperatureC":21.3,"Humidity":48,"DewPointC":9.9,"TemperatureTrendC":-0.4,
+//    "HumidityTrend":1.2,"5m":{"Readings":6,"TemperatureC":[21.1,21.2,21.3],"Humidity":[47,47.8,48]},"1h":{...},"24h":{...}}
+// Trends are per hour and left out until the 1 h window has two buckets with readings. Arrays are minimum, mean and
+// maximum. Other protocols than Newentor add "Protocol" like the reading messages.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+#include "sensors.h"
+
+#define AGGREGATE_SENSORS SENSORS_MAX //sensors tracked, least recently seen sensor is replaced when the table is full
+#define AGGREGATE_WINDOWS 3
+#define AGGREGATE_BUCKETS 4 //buckets per window
+#define AGGREGATE_TOPIC "/aggregates" //appended to mqtt_topic when aggregate_topic is empty
+#define AGGREGATE_JSON_SIZE 400 //longest message of one sensor
+#define AGGREGATE_RTC_OFFSET 16 //after the connection cache of config.h
+#define AGGREGATE_RTC_MAGIC 0x4E524147 //"NRAG"
+
+struct aggregateBucket { //readings of a quarter of a window
+  int32_t temperature_sum; //tenths of C
+  uint32_t humidity_sum;
+  uint16_t count;
+  int16_t temperature_min, temperature_max;
+  uint8_t humidity_min, humidity_max;
+};
+
+struct aggregateWindow {
+  uint32_t bucket; //number of the newest bucket, clock divided by the bucket length
+  aggregateBucket buckets[AGGREGATE_BUCKETS];
+};
+
+struct aggregateSensor {
+  uint32_t last_seen; //aggregate clock, s
+  uint16_t sensor; //protocolSensor(), address and channel
+  uint8_t protocol;
+  bool used;
+  int16_t temperature; //last reading, tenths of C
+  uint8_t humidity;
+  aggregateWindow windows[AGGREGATE_WINDOWS];
+};
+
+#define AGGREGATE_SENSOR_BYTES sizeof(aggregateSensor)
+
+struct aggregateSummary { //one window combined from its buckets
+  uint16_t count;
+  int16_t temperature_min, temperature_mean, temperature_max; //tenths of C
+  uint8_t humidity_min, humidity_max;
+  uint16_t humidity_mean; //tenths
+};
+
+struct aggregateStatistics {
+  uint32_t messages; //published
+  uint32_t failed;
+  uint32_t restored; //sensors restored from RTC memory at boot
+};
+
+extern aggregateStatistics aggregateStats;
+
+void aggregateBegin(); //restore from RTC memory and apply the aggregate settings, call after the config is loaded
+void aggregateAdd(uint8_t protocol, uint64_t data); //valid reading, duplicates of a burst filtered out
+void aggregateLoop(); //publish the aggregates when they are due and keep the clock in RTC memory
+bool aggregateGet(uint8_t index, aggregateSensor &sensor); //copy of a table entry, false if unused, windows slid to now
+void aggregateSummarize(const aggregateSensor &sensor, uint8_t window, aggregateSummary &summary);
+size_t aggregateJson(const aggregateSensor &sensor, char *buf, size_t size); //message of the sensor, 0 if it does not fit
+uint8_t aggregateCount(); //sensors tracked
+uint32_t aggregateClock(); //s
@@ -0,0 +1,39 @@
+#pragma once
+// Boot phase timings: milliseconds from power on (the SDK starts the clock) until every phase was first reached.
+// Shown on the main page, in /metrics and on the stats topic, to measure how long the receiver is deaf after a reset.
+
+#include <stdint.h>
+#include "hal.h"
+
+enum bootPhase : uint8_t {
+  BOOT_SETUP, //setup() entered, time spent in the boot loader and SDK
+  BOOT_FS, //file system mounted
+  BOOT_CONFIG, //settings loaded
+  BOOT_WIFI, //WiFi connected
+  BOOT_MQTT, //first broker connection
+  BOOT_FRAME, //first datagram received
+  BOOT_PUBLISH, //first reading published
+  BOOT_PHASES
+};
+
+enum bootConfigSource : uint8_t {
+  BOOT_CONFIG_DEFAULTS, //no settings saved
+  BOOT_CONFIG_BINARY, //binary record with a valid CRC
+  BOOT_CONFIG_JSON //imported from /config.json
+};
+
+struct bootStatistics {
+  uint32_t phases[BOOT_PHASES]; //halMillis() when the phase was reached, 0 if not yet
+  bootConfigSource config_source;
+  bool wifi_cached; //joined the cached access point without a scan
+  bool rtc_valid; //connection cache in RTC memory survived the reset
+};
+
+extern bootStatistics bootStats;
+
+inline void bootMark(bootPhase phase) { //only the first time counts
+  if (!bootStats.phases[phase]) bootStats.phases[phase] = halMillis() | 1;
+}
+
+const char *bootPhaseName(uint8_t phase);
+const char *bootConfigSourceName();
@@ -0,0 +1,42 @@
+#pragma once
+// Burst assembler. Every transmission of a sensor is a burst of repeats of the same datagram, 6 for Newentor.
+// Repeats of a burst are collected, majority voted bit by bit and handed over as one consensus datagram,
+// which also recovers datagrams where every repeat got a few bits wrong.
+// Repeats passing the check only join a burst of the same sensor (protocolSensor), broken ones the nearest burst.
+
+#include <stdint.h>
+#include "rf_receiver.h"
+
+#define BURST_REPEATS 6 //repeats voted per burst, sensors sending more repeats start a new burst that the duplicate filter drops
+#define BURST_GAP 500000 //us, burst is complete when no repeat arrived for this long. one repeat takes 110-190ms
+#define BURST_MAX_DISTANCE 8 //max different bits for a datagram to be a repeat of the burst
+#define BURST_SLOTS 4 //bursts of different sensors assembled at the same time
+#define BURST_MARGIN_UNKNOWN 255 //timing margin of repeats whose durations were not recorded
+
+struct rfBurst { //consensus of one burst
+  uint64_t data; //majority voted datagram
+  uint32_t time; //micros() time of the first repeat
+  uint8_t repeats; //repeats received
+  uint8_t agree; //repeats identical to the consensus
+  bool valid; //consensus passed validity and CRC check
+  uint8_t protocol; //rfProtocolId
+  uint8_t margin; //mean timing margin of the repeats in % (quality.h), BURST_MARGIN_UNKNOWN if none was measured
+};
+
+struct burstStatistics {
+  uint32_t bursts; //bursts completed
+  uint32_t valid; //bursts with a valid consensus
+  uint32_t recovered; //valid bursts where no single repeat passed the CRC check
+  uint32_t failed; //bursts without a valid consensus
+  uint32_t frames; //datagrams received in all bursts
+  uint32_t invalid; //received datagrams failing the validity check
+  uint32_t bad_crc; //received datagrams failing the CRC check
+};
+
+extern burstStatistics burstStats;
+
+typedef void (*burstHandler)(const rfBurst &burst);
+
+void burstAdd(const rfFrame &frame, uint8_t margin, burstHandler handler); //add a received datagram with its timing margin, handler is called for bursts completed by it
+void burstPoll(uint32_t now, burstHandler handler); //complete bursts which got no repeat for BURST_GAP, now is micros()
+uint64_t burstVote(const uint64_t *frames, uint8_t count); //bitwise majority of the datagrams, ties are resolved to 0
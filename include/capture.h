@@ -0,0 +1,46 @@
+#pragma once
+// Pulse train capture: compact binary recording of the RF receiver output for offline analysis and replay.
+//
+// Format: 8 byte header, "NRC" + version byte + little endian uint32 micros() time of the capture start,
+// followed by one unsigned LEB128 varint per edge: (microseconds since the previous edge << 1) | pin level after the edge.
+// Bit timings of the sensors take 2 bytes per edge, short noise spikes 1 byte.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 8
+#define CAPTURE_MAX_EDGE_SIZE 5 //longest varint of a 32 bit delta
+#define CAPTURE_RAM_SIZE 8192 //buffer size when capturing to RAM
+#define CAPTURE_RING_SIZE 2048 //buffer between the interrupt and the file writer when capturing to file. must be a power of 2
+#define CAPTURE_FILE "/capture.bin"
+
+enum captureMode {
+  CAPTURE_TO_RAM = 0, //record into a RAM buffer until it is full
+  CAPTURE_TO_FILE //stream the recording to CAPTURE_FILE
+};
+
+//recording
+bool captureStart(captureMode mode, uint32_t duration_ms); //start a new recording, drops the previous one
+void captureStop();
+void captureEdge(bool state, uint32_t time); //record one edge, called from interrupt context
+void captureLoop(); //write recorded data to the file and stop the recording when the duration is over
+bool captureActive();
+captureMode captureLastMode(); //mode of the current or last recording
+const uint8_t *captureData(size_t &len); //contents of the last RAM recording, NULL if there is none
+uint32_t captureEdges(); //edges recorded
+uint32_t captureBytes(); //size of the recording including the header
+uint32_t captureDropped(); //edges lost because the buffer was full
+
+//reading
+struct captureReader {
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+  uint32_t time; //time of the last edge read
+};
+
+bool captureReaderBegin(captureReader &reader, const uint8_t *data, size_t len); //false if the header is not valid
+bool captureReadEdge(captureReader &reader, bool &state, uint32_t &time); //false at the end of the recording
+size_t captureEncodeHeader(uint8_t *out, uint32_t start); //writes CAPTURE_HEADER_SIZE bytes
+size_t captureEncodeEdge(uint8_t *out, uint32_t delta, bool state); //writes up to CAPTURE_MAX_EDGE_SIZE bytes
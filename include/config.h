@@ -0,0 +1,57 @@
+#pragma once
+// Receiver settings, stored as a binary record with a CRC in /config.bin that is read at boot without parsing.
+// /config.json is written next to it as the import/export format and is imported when there is no valid record,
+// e.g. on the first boot after an update changed the record version.
+// The record also caches the access point the receiver joined (BSSID and channel) so that the next boot connects
+// without a scan. A copy of the cache is kept in RTC memory and updated there on every connect, flash is only written
+// when the network changed or the cached access point could not be joined.
+
+#include <stdint.h>
+
+#define CONFIG_FILE "/config.bin"
+#define CONFIG_JSON_FILE "/config.json"
+#define CONFIG_JSON_SIZE 1152 //json document and text of all settings
+#define CONFIG_MAGIC 0x4E524346 //"NRCF"
+#define CONFIG_VERSION 6 //increment when the record layout changes, older records are then imported from the json
+#define CONFIG_RTC_OFFSET 0 //connection cache in RTC memory, 16 bytes, the aggregates of aggregate.h follow
+
+extern char mqtt_server[65];
+extern char mqtt_port[6];
+extern char mqtt_topic[65];
+extern char admin_username[6];
+extern char admin_pass[23];
+extern char hostname[33];
+extern char publish_mode[7]; //json, batch or binary
+extern char batch_interval[7]; //ms, batch and binary modes publish the collected readings at least this often
+extern char batch_size[3]; //readings, batch and binary modes publish as soon as this many readings are collected
+extern char stream_mode[4]; //frame stream transport next to MQTT: off, udp or tcp
+extern char stream_address[16]; //udp: multicast group or listener address
+extern char stream_port[6]; //udp: destination port, tcp: port the receiver listens on
+extern char stats_interval[6]; //seconds between messages on the stats topic, 0 disables them
+extern char aggregate_interval[6]; //seconds between the aggregate messages of every sensor, 0 disables them
+extern char aggregate_topic[65]; //topic of the aggregate messages, empty for <mqtt_topic>/aggregates
+extern char edge_rate_max[7]; //edges/s without a preamble that turn the RF interrupt off for a while, 0 disables it
+extern char burst_hold[2]; //1 holds web, OTA, MQTT reconnects and flash writes back while a sensor burst is expected, 0 off
+extern char receiver_id[33]; //name of the receiver in published readings and claims, empty for the hostname
+extern char leader_election[2]; //1 publishes a reading only if no other receiver claimed a better copy of it, 0 off
+extern char static_ip[16]; //empty for DHCP
+extern char gateway[16];
+extern char netmask[16];
+extern char dns_server[16];
+
+struct configWifi { //network joined last, not exported to the json
+  char ssid[33];
+  char psk[65];
+  uint8_t bssid[6];
+  uint8_t channel; //0 if no access point is cached
+};
+
+extern configWifi config_wifi;
+
+extern bool shouldSaveConfig; //flag for saving data
+extern bool no_config_file; //flag for not finding config file
+
+void saveConfigFile(); //binary record and json
+void loadConfigFile(); //binary record, or the json if there is no valid record
+bool configSet(const char *name, const char *value); //copy a setting given by its json name, truncated to its size, false if there is no such setting
+void configWifiUpdate(const char *ssid, const char *psk, const uint8_t *bssid, uint8_t channel, bool save); //after connecting, save writes a changed access point to flash
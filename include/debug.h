@@ -0,0 +1,4 @@
+#pragma once
+
+//#define DEBUG true      //enable debugging
+//#define DEBUG433 true   //enable debugging for RF signal
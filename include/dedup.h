@@ -0,0 +1,26 @@
+#pragma once
+// Duplicate filter. Sensors repeat every datagram 6 times, only the first copy is published.
+// One entry per sensor (protocol, address, channel) so that interleaved repeats of several sensors are still filtered.
+
+#include <stdint.h>
+
+#define DEDUP_SENSORS 8 //number of sensors tracked, least recently seen sensor is replaced when the table is full
+#define DEDUP_TIMEOUT 6000 //ms, same datagram is published again if the sensor was silent for this long
+
+struct dedupEntry {
+  uint64_t data; //last datagram received from the sensor
+  uint32_t last_seen; //halMillis() time of the last datagram
+  uint16_t sensor; //protocolSensor(), address and channel
+  uint8_t protocol;
+  bool used;
+};
+
+struct dedupStatistics {
+  uint32_t published; //datagrams passed on for publishing
+  uint32_t suppressed; //duplicates dropped
+  uint32_t evictions; //sensors replaced in the full table
+};
+
+extern dedupStatistics dedupStats;
+
+bool dedupIsNew(uint8_t protocol, uint64_t data, uint32_t now); //true if the datagram has to be published, records it in the table
@@ -0,0 +1,70 @@
+#pragma once
+// Hardware abstraction layer. Every platform (ESP8266 firmware, Linux native build) provides its own
+// implementation of these functions, the decoder and publisher code only talks to the hardware through them.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "debug.h"
+
+#ifdef ARDUINO
+#include <Arduino.h> //IRAM_ATTR, PROGMEM
+#else
+#define IRAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#endif
+
+//clock
+uint32_t halMillis(); //milliseconds since start
+uint32_t halMicros(); //microseconds since start, wraps every ~71 minutes
+uint32_t halCycleCount(); //free running cycle counter for measuring short durations, callable from interrupt context
+uint32_t halCycleFrequency(); //cycle counter ticks per second
+
+//GPIO edge source. Edges are delivered to rfHandleEdge()
+void halEdgeSourceBegin(); //start receiving RF edges
+void halEdgeSourceEnable(bool on); //turn edge delivery off and on again, callable from interrupt context
+void halSamplePoll(); //sampled edge source: hand the samples collected since the last call to rfHandleSamples(), from loop()
+
+//publisher
+bool halMqttConnect(const char *client_id); //connect to the broker, may block for the connect timeout
+bool halMqttConnected(); //true if the publisher is able to send messages
+bool halMqttPublish(const char *topic, const char *payload); //publish a message, false on failure
+bool halMqttBeginPublish(const char *topic, size_t len); //start a message of len bytes sent in pieces with halMqttWrite
+bool halMqttWrite(const uint8_t *data, size_t len);
+bool halMqttEndPublish(); //false if the message was not sent completely
+void halMqttLoop(); //keep alive and incoming traffic
+typedef void (*halMqttHandler)(const char *topic, const uint8_t *payload, size_t len);
+bool halMqttSubscribe(const char *topic, halMqttHandler handler); //QoS 0, again after every connect, one handler for all topics. messages are delivered from halMqttLoop()
+
+//frame stream, see stream.h
+bool halStreamBegin(bool tcp, const char *address, uint16_t port); //udp sends to address:port, tcp listens on port
+bool halStreamSend(const uint8_t *data, size_t len); //one udp datagram, or to every TCP subscriber. false if one could not take it
+void halStreamAccept(); //take new TCP subscribers
+uint8_t halStreamClients(); //connected TCP subscribers
+
+//filesystem
+bool halFileExists(const char *path);
+int halFileRead(const char *path, char *buf, size_t size); //read up to size bytes, returns number of bytes read or -1 on error
+int halFileReadAt(const char *path, size_t offset, char *buf, size_t size); //read up to size bytes from offset
+long halFileSize(const char *path); //-1 if the file does not exist
+bool halFileWrite(const char *path, const char *data, size_t len); //create or overwrite the file
+bool halFileAppend(const char *path, const char *data, size_t len); //append to the file, create it if missing
+bool halFileRemove(const char *path);
+
+//RTC memory, kept over soft resets and lost on power loss
+#define HAL_RTC_SIZE 384 //bytes, the RTC user memory after the 128 bytes used by the OTA boot loader
+bool halRtcRead(size_t offset, void *data, size_t size); //offset and size are multiples of 4
+bool halRtcWrite(size_t offset, const void *data, size_t size);
+
+//heap
+struct halHeapStats {
+  uint32_t free; //bytes
+  uint32_t max_block; //largest block that can be allocated
+  uint8_t fragmentation; //%, 0 if the platform does not report it
+};
+void halHeap(halHeapStats &stats); //walks the free list, not for interrupt context
+
+//misc
+void halLed(bool on); //valid packet indicator
+void halDebug(const char *format, ...); //debug output, only called from #if DEBUG blocks
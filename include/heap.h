@@ -0,0 +1,39 @@
+#pragma once
+// Heap telemetry for long running receivers. Free heap, the largest allocatable block and the fragmentation reported
+// by the platform (halHeap) are sampled every HEAP_PERIOD ms and after every web page, the lowest free heap and block
+// and the highest fragmentation since boot are kept, and so is one point per HEAP_HISTORY_PERIOD seconds with the
+// extremes of that period. A heap that holds up over a soak test shows flat lines in the history.
+//
+// The main page, /metrics and the stats topic show the current values and the extremes since boot, /heap streams the
+// history as CSV: uptime_s (start of the period), free_min, max_block_min, fragmentation_max. The last line is the
+// period in progress.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+
+#define HEAP_PERIOD 10000 //ms between samples of the heap task
+#define HEAP_HISTORY 24 //history points, the oldest is replaced
+#define HEAP_HISTORY_PERIOD 3600 //s per history point
+
+struct heapPoint { //extremes of one history period
+  uint32_t start; //uptime in s
+  uint32_t free_min;
+  uint32_t max_block_min;
+  uint8_t fragmentation_max;
+};
+
+struct heapStatistics {
+  halHeapStats now; //last sample
+  uint32_t free_min; //since boot
+  uint32_t max_block_min;
+  uint8_t fragmentation_max;
+  uint32_t samples;
+};
+
+extern heapStatistics heapStats;
+
+typedef void (*heapSink)(const char *text, size_t len, void *context);
+
+void heapSample(); //scheduler task every HEAP_PERIOD ms, and at the end of a request that allocates
+size_t heapStream(heapSink sink, void *context); //history as CSV with a header line, returns the length of the output
@@ -0,0 +1,80 @@
+#pragma once
+// On-device history of the readings of every sensor. Samples are bit packed into fixed size blocks with delta
+// encoding, so a sample usually takes 3 to 10 bits:
+//   time        delta of the interval to the previous sample (seconds): '0' same interval, '10'+3 bits,
+//               '110'+9 bits, '111'+32 bits
+//   temperature tenths of C, delta to the previous sample: '0' same, '10'+3 bits, '110'+7 bits, '111'+12 bits absolute
+//   humidity    '0' same, '10'+2 bits delta, '11'+7 bits absolute+1 bit battery (battery changes only this way)
+// Deltas are two's complement. Every block starts from time first_time, interval 0, temperature 0, humidity 0 and
+// battery 0, so any block decodes on its own.
+//
+// The newest blocks are kept in a RAM pool. When the pool runs low, the oldest complete blocks are appended to a ring of
+// segment files in one write. A full segment moves the log to the next one, which is removed first. Flash is only
+// appended to or whole files are deleted, and nothing is rewritten in place. Timestamps are uptime seconds together
+// with the boot number, because the device has no clock.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HISTORY_BLOCK_SIZE 128 //bytes, 16 byte header and the bit packed samples
+#define HISTORY_HEADER_SIZE 16
+#define HISTORY_RAM_BLOCKS 32 //4kB RAM pool
+#define HISTORY_FLUSH_BLOCKS 8 //oldest complete blocks written to the file at once when fewer blocks are free
+#define HISTORY_SENSORS 8 //sensors with an open block
+#define HISTORY_SEGMENTS 8 //segment files of the ring
+#define HISTORY_SEGMENT_BLOCKS 64 //blocks per segment file, 8kB, 64kB for the whole ring
+#define HISTORY_FILE "/history%u.bin" //segment file name, %u is the segment number
+#define HISTORY_CHUNK 512 //streamed output is handed to the sink in pieces of up to this size
+
+struct historyBlock { //stored in the segment files as is
+  uint32_t seq; //order of the blocks, continues over reboots
+  uint32_t first_time; //uptime seconds the time deltas start from
+  uint16_t boot; //boot number
+  uint16_t sensor; //protocolSensor(), address and channel
+  uint8_t protocol;
+  uint8_t count; //samples
+  uint16_t bits; //bits used
+  uint8_t data[HISTORY_BLOCK_SIZE-HISTORY_HEADER_SIZE];
+};
+
+struct historySample {
+  uint32_t time; //uptime seconds
+  int16_t temperature; //tenths of C
+  uint8_t humidity;
+  uint8_t battery_low;
+};
+
+struct historyQuery { ///history?protocol=newentor&address=A5&channel=1&last=3600, every parameter is optional
+  int16_t protocol; //rfProtocolId, -1 for all
+  int16_t address; //-1 for all
+  int16_t channel; //as in the JSON readings, -1 for all
+  uint32_t last; //seconds before now within the current boot, 0 for all samples of all boots
+};
+
+struct historyStatistics {
+  uint32_t samples; //samples added
+  uint32_t sample_bits; //encoded bits of all samples
+  uint32_t blocks; //blocks started
+  uint32_t flushed_blocks; //blocks written to the file
+  uint32_t flushed_samples; //samples in the written blocks
+  uint32_t flushed_bits; //encoded bits of the samples in the written blocks
+  uint32_t file_bytes; //bytes written to the file
+  uint32_t appends; //file writes
+  uint32_t segments_removed; //segments deleted to make room
+  uint32_t dropped_blocks; //blocks lost because the file could not be written
+};
+
+extern historyStatistics historyStats;
+
+typedef void (*historySink)(const char *text, size_t len, void *context);
+
+void historyBegin(); //find the end of the log and the boot number, call after the file system is mounted
+void historyAdd(uint8_t protocol, uint64_t data, uint32_t now); //record a reading, now is halMillis()
+void historyLoop(); //write the oldest blocks to the file when the RAM pool runs low
+void historyFlushAll(); //write all blocks with samples to the file, before a restart
+uint8_t historyDecode(const historyBlock &block, historySample *samples); //decode up to 255 samples of a block
+void historyQueryBegin(historyQuery &query); //all samples
+bool historyQueryArg(historyQuery &query, const char *name, const char *value); //protocol, address, channel or last, false if invalid
+size_t historyStream(const historyQuery &query, historySink sink, void *context); //CSV in block order, oldest first, returns the length
+uint8_t historyRamBlocks(); //blocks in use in the RAM pool
+uint32_t historyFileBlocks(); //blocks in the segment files
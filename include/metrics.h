@@ -0,0 +1,108 @@
+#pragma once
+// Always-on receiver metrics: counters of the RF path and the publisher, and histograms of the interrupt
+// duration in CPU cycles and of the loop() iteration time. Recording costs a few instructions, so unlike the
+// DEBUG433 prints the metrics do not change the interrupt timing they measure. Runtime and latency of the scheduler
+// tasks are included, labelled with the task name, and so are the boot phase timings labelled with the phase and the
+// bursts and lost repeats of the burst prediction, labelled with the burst_hold setting and whether deferrable work ran.
+//
+// Output formats:
+//   Prometheus text exposition format, served on /metrics
+//   JSON object of the same values, published to <mqtt_topic>/stats every stats_interval seconds if it is not 0
+
+#include <stdint.h>
+#include <stddef.h>
+#include "scheduler.h"
+#include "boot.h"
+#include "predict.h"
+
+#define METRICS_BUCKETS 14 //histogram buckets with an upper bound, plus one for larger values (+Inf)
+#define METRICS_ISR_FIRST 32 //cycles, upper bound of the first interrupt duration bucket, doubled for every next bucket
+#define METRICS_LOOP_FIRST 64 //us, upper bound of the first loop time bucket
+#define METRICS_LATENCY_FIRST 16 //ms, upper bound of the first publish latency bucket
+#define METRICS_PREFIX "newentor_" //Prometheus metric name prefix
+#define METRICS_STATS_TOPIC "/stats" //appended to mqtt_topic
+#define METRICS_CHUNK 512 //output is handed to the sink in pieces of up to this size
+
+enum metricId {
+  METRIC_UPTIME,
+  METRIC_EDGES,
+  METRIC_PREAMBLES,
+  METRIC_RESTARTS,
+  METRIC_ERROR_PULSE,
+  METRIC_ERROR_LENGTH,
+  METRIC_FRAMES,
+  METRIC_GLITCHES,
+  METRIC_BACKOFFS,
+  METRIC_BACKOFF_TIME,
+  METRIC_SUPPRESSED,
+  METRIC_QUEUE_OVERFLOWS,
+  METRIC_INVALID,
+  METRIC_BAD_CRC,
+  METRIC_BURSTS,
+  METRIC_BURSTS_FAILED,
+  METRIC_DUPLICATES,
+  METRIC_PUBLISHED,
+  METRIC_PUBLISH_FAILED,
+  METRIC_PUBLISH_DROPPED,
+  METRIC_CONNECT_FAILURES,
+  METRIC_OUTBOX_DEPTH,
+  METRIC_OUTBOX_DROPPED,
+  METRIC_PREDICT_SENSORS,
+  METRIC_PREDICT_HITS,
+  METRIC_PREDICT_MISSES,
+  METRIC_PREDICT_EMPTY,
+  METRIC_PREDICT_ERROR,
+  METRIC_PREDICT_HOLDS,
+  METRIC_AGGREGATE_SENSORS,
+  METRIC_AGGREGATE_SENSOR_BYTES,
+  METRIC_AGGREGATE_MESSAGES,
+  METRIC_AGGREGATE_FAILED,
+  METRIC_AGGREGATE_RESTORED,
+  METRIC_QUALITY_SCORED,
+  METRIC_QUALITY_SCORE_SUM,
+  METRIC_QUALITY_CLAIMS_SENT,
+  METRIC_QUALITY_CLAIMS_RECEIVED,
+  METRIC_QUALITY_WON,
+  METRIC_QUALITY_LOST,
+  METRIC_STREAM_RECORDS,
+  METRIC_STREAM_FAILED,
+  METRIC_STREAM_REPEATS,
+  METRIC_STREAM_CLIENTS,
+  METRIC_HEAP_FREE,
+  METRIC_HEAP_FREE_MIN,
+  METRIC_HEAP_MAX_BLOCK,
+  METRIC_HEAP_MAX_BLOCK_MIN,
+  METRIC_HEAP_FRAGMENTATION,
+  METRIC_HEAP_FRAGMENTATION_MAX,
+  METRIC_CPU_FREQUENCY,
+  METRICS
+};
+
+struct metricsHistogram { //buckets are not cumulative, the last one counts values above all bounds
+  uint32_t buckets[METRICS_BUCKETS+1];
+  uint32_t count;
+  uint64_t sum;
+};
+
+struct metricsSnapshot { //consistent copy of all metrics, taken before formatting
+  uint32_t values[METRICS];
+  metricsHistogram isr; //cycles per interrupt
+  metricsHistogram loop; //us per loop() iteration
+  metricsHistogram latency; //ms from queueing a reading to publishing it
+  schedulerTask tasks[SCHEDULER_TASKS]; //scheduler task statistics
+  uint8_t task_count;
+  uint32_t boot[BOOT_PHASES]; //ms since power on when the phase was reached, 0 if not yet
+  uint32_t bursts[2][2]; //predictStatistics.bursts
+  uint32_t lost[2][2]; //predictStatistics.lost
+};
+
+typedef void (*metricsSink)(const char *text, size_t len, void *context);
+
+void metricsIsr(uint32_t cycles); //record the duration of one interrupt, called from interrupt context
+void metricsLoopTime(uint32_t us); //record the duration of one loop() iteration
+void metricsPublishLatency(uint32_t ms); //record the time a reading waited in the outbox
+void metricsTake(metricsSnapshot &snapshot);
+size_t metricsPrometheus(const metricsSnapshot &snapshot, metricsSink sink, void *context); //returns the length of the output
+size_t metricsJson(const metricsSnapshot &snapshot, metricsSink sink, void *context);
+void metricsBegin(); //apply the stats_interval setting, call after the config is loaded
+void metricsLoop(); //publish the stats topic when it is due
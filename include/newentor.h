@@ -0,0 +1,57 @@
+#pragma once
+// Newentor Q5 (InFactory) sensor datagram decoding.
+// CRC check is copied from rtl_433 project https://github.com/merbanan/rtl_433 InFactory sensor plugin.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NEWENTOR_JSON_SIZE 160 //buffer size required by newentorToJson()
+
+enum newentorStatus {
+  NEWENTOR_OK = 0,
+  NEWENTOR_INVALID, //channel bits are empty
+  NEWENTOR_BAD_CRC
+};
+
+struct sensorReading {
+  char address[3]; //sensor address HEX representation, gets reset every battery change
+  int channel; //sensor channel 1-3
+  int tempF; //tenths of degree
+  int tempC; //tenths of degree
+  int humidity;
+  int battery_low; //0=battery ok, 1=battery low
+  int confidence; //repeats of the burst that agreed with the published datagram
+  uint8_t protocol; //rfProtocolId of the sensor, see protocol.h
+};
+
+//field extraction from the 40 bit datagram, first received bit is bit 39:
+//  Address |CRC4|?|B|??|Temperature |Humidity|??|Ch
+//  39..32   31..28 26   23..12       11..4       1..0
+inline uint8_t newentorAddress(uint64_t data) { return (data >> 32) & 0xFF; }
+inline uint8_t newentorCrc(uint64_t data) { return (data >> 28) & 0x0F; }
+inline uint8_t newentorBattery(uint64_t data) { return (data >> 26) & 1; } // 0=battery ok, 1=battery low
+inline uint16_t newentorTempRaw(uint64_t data) { return (data >> 12) & 0xFFF; } // encoded temperature in F
+inline uint8_t newentorHumidity(uint64_t data) { return ((data >> 8) & 0x0F) * 10 + ((data >> 4) & 0x0F); } // BCD, 'A0'=100%rH
+inline uint8_t newentorChannel(uint64_t data) { return data & 0x03; } // sensor channel 1-3
+inline bool newentorValid(uint64_t data) { return data & 0x0F; } // channel nibble is never empty
+
+inline void newentorToBytes(uint64_t data, uint8_t *bytes) { //byte array representation of the datagram
+  for (uint8_t i=0;i<5;i++) bytes[i] = data >> (32-8*i);
+}
+
+inline uint64_t newentorFromBytes(const uint8_t *bytes) {
+  uint64_t data = 0;
+  for (uint8_t i=0;i<5;i++) data = (data << 8) | bytes[i];
+  return data;
+}
+
+double convertFtoC(double f); //convert F to C and round to 1 decimal, floating point reference of newentorFtoC()
+int newentorFtoC(int tempF); //convert tenths of F to tenths of C, same rounding as convertFtoC()
+uint8_t crc4(uint8_t const message[], unsigned nBytes, uint8_t polynomial, uint8_t init); //bitwise reference implementation
+uint8_t newentorCrc4(uint32_t body); //table driven crc4(), polynomial 0x13 and init 0, of the 4 message bytes packed big endian
+bool newentorCrcCheck(uint64_t data); //CRC check of the packed datagram, done before any field decoding
+int infactory_crc_check(const uint8_t *b);
+newentorStatus newentorCheck(uint64_t data); //validity and CRC check without decoding the fields
+void newentorFields(uint64_t data, sensorReading &reading); //decode the fields without checking the datagram
+newentorStatus newentorDecode(uint64_t data, sensorReading &reading); //check and decode the datagram, fields are only filled if it is valid
+size_t newentorToJson(const sensorReading &reading, char *buf, size_t size); //format the MQTT message json of any protocol, needs NEWENTOR_JSON_SIZE bytes. returns length or 0
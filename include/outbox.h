@@ -0,0 +1,39 @@
+#pragma once
+// Outbox of readings waiting to be published. Readings are queued in RAM and spill to an append-only
+// LittleFS log when the ring is full, so a broker outage does not lose them and spilled records survive a reboot.
+// Order is preserved: the RAM ring always holds the oldest records, while the log is in use new records
+// are appended to it and the ring is refilled from the log when it runs empty.
+// Delivery from the log is at least once: a batch moved to RAM is sent again if the device reboots before
+// the batch is published.
+
+#include <stdint.h>
+
+#define OUTBOX_RAM_SIZE 32 //records held in RAM, power of 2
+#define OUTBOX_FILE_RECORDS 4096 //maximum records in the log file (64kB), newer records are dropped when full
+#define OUTBOX_FILE "/outbox.bin" //spilled records
+#define OUTBOX_POS_FILE "/outbox.pos" //index of the first record in the log that was not published
+
+struct outboxRecord { //fixed size so that the log can be read at any record offset
+  uint64_t data; //datagram
+  uint32_t time; //halMillis() when the reading was queued, 0 if queued before the last reboot
+  uint8_t confidence; //repeats agreeing with the published datagram
+  uint8_t protocol; //rfProtocolId, 0 (Newentor) in logs of older versions
+  uint8_t quality; //qualityScore() of the burst, 0 in logs of older versions
+  uint8_t reserved;
+};
+
+struct outboxStatistics {
+  uint32_t queued; //records accepted
+  uint32_t spilled; //records written to the log file
+  uint32_t dropped; //records lost because the log file was full or could not be written
+};
+
+extern outboxStatistics outboxStats;
+
+void outboxBegin(); //pick up records spilled before a reboot, call after the file system is mounted
+bool outboxPush(const outboxRecord &record); //false if the record was dropped
+bool outboxPeek(outboxRecord &record); //oldest pending record, false if the outbox is empty
+uint8_t outboxPeekMany(outboxRecord *records, uint8_t max); //copy up to max oldest records held in RAM, returns the count
+void outboxPop(uint8_t count); //remove the oldest records after they were published
+uint32_t outboxDepth(); //records pending in RAM and in the log file
+uint32_t outboxOldestAge(uint32_t now); //ms the oldest pending record has been waiting, 0 if empty
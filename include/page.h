@@ -0,0 +1,18 @@
+#pragma once
+// HTML pages rendered from a printf style template in flash straight into a chunked response. Neither the page nor
+// the substituted settings are copied into a buffer of the whole page or into String objects, the text is collected
+// in a PAGE_CHUNK byte buffer on the stack and handed to the sink whenever it is full.
+//
+// Conversions: %s is HTML escaped (& < > " '), so settings are safe inside attribute values. %u %d %x with one l
+// modifier, flags, a field width and %% are formatted like printf. Other conversions are not supported.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#define PAGE_CHUNK 512 //bytes handed to the sink at once
+
+typedef void (*pageSink)(const char *text, size_t len, void *context);
+
+size_t pagePrintf(pageSink sink, void *context, const char *format, ...); //format in PROGMEM (PSTR), returns the length of the output
+size_t pageVprintf(pageSink sink, void *context, const char *format, va_list args);
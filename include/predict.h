@@ -0,0 +1,57 @@
+#pragma once
+// Burst prediction. Sensors transmit on a fairly regular period, so the period and phase of every sensor are learned
+// from its valid bursts and the next bursts are expected in a window around the last one plus whole periods. While a
+// window is open, deferrable work (web requests, OTA, MQTT reconnects, flash writes) is held back by the scheduler,
+// because it stalls loop() and the WiFi stack while the repeats arrive. The edge storm governor (rf_receiver.h) keeps
+// the RF interrupt on during the windows, so a preamble arriving in a noise storm is not lost to a backoff.
+//
+// Accuracy: a burst of a learned sensor is a hit if it arrived within the window, a miss otherwise, and every window
+// that passed without a burst of its sensor is counted as empty. To see the effect of holding, the repeats missing from
+// bursts are counted separately for bursts during which a deferrable task ran and for the other bursts, both with
+// holding on and off (burst_hold setting).
+
+#include <stdint.h>
+#include "burst.h"
+
+#define PREDICT_SENSORS 8 //sensors learned, least recently seen sensor is replaced when the table is full
+#define PREDICT_PERIOD_MIN 10000000 //us, bursts closer than this are the same transmission (12 repeat Nexus bursts)
+#define PREDICT_PERIOD_MAX 300000000 //us, longest transmit period learned
+#define PREDICT_SKIPS_MAX 8 //missed transmissions bridged before the sensor is learned again
+#define PREDICT_MIN_INTERVALS 3 //intervals learned before windows are predicted
+#define PREDICT_MISSES_MAX 3 //misses in a row before the sensor is learned again
+#define PREDICT_MARGIN_MIN 150000 //us, window opens this long before and closes this long after the expected burst
+#define PREDICT_MARGIN_MAX 2000000 //us, widest margin of a sensor with irregular timing
+#define PREDICT_LEAD 250000 //us, work is held back this long before the window, a task can not be interrupted
+#define PREDICT_ACTIVITIES 8 //recent runs of deferrable tasks remembered for the loss statistics
+#define PREDICT_ACTIVITY_MIN 2000 //us, shorter runs of deferrable tasks do not count as activity
+
+struct predictSensor {
+  uint32_t last; //micros() time of the last burst
+  uint32_t period; //us, learned transmit period
+  uint32_t deviation; //us, mean absolute deviation of the arrivals from the prediction
+  uint16_t sensor; //protocolSensor(), address and channel
+  uint8_t protocol;
+  uint8_t intervals; //intervals learned, saturates at 255
+  uint8_t misses; //misses in a row
+  bool used;
+};
+
+struct predictStatistics {
+  uint32_t hits; //bursts of learned sensors within their window
+  uint32_t misses; //bursts of learned sensors outside their window
+  uint32_t empty; //windows without a burst
+  uint32_t error_ms; //sum of the absolute arrival errors of the hits, ms
+  uint32_t holds; //times holding started
+  uint32_t bursts[2][2]; //[holding on][deferrable task ran during the burst]
+  uint32_t lost[2][2]; //repeats missing from these bursts
+};
+
+extern predictStatistics predictStats;
+
+void predictBegin(bool hold); //hold false only learns and measures, deferrable work is never held back
+void predictBurst(const rfBurst &burst); //learn from a completed burst, valid or not
+bool predictHold(uint32_t now); //a window is open or about to open, now is halMicros()
+bool predictExpect(uint32_t now); //like predictHold() but regardless of burst_hold and not counted, for the RF governor
+void predictActivity(uint32_t start, uint32_t end); //a deferrable task ran from start to end, halMicros()
+bool predictHolding(); //holding is on
+uint8_t predictLearned(); //sensors with predicted windows
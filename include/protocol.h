@@ -0,0 +1,85 @@
+#pragma once
+// 433MHz sensor protocols. Every protocol is a constexpr descriptor: pulse distance timing, datagram length,
+// validity/CRC check and the map of the sensor fields in the datagram. The pulse state machines of all enabled
+// protocols are generated from the descriptors at compile time (rf_decoder.h), checks and field decoding run in loop().
+// To add a protocol: add its id before RF_PROTOCOLS, a descriptor below, its check function and table entry in protocol.cpp,
+// and list it in the decoder set in rf_receiver.cpp.
+
+#include <stdint.h>
+#include "rf_receiver.h"
+#include "newentor.h"
+
+#ifndef RF_ENABLE_NEXUS
+#define RF_ENABLE_NEXUS 1 //decode Nexus sensors next to Newentor, set to 0 in build_flags to save interrupt time
+#endif
+
+enum rfProtocolId : uint8_t {
+  RF_PROTOCOL_NEWENTOR = 0,
+  RF_PROTOCOL_NEXUS,
+  RF_PROTOCOLS
+};
+
+struct rfField { //bit field of the datagram, shift counts from the last received bit
+  uint8_t shift;
+  uint8_t width;
+};
+
+enum rfTemperatureCoding : uint8_t {
+  RF_TEMP_F_OFFSET_900, //unsigned tenths of F plus 90F
+  RF_TEMP_C_SIGNED //two's complement tenths of C
+};
+
+enum rfHumidityCoding : uint8_t {
+  RF_HUMIDITY_BCD, //two BCD digits, 'A0' is 100%
+  RF_HUMIDITY_BINARY
+};
+
+struct rfProtocol {
+  const char *name;
+  uint8_t id;
+  uint8_t bits; //datagram length, at most DATAGRAM
+  uint8_t repeats; //datagrams per burst sent by the sensor
+  bool adaptive; //decoder uses the learned windows of rfTimings (timing.h) instead of timing, one protocol only
+  rfTiming timing; //pulse distance coding: fixed pulse, pause length is the bit, long pause before the first bit
+  newentorStatus (*check)(uint64_t data); //validity and CRC check, called from loop()
+  rfField address, channel, battery, temperature, humidity;
+  uint8_t channel_offset; //added to the channel field
+  rfTemperatureCoding temperature_coding;
+  rfHumidityCoding humidity_coding;
+};
+
+newentorStatus nexusCheck(uint64_t data);
+
+inline constexpr rfProtocol protocolNewentor = {
+  "newentor", RF_PROTOCOL_NEWENTOR, 40, 6, true,
+  {NEWDATA_MIN, NEWDATA_MAX, ONE_MIN, ONE_MAX, ZERO_MIN, ZERO_MAX, PULSE_MIN, PULSE_MAX},
+  newentorCheck,
+  {32, 8}, {0, 2}, {26, 1}, {12, 12}, {4, 8}, 0,
+  RF_TEMP_F_OFFSET_900, RF_HUMIDITY_BCD
+};
+
+//Nexus / Rubicson compatible sensors, layout from rtl_433 nexus.c:
+//  Address |B|?|Ch|Temperature |1111|Humidity
+//  35..28   27 25..24 23..12    11..8  7..0
+inline constexpr rfProtocol protocolNexus = {
+  "nexus", RF_PROTOCOL_NEXUS, 36, 12, false,
+  {3400, 4800, 1600, 2500, 700, 1400, 300, 700},
+  nexusCheck,
+  {28, 8}, {24, 2}, {27, 1}, {12, 12}, {0, 8}, 1,
+  RF_TEMP_C_SIGNED, RF_HUMIDITY_BINARY
+};
+
+inline constexpr uint32_t rfFieldGet(uint64_t data, rfField field) {
+  return (data >> field.shift) & ((1UL << field.width)-1);
+}
+
+inline constexpr uint64_t rfProtocolMask(const rfProtocol &protocol) {
+  return (1ULL << protocol.bits)-1;
+}
+
+const rfProtocol *protocolGet(uint8_t id); //NULL for an unknown id
+const char *protocolName(uint8_t id);
+newentorStatus protocolCheck(uint8_t id, uint64_t data); //NEWENTOR_INVALID for an unknown protocol
+uint16_t protocolSensor(uint8_t id, uint64_t data); //address and channel, identifies the sensor within the protocol
+void protocolFields(uint8_t id, uint64_t data, sensorReading &reading); //decode the fields without checking the datagram
+newentorStatus protocolDecode(uint8_t id, uint64_t data, sensorReading &reading); //check and decode, fields are only filled if valid
@@ -0,0 +1,55 @@
+#pragma once
+// MQTT publishing from the outbox. Reconnects with exponential backoff and jitter so that a dead
+// broker costs one bounded connect attempt per backoff period instead of stalling every loop.
+//
+// Publish modes (publish_mode setting):
+//   json   - one JSON object per reading (default)
+//   batch  - JSON array of the readings collected over batch_interval ms or up to batch_size readings
+//   binary - PUBLISH_RECORD_SIZE byte records per reading, collected like in batch mode:
+//            bytes 0-4 datagram as received (right aligned), byte 5 protocol id in bits 7-5 and confidence in bits 4-0,
+//            bytes 6-7 seconds since reception (big endian, 0xFFFF if unknown or longer), so a consumer decodes the
+//            datagram with the same protocol rules. Newentor is protocol 0
+
+#include <stdint.h>
+#include <stddef.h>
+#include "outbox.h"
+#include "newentor.h"
+#include "quality.h"
+
+#define MQTT_BACKOFF_MIN 1000 //ms, first retry after a failed connect
+#define MQTT_BACKOFF_MAX 60000 //ms, retry period while the broker stays unreachable
+#define MQTT_CONNECT_TIMEOUT 500 //ms, TCP connect timeout of the client socket
+#define MQTT_SOCKET_TIMEOUT 2 //seconds to wait for CONNACK
+#define PUBLISH_PER_LOOP 4 //messages sent per loop, keeps the loop responsive while a backlog drains
+#define PUBLISH_BATCH_MAX OUTBOX_RAM_SIZE //largest batch_size, a batch is taken from the RAM part of the outbox
+#define PUBLISH_RECORD_SIZE 8 //bytes per reading in binary mode
+#define PUBLISH_RATE_PERIOD 60000 //ms, publish rates are counted over this period
+#define PUBLISH_JSON_SIZE (NEWENTOR_JSON_SIZE+QUALITY_JSON_SIZE) //reading message with the quality fields
+
+enum publishMode {PUBLISH_JSON, PUBLISH_BATCH, PUBLISH_BINARY, PUBLISH_MODES};
+
+struct publishModeStatistics { //counted separately for every mode
+  uint32_t messages; //messages published
+  uint32_t readings; //readings in the published messages
+  uint32_t bytes; //payload bytes
+  uint32_t messages_per_period; //messages published in the last complete PUBLISH_RATE_PERIOD
+  uint32_t bytes_per_period; //payload bytes published in the last complete PUBLISH_RATE_PERIOD
+};
+
+struct publisherStatistics {
+  uint32_t published; //messages accepted by the client
+  uint32_t failed; //publish calls that failed, the message stays in the outbox
+  uint32_t dropped; //readings removed from the outbox because they can not be formatted, e.g. corrupted in the outbox file
+  uint32_t connects; //successful connects
+  uint32_t connect_failures; //failed connect attempts
+};
+
+extern publisherStatistics publisherStats;
+extern publishModeStatistics publishModeStats[PUBLISH_MODES];
+
+void publisherBegin(); //apply the publish mode settings, call after the config is loaded
+void publisherLoop(); //keep the broker connection up and publish pending readings
+uint32_t publisherBackoff(); //ms until the next connect attempt, 0 if connected
+publishMode publisherMode();
+const char *publishModeName(publishMode mode);
+size_t publishBinaryRecord(const outboxRecord &record, uint32_t now, uint8_t *buf); //PUBLISH_RECORD_SIZE bytes
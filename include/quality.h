@@ -0,0 +1,55 @@
+#pragma once
+// Frame quality and cross-receiver deduplication for installations where several receivers hear the same sensors.
+// Every published reading carries a quality score, a fingerprint of the datagram and the receiver ID, so a backend
+// can keep the best copy:
+//   Quality     - 0-100, weighted from the repeats received of the burst, the repeats agreeing with the consensus and
+//                 the timing margin of the bits, how far the pause of every bit was from the edges of its ONE/ZERO
+//                 window (rfTimings) in % of half the window. Protocols without recorded durations (all but the
+//                 adaptive one) are scored from repeats and agreement only
+//   Fingerprint - 8 hex digits, FNV-1a of the protocol and the datagram bytes, the same on every receiver
+//   Receiver    - receiver_id setting, the hostname if it is empty
+// There is no clock shared by the receivers, so the time bucket of a fingerprint is applied on reception: copies of a
+// fingerprint only match within QUALITY_CLAIM_AGE, a sensor sending the same reading again later is a new reading.
+//
+// Leader election (leader_election setting): a receiver announces the fingerprint and quality of every new reading on
+// <mqtt_topic>/claims as "<fingerprint> <quality> <receiver>", subscribes to the claims of the others and holds the
+// reading for QUALITY_ELECTION ms, longer than a burst completed by timeout arrives late. If another receiver claimed
+// the fingerprint with a higher quality, or the same quality and a lower receiver hash, the reading is dropped,
+// otherwise it is queued for publishing. Without a broker connection readings are queued right away.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "burst.h"
+#include "outbox.h"
+
+#define QUALITY_WEIGHT_REPEATS 40 //weights of the score parts, sum is 100
+#define QUALITY_WEIGHT_AGREE 30
+#define QUALITY_WEIGHT_MARGIN 30
+#define QUALITY_JSON_SIZE 96 //fields appended to a reading message
+#define QUALITY_TOPIC "/claims" //appended to mqtt_topic
+#define QUALITY_ELECTION 1000 //ms a reading is held for the claims of the other receivers, more than BURST_GAP
+#define QUALITY_CLAIM_AGE 10000 //ms a claim of another receiver is kept
+#define QUALITY_CLAIMS 16 //claims of other receivers kept, the oldest is replaced
+#define QUALITY_PENDING 8 //readings held for the election, further readings are queued without election
+
+struct qualityStatistics {
+  uint32_t scored; //valid bursts scored
+  uint32_t score_sum; //sum of their scores
+  uint32_t claims_sent;
+  uint32_t claims_received; //claims of other receivers
+  uint32_t won; //readings queued after the election
+  uint32_t lost; //readings dropped because another receiver had a better copy
+};
+
+extern qualityStatistics qualityStats;
+
+void qualityBegin(); //apply the receiver_id and leader_election settings, call after the config is loaded
+uint8_t qualityMargin(const rfFrame &frame); //timing margin of a received datagram in %, call before the next frame arrives
+uint8_t qualityScore(const rfBurst &burst);
+uint32_t qualityFingerprint(uint8_t protocol, uint64_t data);
+const char *qualityReceiver(); //receiver ID
+size_t qualityJson(const outboxRecord &record, char *buf, size_t size); //fields of the reading message, starting with ','
+bool qualityElect(const outboxRecord &record); //hold a new reading for the election, false if it is to be queued now
+void qualityConnected(); //subscribe to the claims after every broker connect
+void qualityLoop(); //queue or drop the readings whose election is over
+bool qualityElecting(); //leader election is on
@@ -0,0 +1,8 @@
+#pragma once
+// Received datagram processing: burst assembly, duplicate filtering and queueing to the outbox.
+
+#include "rf_receiver.h"
+#include "burst.h"
+
+void sendDatagram(const rfBurst &burst); //queue the consensus datagram of a burst for publishing
+void processFrames(); //drain the datagrams received by the interrupt and queue them for publishing
@@ -0,0 +1,90 @@
+#pragma once
+// Pulse state machines generated from the protocol descriptors. rfDecoderSet advances the decoders of all listed
+// protocols by one edge in a single pass: every decoder is a template on its descriptor, so the windows of fixed
+// timing protocols are immediate constants and the calls are unrolled and inlined at compile time, no virtual
+// dispatch or descriptor lookup happens in the interrupt.
+//
+// Output is a class with two static functions called from interrupt context:
+//   void frame(uint64_t data, uint8_t protocol, uint32_t time, bool adaptive); //complete datagram
+//   rfFrameTiming *timing(); //buffer for the durations of the datagram being received, used by the adaptive protocol
+
+#include "protocol.h"
+
+#define RF_ALWAYS_INLINE inline __attribute__((always_inline))
+
+template <const rfProtocol &P> struct rfDecoder {
+  static_assert(P.bits<=DATAGRAM, "datagram does not fit the frame");
+  uint64_t datagram = 0; //shift register receiving the datagram, bits are shifted in from the right
+  uint8_t index = 0;
+  bool receiving = false;
+
+  template <uint16_t rfTiming::*Limit> static RF_ALWAYS_INLINE uint16_t window() {
+    if constexpr (P.adaptive) return rfTimings.*Limit; //learned, changes at runtime
+    else return P.timing.*Limit;
+  }
+
+  template <class Output> RF_ALWAYS_INLINE void edge(bool state, uint32_t duration, uint32_t time) {
+    if (state){//rising edge, duration is the pause before it
+      if (duration>window<&rfTiming::newdata_min>() && duration<window<&rfTiming::newdata_max>()){ //preamble pause
+        #if DEBUG433
+        halDebug("%s %s %lu\n", P.name, receiving ? "new_new_data" : "new_data", (unsigned long)duration);
+        #endif
+        if (receiving) rfStats.restarts++; //new datagram in the middle of the previous one
+        else rfStats.preambles++;
+        index=0;
+        receiving=true;
+        if constexpr (P.adaptive) Output::timing()->preamble=duration;
+        return;
+      }
+      if (!receiving) return;
+      if (duration>window<&rfTiming::one_min>() && duration<window<&rfTiming::one_max>()){ //received 1
+        #if DEBUG433
+        halDebug("%s 1 %lu\n", P.name, (unsigned long)duration);
+        #endif
+        datagram=(datagram<<1)|1;
+      }
+      else if (duration>window<&rfTiming::zero_min>() && duration<window<&rfTiming::zero_max>()){ //received 0
+        #if DEBUG433
+        halDebug("%s 0 %lu\n", P.name, (unsigned long)duration);
+        #endif
+        datagram<<=1;
+      }
+      else { //intervals do not match
+        #if DEBUG433
+        halDebug("%s error_length %lu\n", P.name, (unsigned long)duration);
+        #endif
+        index=0;
+        receiving=false;
+        rfStats.error_length++;
+        return;
+      }
+      if constexpr (P.adaptive) Output::timing()->gaps[index]=duration;
+      if (++index==P.bits){
+        Output::frame(datagram & rfProtocolMask(P), P.id, time, P.adaptive); //bits of the previous attempts are shifted out
+        index=0;
+        receiving=false;
+      }
+    }
+    else if (receiving) { //falling edge, duration is the pulse
+      if (duration<window<&rfTiming::pulse_min>() || duration>window<&rfTiming::pulse_max>()){ //out of sync
+        #if DEBUG433
+        halDebug("%s error_pulse %lu\n", P.name, (unsigned long)duration);
+        #endif
+        index=0;
+        receiving=false;
+        rfStats.error_pulse++;
+        return;
+      }
+      #if DEBUG433
+      halDebug("%s sep %lu\n", P.name, (unsigned long)duration);
+      #endif
+      if constexpr (P.adaptive) Output::timing()->pulses[index]=duration;
+    }
+  }
+};
+
+template <class Output, const rfProtocol &... P> struct rfDecoderSet : rfDecoder<P>... {
+  RF_ALWAYS_INLINE void edge(bool state, uint32_t duration, uint32_t time) {
+    (rfDecoder<P>::template edge<Output>(state, duration, time), ...);
+  }
+};
@@ -0,0 +1,103 @@
+#pragma once
+// RF 433MHz pulse decoder. Turns the edges of the receiver output into datagrams of the enabled protocols (protocol.h).
+//
+// Front end in the interrupt, before the decoders:
+//   glitch filter  an edge is held back until the next one arrives. If the two are less than RF_GLITCH_MIN apart, both
+//                  are dropped, so a noise spike is merged into the pulse or pause around it instead of breaking it
+//   governor       superregenerative receivers output a constant stream of noise edges while nobody transmits. If the
+//                  edge rate over RF_GOVERNOR_WINDOW exceeds the configured ceiling without a preamble, the edge
+//                  interrupt is turned off for RF_BACKOFF. After a datagram it stays on for RF_GRACE, so the repeats
+//                  of a burst are not lost, and so it does while a burst is predicted (rfGovernorExpect, predict.h).
+//                  rfGovernorPoll() turns the interrupt back on from loop(), early if a burst is predicted.
+//
+// Sampled edge source (RF_SAMPLED build flag): instead of an interrupt on every edge, the receiver output is sampled at
+// a fixed rate by a peripheral with DMA and halSamplePoll() hands the samples to rfHandleSamples() from loop(). A word of
+// 32 samples without an edge costs one compare, the edges of the other words are found with popcount and count leading
+// zeros and go through the same glitch filter, governor and decoders as the interrupt edges. Pulse and pause durations
+// are quantized to the sample period.
+
+#include <stdint.h>
+#include "hal.h"
+
+//Default time intervals to decode the signal. Times are in microseconds.
+//The decoder uses rfTimings, which start with these values and are adjusted to the sensors by timing.h.
+#define NEWDATA_MIN 7000 //preamble min
+#define NEWDATA_MAX 9000 //preamble max
+#define ONE_MIN 3200 // 1 min
+#define ONE_MAX 4900 // 1 max
+#define ZERO_MIN 1200 // 0 min
+#define ZERO_MAX 2400 // 0 max
+#define PULSE_MIN 400 // pulse min
+#define PULSE_MAX 900 // pulse max
+
+#ifndef RF_GLITCH_MIN
+#define RF_GLITCH_MIN 150 //us, shorter pulses and pauses are noise. The shortest valid one is a 300us pulse. 0 disables the filter
+#endif
+#define RF_GOVERNOR_WINDOW 10000 //us, the edge rate is measured over this time
+#define RF_BACKOFF 20000 //us the edge interrupt is off after an edge storm
+#define RF_GRACE 1000000 //us the governor does not back off after a datagram, the rest of the burst is expected
+#define RF_EDGE_RATE_DEFAULT 10000 //edges/s, about 10 times the rate of a transmission
+#ifndef RF_SAMPLED
+#define RF_SAMPLED 0 //1 samples the receiver output with I2S DMA instead of the edge interrupt, see hal_esp8266.h for the wiring
+#endif
+
+#define DATAGRAM 40  // longest datagram of all protocols
+#define DATAGRAM_MASK ((1ULL<<DATAGRAM)-1)
+#define FRAMEQUEUE_SIZE 16 //number of received datagrams buffered between the interrupt and loop(). must be a power of 2
+
+struct rfFrame { //received datagram handed over from the interrupt to loop()
+  uint64_t data; //datagram bits, last received bit is bit 0
+  uint32_t time; //micros() time of the last edge of the datagram
+  uint32_t seq; //rfStats.frames when the datagram was received, identifies its rfFrameTiming
+  uint8_t protocol; //rfProtocolId, see protocol.h
+};
+
+struct rfTiming { //decoder windows, a duration is accepted if min < duration < max
+  uint16_t newdata_min, newdata_max;
+  uint16_t one_min, one_max;
+  uint16_t zero_min, zero_max;
+  uint16_t pulse_min, pulse_max;
+};
+
+struct rfFrameTiming { //measured durations of one datagram
+  uint16_t preamble; //pause before the first bit
+  uint16_t gaps[DATAGRAM]; //pause of every bit
+  uint16_t pulses[DATAGRAM]; //pulse before every bit
+};
+
+struct rfStatistics { //pulse state machine counters, summed over the decoders of all protocols
+  uint32_t edges; //edges seen
+  uint32_t preambles; //preamble pauses starting a datagram
+  uint32_t restarts; //preamble pause seen in the middle of a datagram
+  uint32_t error_pulse; //pulse length out of range
+  uint32_t error_length; //pause length out of range
+  uint32_t frames; //complete datagrams received
+  uint32_t glitches; //edges dropped by the glitch filter
+  uint32_t backoffs; //edge storms that turned the interrupt off
+  uint32_t backoff_ms; //time the interrupt was off
+  uint32_t suppressed; //edges missed while the interrupt was off, estimated from the rate of the storm
+};
+
+struct rfEdgeRates { //edges per second over the last second
+  uint32_t accepted; //passed to the decoders
+  uint32_t glitches;
+  uint32_t suppressed;
+};
+
+extern volatile rfStatistics rfStats;
+extern volatile rfTiming rfTimings; //written by loop(), fields are read one by one by the interrupt
+extern volatile uint8_t frameQueueHighWater; //maximum number of datagrams waiting in the queue
+extern volatile uint32_t frameQueueOverflows; //number of datagrams dropped because the queue was full
+extern rfEdgeRates rfRates;
+
+void rfHandleEdge(bool state, uint32_t time); //filter an edge and advance the pulse state machines, called from interrupt context
+void rfSamplesBegin(uint32_t time, uint32_t period_ns); //start of the sample stream, time of the first sample is halMicros()
+void rfHandleSamples(const uint32_t *words, size_t count); //32 samples per word, oldest in the MSB, called from loop()
+uint32_t rfSamplesTime(); //time of the next sample, behind halMicros() by the samples not handed over yet
+void rfGovernorBegin(uint32_t edge_rate_max); //edges/s, 0 disables the governor
+void rfGovernorExpect(bool burst); //a burst is predicted, no backoff until it is cleared, call from loop()
+void rfGovernorPoll(uint32_t now); //turn the edge interrupt on again after a backoff and update rfRates, now is halMicros()
+bool rfBackedOff(); //edge interrupt is off
+bool rfReadFrame(rfFrame &frame); //take the oldest received datagram from the queue, false if the queue is empty
+uint8_t rfQueuedFrames(); //number of datagrams waiting in the queue
+bool rfReadFrameTiming(const rfFrame &frame, rfFrameTiming &timing); //durations of the frame, false if a newer frame overwrote them
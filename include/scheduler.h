@@ -0,0 +1,49 @@
+#pragma once
+// Cooperative task scheduler run from loop(). Tasks run in the order they were added, every one at most once per
+// pass and not more often than its period. Critical tasks (RF frame draining) run at the start of every pass and
+// again after every other task, so datagrams wait at most for the longest single task instead of a whole loop.
+// Once a pass has used SCHEDULER_PASS_BUDGET, the remaining due tasks are deferred to the next pass, where they run
+// regardless of the budget so that a slow task can not starve the ones after it.
+// Tasks can not be preempted, the budget of a task only counts its overruns for the statistics.
+// Deferrable tasks (heavy network and flash work) are held back while the hold function returns true, e.g. while a
+// sensor burst is expected (predict.h), but not longer than SCHEDULER_HOLD_MAX. Their runs are reported to the
+// activity function.
+
+#include <stdint.h>
+
+#define SCHEDULER_TASKS 16 //maximum number of tasks, setup() adds 13
+#define SCHEDULER_PASS_BUDGET 20000 //us, non-critical tasks due after this much time in a pass wait for the next pass
+#define SCHEDULER_HOLD_MAX 3000000 //us, a deferrable task held back this long runs anyway
+#define SCHEDULER_CRITICAL 1 //task flags
+#define SCHEDULER_DEFERRABLE 2
+
+typedef void (*schedulerFunction)();
+typedef bool (*schedulerHoldFunction)(uint32_t now); //true while deferrable tasks have to wait, now is halMicros()
+typedef void (*schedulerActivityFunction)(uint32_t start, uint32_t end); //a deferrable task ran, halMicros()
+
+struct schedulerTask {
+  const char *name;
+  schedulerFunction run;
+  uint32_t period; //us between the starts of two runs, 0 to run on every pass
+  uint32_t budget; //us, runs taking longer are counted as overruns
+  bool critical; //runs at the start of every pass and after every other task
+  bool deferrable; //waits while the hold function returns true
+  bool deferred; //skipped in the last pass because the pass budget was used up
+  bool held; //due but held back
+  uint32_t next; //halMicros() when the task is due
+  //statistics
+  uint32_t runs;
+  uint32_t overruns; //runs longer than the budget
+  uint32_t deferrals; //passes the task was due but deferred
+  uint32_t holds; //times the task was held back
+  uint32_t max_runtime; //us, longest run
+  uint32_t max_latency; //us, longest time between becoming due and starting
+  uint64_t runtime; //us, total
+};
+
+bool schedulerAdd(const char *name, schedulerFunction run, uint32_t period, uint32_t budget, uint8_t flags=0); //false if the table is full
+void schedulerSetHold(schedulerHoldFunction hold, schedulerActivityFunction activity); //either can be NULL
+bool schedulerHolding(); //deferrable work has to wait, for work done outside of deferrable tasks
+void schedulerRun(); //one pass over the tasks, call from loop()
+uint8_t schedulerCount(); //number of tasks
+const schedulerTask &schedulerGet(uint8_t index);
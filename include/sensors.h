@@ -0,0 +1,30 @@
+#pragma once
+// Latest reading of every sensor for the /api/sensors endpoint. The JSON response is rendered once after a reading
+// changed and served from the cached buffer until the next change, with an ETag so that polling clients get a 304.
+// The body only changes with the readings: LastSeen is the uptime in seconds at reception, the age is the
+// X-Uptime response header minus LastSeen.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "newentor.h"
+
+#define SENSORS_MAX 8 //sensors tracked, least recently seen sensor is replaced when the table is full
+#define SENSORS_ENTRY_SIZE (NEWENTOR_JSON_SIZE+40) //reading json plus LastSeen and Receives
+#define SENSORS_JSON_SIZE (SENSORS_MAX*SENSORS_ENTRY_SIZE+2)
+#define SENSORS_ETAG_SIZE 24
+
+struct sensorEntry {
+  uint64_t data; //last valid datagram
+  uint32_t last_seen; //halMillis() of the last reception
+  uint32_t receives; //valid bursts received, duplicates included
+  uint16_t sensor; //protocolSensor(), address and channel
+  uint8_t protocol;
+  uint8_t confidence; //repeats agreeing with the last datagram
+  bool used;
+};
+
+void sensorsUpdate(uint8_t protocol, uint64_t data, uint8_t confidence, uint32_t now); //record a valid burst
+const char *sensorsJson(size_t &len); //cached response body, rendered here if a reading changed since the last call
+const char *sensorsEtag(); //quoted ETag of the current body
+bool sensorsNotModified(const char *if_none_match); //true if the client has the current body
+uint8_t sensorsCount();
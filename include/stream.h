@@ -0,0 +1,47 @@
+#pragma once
+// Frame stream, a low latency transport next to MQTT for alerting on the LAN without a broker in the path. The first
+// repeat of a burst that passes the validity and CRC check is sent right away from processFrames() as a fixed size
+// record, later repeats of the same datagram are not sent again. No consensus, duplicate filter or outbox is waited for.
+//
+// Transports (stream_mode setting):
+//   udp - one datagram per record to stream_address:stream_port, a multicast group or a single listener
+//   tcp - the receiver listens on stream_port, every record is written to up to STREAM_CLIENTS connected subscribers.
+//         A subscriber that can not take a record is disconnected, it reconnects and sees the gap in the sequence
+//
+// Record, STREAM_RECORD_SIZE bytes, multi-byte fields big endian:
+//   0      STREAM_VERSION
+//   1      protocol, rfProtocolId
+//   2-5    sequence number, +1 per record since boot, a gap is a lost record, 0 again after a reboot
+//   6-13   receive time, us since boot of the last edge of the datagram
+//   14-17  us from the last edge to sending the record
+//   18-22  datagram as received, right aligned like the binary publish mode
+//   23     timing margin of the datagram in % (quality.h), 255 if not measured
+// A listener has no common clock with the receiver, `listen` of the native build reports the receiver part of the
+// latency exactly and adds the network transit above the fastest record of the run.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rf_receiver.h"
+
+#define STREAM_VERSION 1
+#define STREAM_RECORD_SIZE 24
+#define STREAM_CLIENTS 2 //TCP subscribers
+#define STREAM_RECENT 4 //datagrams remembered to skip the later repeats of a burst
+
+enum streamMode {STREAM_OFF, STREAM_UDP, STREAM_TCP};
+
+struct streamStatistics {
+  uint32_t records; //records sent
+  uint32_t failed; //records that could not be sent to the group or to a subscriber
+  uint32_t repeats; //later repeats not sent
+};
+
+extern streamStatistics streamStats;
+
+void streamBegin(); //apply the stream settings and open the transport, call after the network is up
+void streamFrame(const rfFrame &frame, uint8_t margin); //send a received datagram if it is valid and new, margin from qualityMargin()
+void streamLoop(); //accept TCP subscribers
+streamMode streamGetMode();
+const char *streamModeName(streamMode mode);
+uint8_t streamClients(); //connected TCP subscribers
+void streamRecord(uint32_t seq, uint8_t protocol, uint64_t time, uint32_t age, uint64_t data, uint8_t margin, uint8_t *buf); //STREAM_RECORD_SIZE bytes
@@ -0,0 +1,52 @@
+#pragma once
+// Self-calibrating pulse classifier. Learns the pulse and pause durations of every sensor from the
+// datagrams that pass the CRC check and moves the decoder windows (rfTimings) of the adaptive protocol (Newentor) to fit them, so that
+// drifting sensors and slow receivers do not end up at the edge of the fixed windows.
+// Every window is centred on the learned mean of its class and is at least as wide as the default window,
+// wider if the sensor timing spreads more. With several sensors the windows cover all of them.
+// Windows stay within safe bounds and never overlap. Learned sensor timing is stored in TIMING_FILE by timingLoop(),
+// outside of the receive path.
+
+#include <stdint.h>
+#include "rf_receiver.h"
+
+#define TIMING_SENSORS 8 //sensors learned, least recently seen sensor is replaced when the table is full
+#define TIMING_MIN_FRAMES 6 //valid datagrams of a sensor before its timing is used
+#define TIMING_EMA_SHIFT 3 //learning rate, every datagram moves the mean by 1/8 of the difference
+#define TIMING_SPREAD 4 //window half width in mean absolute deviations, if wider than the default
+#define TIMING_UPDATE_DELTA 10 //us, decoder windows are updated when a limit moved more than this
+#define TIMING_SAVE_DELTA 50 //us, windows are saved when a limit moved this much since the last save
+#define TIMING_SAVE_INTERVAL 600000 //ms, minimum time between saves to limit flash wear
+#define TIMING_FILE "/timing.bin"
+#define TIMING_BINS 64 //histogram bins per class
+
+enum timingClass {TIMING_PULSE, TIMING_ZERO, TIMING_ONE, TIMING_PREAMBLE, TIMING_CLASSES};
+
+struct timingSensor { //learned timing of one sensor, stored in TIMING_FILE as is
+  uint8_t address;
+  uint8_t channel;
+  bool used;
+  uint8_t reserved;
+  uint32_t frames; //valid datagrams learned from
+  uint32_t last_seen; //halMillis(), 0 after loading from the file
+  int32_t mean[TIMING_CLASSES]; //us*16
+  int32_t deviation[TIMING_CLASSES]; //mean absolute deviation, us*16
+};
+
+struct timingStatistics {
+  uint32_t frames; //datagrams received
+  uint32_t valid; //datagrams that passed the CRC check
+  uint32_t learned; //valid datagrams whose durations were available for learning
+  uint32_t updates; //decoder window changes
+  uint32_t saves; //writes of TIMING_FILE
+};
+
+extern timingStatistics timingStats;
+
+void timingBegin(); //load the learned timing and set the decoder windows, call after the file system is mounted
+void timingLearn(const rfFrame &frame); //learn from a received datagram, call for every datagram taken from the queue
+void timingLoop(); //write the learned timing to TIMING_FILE when it is due
+void timingReset(); //forget the learned timing and return to the default windows
+void timingSetAdaptive(bool adaptive); //false keeps the default windows, learning and statistics continue
+uint16_t timingPercentile(timingClass cls, uint8_t percent); //observed duration in us, 0 if nothing observed
+const char *timingClassName(timingClass cls);
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hal.h"
+#include "config.h"
+#include "protocol.h"
+#include "aggregate.h"
+
+struct aggregateRtcWindow { //summary of a window in RTC memory
+  int16_t temperature_min, temperature_mean, temperature_max;
+  uint8_t humidity_min, humidity_mean, humidity_max;
+  uint8_t reserved;
+  uint16_t count;
+};
+
+struct aggregateRtcSensor {
+  uint16_t sensor;
+  uint8_t protocol;
+  uint8_t used;
+  int16_t temperature;
+  uint8_t humidity;
+  uint8_t reserved;
+  aggregateRtcWindow windows[AGGREGATE_WINDOWS];
+};
+
+struct aggregateRtcHeader {
+  uint32_t magic;
+  uint32_t clock; //s
+};
+
+static_assert(sizeof(aggregateRtcSensor)%4==0, "RTC memory is written in words");
+static_assert(AGGREGATE_RTC_OFFSET+sizeof(aggregateRtcHeader)+AGGREGATE_SENSORS*sizeof(aggregateRtcSensor)<=HAL_RTC_SIZE,
+  "aggregates do not fit the RTC memory");
+
+static const uint32_t window_seconds[AGGREGATE_WINDOWS] = {300, 3600, 86400};
+static const char *const window_names[AGGREGATE_WINDOWS] = {"5m", "1h", "24h"};
+
+static aggregateSensor sensors[AGGREGATE_SENSORS];
+static uint32_t clock_seconds = 0;
+static uint32_t clock_ms = 0; //ms of the current second
+static uint32_t clock_last = 0; //halMillis() of the last clock update
+static uint32_t publish_period = 0; //aggregate_interval setting in s, 0 if the aggregates are not published
+static uint32_t publish_next = 0; //aggregate clock of the next messages
+aggregateStatistics aggregateStats = {};
+
+uint32_t aggregateClock() { //halMillis() wraps after 49 days, the clock keeps counting
+  uint32_t now = halMillis();
+  clock_ms += now-clock_last;
+  clock_last = now;
+  clock_seconds += clock_ms/1000;
+  clock_ms %= 1000;
+  return clock_seconds;
+}
+
+static void slide(aggregateWindow &window, uint8_t index, uint32_t now) { //clear the buckets the window moved past
+  uint32_t bucket = now/(window_seconds[index]/AGGREGATE_BUCKETS);
+  uint32_t steps = bucket-window.bucket;
+  if (steps>AGGREGATE_BUCKETS) steps = AGGREGATE_BUCKETS;
+  for (uint32_t i=1;i<=steps;i++) window.buckets[(window.bucket+i)%AGGREGATE_BUCKETS].count = 0;
+  window.bucket = bucket;
+}
+
+static void bucketAdd(aggregateBucket &bucket, int16_t temperature, uint8_t humidity, uint16_t count) {
+  if (!count) return;
+  if (!bucket.count) {
+    bucket = {};
+    bucket.temperature_min = bucket.temperature_max = temperature;
+    bucket.humidity_min = bucket.humidity_max = humidity;
+  }
+  bucket.temperature_sum += (int32_t)temperature*count;
+  bucket.humidity_sum += (uint32_t)humidity*count;
+  bucket.count += count;
+  if (temperature<bucket.temperature_min) bucket.temperature_min = temperature;
+  if (temperature>bucket.temperature_max) bucket.temperature_max = temperature;
+  if (humidity<bucket.humidity_min) bucket.humidity_min = humidity;
+  if (humidity>bucket.humidity_max) bucket.humidity_max = humidity;
+}
+
+static int32_t roundedDivide(int32_t value, int32_t divisor) {
+  return value<0 ? (value-divisor/2)/divisor : (value+divisor/2)/divisor;
+}
+
+void aggregateSummarize(const aggregateSensor &sensor, uint8_t window, aggregateSummary &summary) {
+  summary = {};
+  int32_t temperature_sum = 0;
+  uint32_t humidity_sum = 0, count = 0;
+  for (const aggregateBucket &bucket : sensor.windows[window].buckets) {
+    if (!bucket.count) continue;
+    if (!count || bucket.temperature_min<summary.temperature_min) summary.temperature_min = bucket.temperature_min;
+    if (!count || bucket.temperature_max>summary.temperature_max) summary.temperature_max = bucket.temperature_max;
+    if (!count || bucket.humidity_min<summary.humidity_min) summary.humidity_min = bucket.humidity_min;
+    if (!count || bucket.humidity_max>summary.humidity_max) summary.humidity_max = bucket.humidity_max;
+    temperature_sum += bucket.temperature_sum;
+    humidity_sum += bucket.humidity_sum;
+    count += bucket.count;
+  }
+  if (!count) return;
+  summary.count = count>0xFFFF ? 0xFFFF : count;
+  summary.temperature_mean = roundedDivide(temperature_sum, count);
+  summary.humidity_mean = (humidity_sum*10+count/2)/count;
+}
+
+static bool trend(const aggregateSensor &sensor, int32_t &temperature, int32_t &humidity) { //tenths per hour
+  const aggregateWindow &window = sensor.windows[1]; //1 h
+  const aggregateBucket &newest = window.buckets[window.bucket%AGGREGATE_BUCKETS];
+  if (!newest.count) return false;
+  for (uint8_t age=AGGREGATE_BUCKETS-1; age>0; age--) {
+    const aggregateBucket &oldest = window.buckets[(window.bucket-age)%AGGREGATE_BUCKETS];
+    if (!oldest.count) continue;
+    uint32_t length = window_seconds[1]/AGGREGATE_BUCKETS;
+    uint32_t filled = sensor.last_seen-window.bucket*length; //newest bucket is still filling, its readings are centred earlier
+    int32_t seconds = age*length-length/2+filled/2;
+    int32_t temperature_change = roundedDivide(newest.temperature_sum, newest.count)-roundedDivide(oldest.temperature_sum, oldest.count);
+    int32_t humidity_change = (int32_t)((newest.humidity_sum*10+newest.count/2)/newest.count)-(int32_t)((oldest.humidity_sum*10+oldest.count/2)/oldest.count);
+    temperature = roundedDivide(temperature_change*3600, seconds);
+    humidity = roundedDivide(humidity_change*3600, seconds);
+    return true;
+  }
+  return false;
+}
+
+static void saveRtc(uint8_t index) {
+  aggregateRtcHeader header = {AGGREGATE_RTC_MAGIC, clock_seconds};
+  halRtcWrite(AGGREGATE_RTC_OFFSET, &header, sizeof(header));
+  const aggregateSensor &sensor = sensors[index];
+  aggregateRtcSensor record = {};
+  record.sensor = sensor.sensor;
+  record.protocol = sensor.protocol;
+  record.used = sensor.used;
+  record.temperature = sensor.temperature;
+  record.humidity = sensor.humidity;
+  for (uint8_t w=0;w<AGGREGATE_WINDOWS;w++) {
+    aggregateSummary summary;
+    aggregateSummarize(sensor, w, summary);
+    aggregateRtcWindow &window = record.windows[w];
+    window.count = summary.count;
+    window.temperature_min = summary.temperature_min;
+    window.temperature_mean = summary.temperature_mean;
+    window.temperature_max = summary.temperature_max;
+    window.humidity_min = summary.humidity_min;
+    window.humidity_mean = (summary.humidity_mean+5)/10;
+    window.humidity_max = summary.humidity_max;
+  }
+  halRtcWrite(AGGREGATE_RTC_OFFSET+sizeof(header)+index*sizeof(record), &record, sizeof(record));
+}
+
+static void loadRtc() {
+  aggregateRtcHeader header;
+  if (!halRtcRead(AGGREGATE_RTC_OFFSET, &header, sizeof(header)) || header.magic!=AGGREGATE_RTC_MAGIC) return; //power on
+  clock_seconds = header.clock; //the time of the reset itself is lost
+  for (uint8_t i=0;i<AGGREGATE_SENSORS;i++) {
+    aggregateRtcSensor record;
+    if (!halRtcRead(AGGREGATE_RTC_OFFSET+sizeof(header)+i*sizeof(record), &record, sizeof(record)) || record.used!=1) continue;
+    aggregateSensor &sensor = sensors[i];
+    sensor = {};
+    sensor.used = true;
+    sensor.sensor = record.sensor;
+    sensor.protocol = record.protocol;
+    sensor.temperature = record.temperature;
+    sensor.humidity = record.humidity;
+    sensor.last_seen = clock_seconds;
+    for (uint8_t w=0;w<AGGREGATE_WINDOWS;w++) { //the summary is the bucket before the newest, it ages out with it
+      aggregateWindow &window = sensor.windows[w];
+      window.bucket = clock_seconds/(window_seconds[w]/AGGREGATE_BUCKETS);
+      const aggregateRtcWindow &saved = record.windows[w];
+      if (!saved.count) continue;
+      aggregateBucket &bucket = window.buckets[(window.bucket-1)%AGGREGATE_BUCKETS];
+      bucketAdd(bucket, saved.temperature_mean, saved.humidity_mean, saved.count);
+      bucket.temperature_min = saved.temperature_min;
+      bucket.temperature_max = saved.temperature_max;
+      bucket.humidity_min = saved.humidity_min;
+      bucket.humidity_max = saved.humidity_max;
+    }
+    aggregateStats.restored++;
+  }
+}
+
+void aggregateBegin() {
+  clock_last = halMillis();
+  clock_seconds = 0;
+  clock_ms = 0;
+  loadRtc();
+  clock_seconds += clock_last/1000; //setup() ran since the reset
+  clock_ms = clock_last%1000;
+  publish_period = strtoul(aggregate_interval, NULL, 10);
+  publish_next = clock_seconds+publish_period;
+}
+
+void aggregateAdd(uint8_t protocol, uint64_t data) {
+  uint32_t now = aggregateClock();
+  sensorReading reading;
+  protocolFields(protocol, data, reading);
+  uint16_t id = protocolSensor(protocol, data);
+  uint8_t index = 0, oldest = 0;
+  for (; index<AGGREGATE_SENSORS; index++) {
+    const aggregateSensor &candidate = sensors[index];
+    if (candidate.used && candidate.protocol==protocol && candidate.sensor==id) break;
+    if (!candidate.used) {
+      if (sensors[oldest].used) oldest = index; //free slot is taken before any used one
+    }
+    else if (sensors[oldest].used && now-candidate.last_seen > now-sensors[oldest].last_seen) oldest = index;
+  }
+  if (index==AGGREGATE_SENSORS) { //new sensor
+    index = oldest;
+    aggregateSensor &sensor = sensors[index];
+    sensor = {};
+    sensor.used = true;
+    sensor.sensor = id;
+    sensor.protocol = protocol;
+    for (uint8_t w=0;w<AGGREGATE_WINDOWS;w++) sensor.windows[w].bucket = now/(window_seconds[w]/AGGREGATE_BUCKETS);
+  }
+  aggregateSensor &sensor = sensors[index];
+  int16_t temperature = reading.tempC < -32768 ? -32768 : reading.tempC > 32767 ? 32767 : reading.tempC;
+  uint8_t humidity = reading.humidity > 255 ? 255 : reading.humidity;
+  sensor.last_seen = now;
+  sensor.temperature = temperature;
+  sensor.humidity = humidity;
+  for (uint8_t w=0;w<AGGREGATE_WINDOWS;w++) {
+    slide(sensor.windows[w], w, now);
+    aggregateWindow &window = sensor.windows[w];
+    bucketAdd(window.buckets[window.bucket%AGGREGATE_BUCKETS], temperature, humidity, 1);
+  }
+  saveRtc(index);
+}
+
+bool aggregateGet(uint8_t index, aggregateSensor &sensor) {
+  if (index>=AGGREGATE_SENSORS || !sensors[index].used) return false;
+  uint32_t now = aggregateClock();
+  for (uint8_t w=0;w<AGGREGATE_WINDOWS;w++) slide(sensors[index].windows[w], w, now);
+  sensor = sensors[index];
+  return true;
+}
+
+uint8_t aggregateCount() {
+  uint8_t count = 0;
+  for (const aggregateSensor &sensor : sensors) count += sensor.used;
+  return count;
+}
+
+static size_t tenths(char *buf, size_t size, int32_t value) { //18.9, -7.3, 20 like the reading messages
+  if (value%10==0) return snprintf(buf, size, "%ld", (long)(value/10));
+  return snprintf(buf, size, "%s%ld.%ld", value<0 ? "-" : "", (long)(labs(value)/10), (long)(labs(value)%10));
+}
+
+size_t aggregateJson(const aggregateSensor &sensor, char *buf, size_t size) {
+  const rfProtocol *protocol = protocolGet(sensor.protocol);
+  unsigned channel = (sensor.sensor & 0xFF) + (protocol ? protocol->channel_offset : 0);
+  size_t len = snprintf(buf, size, "{\"SensorAddress\":\"%02x\",\"Channel\":%u,\"TemperatureC\":", sensor.sensor >> 8, channel);
+  len += tenths(buf+len, len<size ? size-len : 0, sensor.temperature);
+  len += snprintf(buf+len, len<size ? size-len : 0, ",\"Humidity\":%u", sensor.humidity);
+  if (sensor.humidity>0 && sensor.humidity<=100) { //Magnus formula, over water
+    float t = sensor.temperature/10.0f;
+    float gamma = logf(sensor.humidity/100.0f) + 17.62f*t/(243.12f+t);
+    len += snprintf(buf+len, len<size ? size-len : 0, ",\"DewPointC\":");
+    len += tenths(buf+len, len<size ? size-len : 0, lroundf(243.12f*gamma/(17.62f-gamma)*10));
+  }
+  int32_t temperature_trend, humidity_trend;
+  if (trend(sensor, temperature_trend, humidity_trend)) {
+    len += snprintf(buf+len, len<size ? size-len : 0, ",\"TemperatureTrendC\":");
+    len += tenths(buf+len, len<size ? size-len : 0, temperature_trend);
+    len += snprintf(buf+len, len<size ? size-len : 0, ",\"HumidityTrend\":");
+    len += tenths(buf+len, len<size ? size-len : 0, humidity_trend);
+  }
+  for (uint8_t w=0;w<AGGREGATE_WINDOWS;w++) {
+    aggregateSummary summary;
+    aggregateSummarize(sensor, w, summary);
+    len += snprintf(buf+len, len<size ? size-len : 0, ",\"%s\":{\"Readings\":%u", window_names[w], summary.count);
+    if (summary.count) {
+      len += snprintf(buf+len, len<size ? size-len : 0, ",\"TemperatureC\":[");
+      len += tenths(buf+len, len<size ? size-len : 0, summary.temperature_min);
+      len += snprintf(buf+len, len<size ? size-len : 0, ",");
+      len += tenths(buf+len, len<size ? size-len : 0, summary.temperature_mean);
+      len += snprintf(buf+len, len<size ? size-len : 0, ",");
+      len += tenths(buf+len, len<size ? size-len : 0, summary.temperature_max);
+      len += snprintf(buf+len, len<size ? size-len : 0, "],\"Humidity\":[%u,", summary.humidity_min);
+      len += tenths(buf+len, len<size ? size-len : 0, summary.humidity_mean);
+      len += snprintf(buf+len, len<size ? size-len : 0, ",%u]", summary.humidity_max);
+    }
+    len += snprintf(buf+len, len<size ? size-len : 0, "}");
+  }
+  if (sensor.protocol!=RF_PROTOCOL_NEWENTOR) len += snprintf(buf+len, len<size ? size-len : 0, ",\"Protocol\":\"%s\"", protocolName(sensor.protocol));
+  len += snprintf(buf+len, len<size ? size-len : 0, "}");
+  return len<size ? len : 0;
+}
+
+void aggregateLoop() {
+  uint32_t now = aggregateClock();
+  static uint32_t saved = 0;
+  if (now!=saved) { //clock in RTC memory, a soft reset continues from here
+    aggregateRtcHeader header = {AGGREGATE_RTC_MAGIC, now};
+    halRtcWrite(AGGREGATE_RTC_OFFSET, &header, sizeof(header));
+    saved = now;
+  }
+  if (!publish_period || (int32_t)(now-publish_next)<0 || !halMqttConnected()) return;
+  publish_next += publish_period;
+  if ((int32_t)(now-publish_next)>=0) publish_next = now+publish_period; //was disconnected for a while
+  char topic[sizeof(mqtt_topic)+sizeof(AGGREGATE_TOPIC)];
+  if (aggregate_topic[0]) snprintf(topic, sizeof(topic), "%s", aggregate_topic);
+  else snprintf(topic, sizeof(topic), "%s" AGGREGATE_TOPIC, mqtt_topic);
+  static char msg[AGGREGATE_JSON_SIZE];
+  for (uint8_t i=0;i<AGGREGATE_SENSORS;i++) {
+    aggregateSensor sensor;
+    if (!aggregateGet(i, sensor)) continue;
+    size_t len = aggregateJson(sensor, msg, sizeof(msg));
+    bool ok = len && halMqttBeginPublish(topic, len);
+    if (ok) {
+      ok = halMqttWrite((const uint8_t*)msg, len);
+      ok = halMqttEndPublish() && ok;
+    }
+    if (ok) aggregateStats.messages++;
+    else {
+      aggregateStats.failed++;
+      #if DEBUG
+      halDebug("Failed to publish aggregates\n");
+      #endif
+    }
+  }
+}
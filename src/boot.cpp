@@ -0,0 +1,18 @@
+#include "hal.h"
+#include "boot.h"
+
+bootStatistics bootStats = {};
+
+static const char *const phase_names[BOOT_PHASES] = {"setup", "fs", "config", "wifi", "mqtt", "frame", "publish"};
+
+const char *bootPhaseName(uint8_t phase) {
+  return phase<BOOT_PHASES ? phase_names[phase] : "?";
+}
+
+const char *bootConfigSourceName() {
+  switch (bootStats.config_source) {
+    case BOOT_CONFIG_BINARY: return "binary";
+    case BOOT_CONFIG_JSON: return "json";
+    default: return "defaults";
+  }
+}
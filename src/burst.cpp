@@ -0,0 +1,141 @@
+#include "protocol.h"
+#include "burst.h"
+
+struct burstSlot { //burst being assembled
+  uint64_t frames[BURST_REPEATS];
+  uint8_t count; //0 if the slot is free
+  uint8_t protocol;
+  uint8_t repeats; //repeats that complete the burst
+  uint8_t margins; //repeats with a known timing margin
+  uint16_t margin_sum;
+  bool identified; //a repeat passed the check, sensor is set
+  uint16_t sensor; //protocolSensor() of the valid repeats
+  uint32_t first_time;
+  uint32_t last_time;
+};
+
+static burstSlot burst_slots[BURST_SLOTS];
+burstStatistics burstStats = {};
+
+static uint64_t countEquals(uint64_t c0, uint64_t c1, uint64_t c2, uint8_t k) { //bits where the 3 bit counter equals k
+  return (k & 1 ? c0 : ~c0) & (k & 2 ? c1 : ~c1) & (k & 4 ? c2 : ~c2);
+}
+
+uint64_t burstVote(const uint64_t *frames, uint8_t count) {
+  uint64_t c0 = 0, c1 = 0, c2 = 0; //bit-sliced 3 bit counters of ones, one counter per datagram bit
+  for (uint8_t i=0;i<count;i++) {
+    uint64_t carry = c0 & frames[i];
+    c0 ^= frames[i];
+    c2 |= c1 & carry;
+    c1 ^= carry;
+  }
+  uint64_t majority = 0;
+  for (uint8_t k=count/2+1;k<=count;k++) majority |= countEquals(c0, c1, c2, k); //more than half of the repeats are 1
+  return majority & DATAGRAM_MASK;
+}
+
+static void burstComplete(burstSlot &slot, burstHandler handler) {
+  rfBurst burst;
+  burst.time = slot.first_time;
+  burst.repeats = slot.count;
+  burst.protocol = slot.protocol;
+  burst.margin = slot.margins ? slot.margin_sum/slot.margins : BURST_MARGIN_UNKNOWN;
+  burst.data = burstVote(slot.frames, slot.count) & rfProtocolMask(*protocolGet(slot.protocol));
+  burst.agree = 0;
+  uint8_t valid_repeats = 0;
+  uint64_t best = 0; //most frequent valid repeat
+  uint8_t best_count = 0;
+  for (uint8_t i=0;i<slot.count;i++) {
+    if (slot.frames[i]==burst.data) burst.agree++;
+    newentorStatus status = protocolCheck(slot.protocol, slot.frames[i]);
+    if (status!=NEWENTOR_OK) {
+      if (status==NEWENTOR_BAD_CRC) burstStats.bad_crc++;
+      else burstStats.invalid++;
+      continue;
+    }
+    valid_repeats++;
+    uint8_t same = 0;
+    for (uint8_t j=0;j<slot.count;j++) same += slot.frames[j]==slot.frames[i];
+    if (same>best_count) {
+      best = slot.frames[i];
+      best_count = same;
+    }
+  }
+  //a consensus no repeat agrees with is only trusted with a real majority of 3 or more repeats and no valid repeat disagreeing,
+  //CRC-4 alone lets 1 of 16 garbage datagrams pass
+  burst.valid = protocolCheck(slot.protocol, burst.data)==NEWENTOR_OK && (burst.agree>0 || (slot.count>=3 && best_count==0));
+  if (!burst.valid && best_count>0) { //vote was spoiled by ties or noise, fall back to the best repeat that passed the CRC check
+    burst.data = best;
+    burst.agree = best_count;
+    burst.valid = true;
+  }
+  burstStats.bursts++;
+  burstStats.frames += slot.count;
+  if (burst.valid) {
+    burstStats.valid++;
+    if (valid_repeats==0) burstStats.recovered++;
+  }
+  else burstStats.failed++;
+  slot.count = 0;
+  handler(burst);
+}
+
+static uint8_t distance(uint64_t a, uint64_t b) {
+  return __builtin_popcountll(a ^ b);
+}
+
+void burstAdd(const rfFrame &frame, uint8_t margin, burstHandler handler) {
+  const rfProtocol *protocol = protocolGet(frame.protocol);
+  if (!protocol) return;
+  //a valid datagram only joins the burst of its own sensor, sensors with addresses a bit or two apart sending similar
+  //readings at the same time are within BURST_MAX_DISTANCE of each other. broken datagrams go to the nearest burst
+  bool valid = protocolCheck(frame.protocol, frame.data)==NEWENTOR_OK;
+  uint16_t sensor = valid ? protocolSensor(frame.protocol, frame.data) : 0;
+  burstSlot *match = NULL;
+  uint8_t match_distance = BURST_MAX_DISTANCE+1;
+  for (burstSlot &slot : burst_slots) {
+    if (!slot.count || slot.protocol!=frame.protocol || frame.time-slot.last_time > BURST_GAP) continue;
+    if (valid && slot.identified && slot.sensor!=sensor) continue;
+    for (uint8_t i=0;i<slot.count;i++) {
+      uint8_t d = distance(frame.data, slot.frames[i]);
+      if (d<match_distance) {
+        match = &slot;
+        match_distance = d;
+      }
+    }
+  }
+  if (!match) { //first repeat of a new burst, take a free slot or complete the oldest burst
+    match = &burst_slots[0];
+    for (burstSlot &slot : burst_slots) {
+      if (!slot.count) {
+        match = &slot;
+        break;
+      }
+      if (frame.time-slot.first_time > frame.time-match->first_time) match = &slot;
+    }
+    if (match->count) burstComplete(*match, handler);
+    match->first_time = frame.time;
+    match->protocol = frame.protocol;
+    match->repeats = protocol->repeats<BURST_REPEATS ? protocol->repeats : BURST_REPEATS;
+    match->margins = 0;
+    match->margin_sum = 0;
+    match->identified = false;
+  }
+  if (valid && !match->identified) {
+    match->identified = true;
+    match->sensor = sensor;
+  }
+  if (margin!=BURST_MARGIN_UNKNOWN) {
+    match->margins++;
+    match->margin_sum += margin;
+  }
+  match->frames[match->count++] = frame.data;
+  match->last_time = frame.time;
+  if (match->count==match->repeats) burstComplete(*match, handler);
+}
+
+void burstPoll(uint32_t now, burstHandler handler) {
+  for (burstSlot &slot : burst_slots) {
+    if (slot.count && now-slot.last_time > BURST_GAP) burstComplete(slot, handler);
+  }
+}
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "hal.h"
+#include "capture.h"
+
+static uint8_t *capture_buf = NULL; //RAM recording or ring buffer for the file writer
+static size_t capture_size = 0;
+static captureMode capture_mode = CAPTURE_TO_RAM;
+static volatile bool capture_active = false;
+static volatile uint32_t capture_head = 0; //written by the interrupt. position in the RAM buffer, free running ring index in file mode
+static uint32_t capture_tail = 0; //ring index of the next byte to be written to the file
+static uint32_t capture_last_time = 0; //time of the last recorded edge
+static uint32_t capture_started = 0; //halMillis() at start
+static uint32_t capture_duration = 0;
+static volatile uint32_t capture_edges = 0;
+static volatile uint32_t capture_dropped = 0;
+static uint32_t capture_bytes = 0;
+
+size_t captureEncodeHeader(uint8_t *out, uint32_t start) {
+  out[0] = 'N'; out[1] = 'R'; out[2] = 'C'; out[3] = CAPTURE_VERSION;
+  for (uint8_t i=0;i<4;i++) out[4+i] = start >> (8*i);
+  return CAPTURE_HEADER_SIZE;
+}
+
+IRAM_ATTR size_t captureEncodeEdge(uint8_t *out, uint32_t delta, bool state) {
+  uint64_t value = ((uint64_t)delta << 1) | state; //33 bits
+  size_t len = 0;
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[len++] = value ? byte | 0x80 : byte;
+  } while (value);
+  return len;
+}
+
+bool captureStart(captureMode mode, uint32_t duration_ms) {
+  captureStop();
+  free(capture_buf);
+  capture_size = mode==CAPTURE_TO_RAM ? CAPTURE_RAM_SIZE : CAPTURE_RING_SIZE;
+  capture_buf = (uint8_t*)malloc(capture_size);
+  if (!capture_buf) {
+    capture_size = 0;
+    return false;
+  }
+  capture_mode = mode;
+  capture_duration = duration_ms;
+  capture_started = halMillis();
+  capture_last_time = halMicros();
+  capture_edges = 0;
+  capture_dropped = 0;
+  capture_tail = 0;
+  uint8_t header[CAPTURE_HEADER_SIZE];
+  captureEncodeHeader(header, capture_last_time);
+  if (mode==CAPTURE_TO_RAM) {
+    memcpy(capture_buf, header, CAPTURE_HEADER_SIZE);
+    capture_head = CAPTURE_HEADER_SIZE;
+  } else {
+    if (!halFileWrite(CAPTURE_FILE, (const char*)header, CAPTURE_HEADER_SIZE)) return false;
+    capture_head = 0;
+  }
+  capture_bytes = CAPTURE_HEADER_SIZE;
+  std::atomic_signal_fence(std::memory_order_release); //buffers are ready before the interrupt starts writing
+  capture_active = true;
+  #if DEBUG
+  halDebug("Capture started\n");
+  #endif
+  return true;
+}
+
+IRAM_ATTR void captureEdge(bool state, uint32_t time) {
+  if (!capture_active) return;
+  uint8_t edge[CAPTURE_MAX_EDGE_SIZE];
+  size_t len = captureEncodeEdge(edge, time-capture_last_time, state);
+  uint32_t head = capture_head;
+  if (capture_mode==CAPTURE_TO_RAM) {
+    if (head+len > capture_size) { //buffer is full, recording is complete
+      capture_active = false;
+      return;
+    }
+    for (size_t i=0;i<len;i++) capture_buf[head+i] = edge[i];
+  } else {
+    if (head-capture_tail+len > capture_size) { //file writer is not keeping up. next delta is counted from the last recorded edge
+      capture_dropped++;
+      return;
+    }
+    for (size_t i=0;i<len;i++) capture_buf[(head+i) & (capture_size-1)] = edge[i];
+  }
+  capture_last_time = time;
+  capture_edges++;
+  std::atomic_signal_fence(std::memory_order_release);
+  capture_head = head+len;
+}
+
+static void captureFlush() { //write the ring buffer contents to the file
+  if (capture_mode!=CAPTURE_TO_FILE || !capture_buf) return;
+  uint32_t head = capture_head;
+  std::atomic_signal_fence(std::memory_order_acquire);
+  while (capture_tail!=head) {
+    uint32_t start = capture_tail & (capture_size-1);
+    uint32_t len = head-capture_tail;
+    if (start+len > capture_size) len = capture_size-start; //write up to the end of the ring first
+    halFileAppend(CAPTURE_FILE, (const char*)capture_buf+start, len);
+    capture_tail += len;
+    capture_bytes += len;
+  }
+}
+
+void captureStop() {
+  if (!capture_active && capture_mode==CAPTURE_TO_RAM) return;
+  capture_active = false;
+  if (capture_mode==CAPTURE_TO_RAM) {
+    capture_bytes = capture_head;
+  } else {
+    captureFlush();
+    free(capture_buf); //the file is the recording, the ring buffer is not needed anymore
+    capture_buf = NULL;
+    capture_size = 0;
+  }
+}
+
+void captureLoop() {
+  if (capture_mode==CAPTURE_TO_RAM) capture_bytes = capture_head;
+  else captureFlush();
+  if (capture_active && halMillis()-capture_started >= capture_duration) {
+    captureStop();
+    #if DEBUG
+    halDebug("Capture complete, %lu edges\n", (unsigned long)capture_edges);
+    #endif
+  }
+}
+
+bool captureActive() {
+  return capture_active;
+}
+
+captureMode captureLastMode() {
+  return capture_mode;
+}
+
+const uint8_t *captureData(size_t &len) {
+  if (capture_mode!=CAPTURE_TO_RAM || !capture_buf) {
+    len = 0;
+    return NULL;
+  }
+  len = capture_head;
+  return capture_buf;
+}
+
+uint32_t captureEdges() {
+  return capture_edges;
+}
+
+uint32_t captureBytes() {
+  return capture_bytes;
+}
+
+uint32_t captureDropped() {
+  return capture_dropped;
+}
+
+bool captureReaderBegin(captureReader &reader, const uint8_t *data, size_t len) {
+  if (len<CAPTURE_HEADER_SIZE || data[0]!='N' || data[1]!='R' || data[2]!='C' || data[3]!=CAPTURE_VERSION) return false;
+  reader.data = data;
+  reader.len = len;
+  reader.pos = CAPTURE_HEADER_SIZE;
+  reader.time = data[4] | data[5] << 8 | data[6] << 16 | (uint32_t)data[7] << 24;
+  return true;
+}
+
+bool captureReadEdge(captureReader &reader, bool &state, uint32_t &time) {
+  uint64_t value = 0;
+  uint8_t shift = 0;
+  while (reader.pos<reader.len && shift<35) {
+    uint8_t byte = reader.data[reader.pos++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    shift += 7;
+    if (!(byte & 0x80)) {
+      state = value & 1;
+      reader.time += value >> 1;
+      time = reader.time;
+      return true;
+    }
+  }
+  return false; //end of data or truncated edge
+}
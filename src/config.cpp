@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <ArduinoJson.h>          //https://github.com/bblanchon/ArduinoJson
+#include "hal.h"
+#include "boot.h"
+#include "config.h"
+
+//define your default values here, if there are different values in config.json, they are overwritten.
+char mqtt_server[65] = "";
+char mqtt_port[6] = "1883";
+char mqtt_topic[65] = "NewentorReceiver433"; //default topic name
+char admin_username[6] = "admin"; //default admin username
+char admin_pass[23] = "p4ssw0rd"; //default admin password for wifi ap, web interface, and OTA
+char hostname[33] = "NewentorReceiver433"; //default mDNS hostname
+char publish_mode[7] = "json"; //default one json message per reading
+char batch_interval[7] = "10000";
+char batch_size[3] = "10";
+char stream_mode[4] = "off"; //default no frame stream
+char stream_address[16] = "239.255.43.3"; //default multicast group, organization local scope
+char stream_port[6] = "4333";
+char stats_interval[6] = "0"; //default no stats messages
+char aggregate_interval[6] = "300"; //default aggregates every 5 minutes
+char aggregate_topic[65] = ""; //default <mqtt_topic>/aggregates
+char edge_rate_max[7] = "10000"; //default RF_EDGE_RATE_DEFAULT
+char burst_hold[2] = "1"; //default hold heavy work back during expected bursts
+char receiver_id[33] = ""; //default hostname
+char leader_election[2] = "0"; //default every receiver publishes its readings
+char static_ip[16] = ""; //default DHCP
+char gateway[16] = "";
+char netmask[16] = "";
+char dns_server[16] = "";
+configWifi config_wifi = {};
+
+bool shouldSaveConfig = false;//flag for saving data
+bool no_config_file = false; //flag for not finding config file
+
+struct configRecord { //settings in the order of the field table, sizes are those of the settings
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size; //sizeof(configRecord)
+  char mqtt_server[sizeof(::mqtt_server)];
+  char mqtt_port[sizeof(::mqtt_port)];
+  char mqtt_topic[sizeof(::mqtt_topic)];
+  char admin_pass[sizeof(::admin_pass)];
+  char hostname[sizeof(::hostname)];
+  char publish_mode[sizeof(::publish_mode)];
+  char batch_interval[sizeof(::batch_interval)];
+  char batch_size[sizeof(::batch_size)];
+  char stream_mode[sizeof(::stream_mode)];
+  char stream_address[sizeof(::stream_address)];
+  char stream_port[sizeof(::stream_port)];
+  char stats_interval[sizeof(::stats_interval)];
+  char aggregate_interval[sizeof(::aggregate_interval)];
+  char aggregate_topic[sizeof(::aggregate_topic)];
+  char edge_rate_max[sizeof(::edge_rate_max)];
+  char burst_hold[sizeof(::burst_hold)];
+  char receiver_id[sizeof(::receiver_id)];
+  char leader_election[sizeof(::leader_election)];
+  char static_ip[sizeof(::static_ip)];
+  char gateway[sizeof(::gateway)];
+  char netmask[sizeof(::netmask)];
+  char dns_server[sizeof(::dns_server)];
+  configWifi wifi;
+  uint32_t crc; //CRC-32 of the record before this field
+};
+
+struct configRtc { //connection cache in RTC memory
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t crc;
+};
+
+struct configField { //setting in the json and the binary record
+  const char *name;
+  char *value;
+  uint8_t size;
+  uint16_t offset; //in configRecord
+};
+
+#define CONFIG_FIELD(name) {#name, name, sizeof(name), offsetof(configRecord, name)}
+
+static const configField fields[] = {
+  CONFIG_FIELD(mqtt_server), CONFIG_FIELD(mqtt_port), CONFIG_FIELD(mqtt_topic), CONFIG_FIELD(admin_pass),
+  CONFIG_FIELD(hostname), CONFIG_FIELD(publish_mode), CONFIG_FIELD(batch_interval), CONFIG_FIELD(batch_size),
+  CONFIG_FIELD(stream_mode), CONFIG_FIELD(stream_address), CONFIG_FIELD(stream_port), CONFIG_FIELD(stats_interval),
+  CONFIG_FIELD(aggregate_interval), CONFIG_FIELD(aggregate_topic), CONFIG_FIELD(edge_rate_max), CONFIG_FIELD(burst_hold),
+  CONFIG_FIELD(receiver_id), CONFIG_FIELD(leader_election), CONFIG_FIELD(static_ip), CONFIG_FIELD(gateway), CONFIG_FIELD(netmask),
+  CONFIG_FIELD(dns_server),
+};
+
+static uint32_t crc32(const void *data, size_t len) { //bitwise, only run for the few hundred bytes of the settings
+  uint32_t crc = 0xFFFFFFFF;
+  const uint8_t *bytes = (const uint8_t*)data;
+  while (len--) {
+    crc ^= *bytes++;
+    for (uint8_t bit=0;bit<8;bit++) crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static void saveRecord() {
+  static configRecord record; //not on the stack of the web handler
+  memset(&record, 0, sizeof(record));
+  record.magic = CONFIG_MAGIC;
+  record.version = CONFIG_VERSION;
+  record.size = sizeof(record);
+  for (const configField &field : fields) memcpy((char*)&record+field.offset, field.value, field.size);
+  record.wifi = config_wifi;
+  record.crc = crc32(&record, offsetof(configRecord, crc));
+  if (!halFileWrite(CONFIG_FILE, (const char*)&record, sizeof(record))) {
+    #if DEBUG
+    halDebug("Failed to write config record\n");
+    #endif
+  }
+}
+
+static bool loadRecord() {
+  static configRecord record;
+  if (halFileRead(CONFIG_FILE, (char*)&record, sizeof(record))!=sizeof(record)) return false;
+  if (record.magic!=CONFIG_MAGIC || record.version!=CONFIG_VERSION || record.size!=sizeof(record)) return false;
+  if (record.crc!=crc32(&record, offsetof(configRecord, crc))) {
+    #if DEBUG
+    halDebug("Config record CRC mismatch\n");
+    #endif
+    return false;
+  }
+  for (const configField &field : fields) {
+    memcpy(field.value, (const char*)&record+field.offset, field.size);
+    field.value[field.size-1] = 0;
+  }
+  config_wifi = record.wifi;
+  config_wifi.ssid[sizeof(config_wifi.ssid)-1] = 0;
+  config_wifi.psk[sizeof(config_wifi.psk)-1] = 0;
+  return true;
+}
+
+static StaticJsonDocument<CONFIG_JSON_SIZE> config_json; //not on the stack of the web handler, shared by saveJson and loadJson
+static char config_text[CONFIG_JSON_SIZE];
+
+static void saveJson() {
+  config_json.clear();
+  for (const configField &field : fields) config_json[field.name] = field.value;
+  size_t len = serializeJson(config_json, config_text, sizeof(config_text));
+  if (len==0) { //keep the last config.json rather than writing an empty one
+    #if DEBUG
+    halDebug("Failed to serialize config\n");
+    #endif
+    return;
+  }
+  if (!halFileWrite(CONFIG_JSON_FILE, config_text, len)) {
+    #if DEBUG
+    halDebug("Failed to write config file\n");
+    #endif
+  }
+  #if DEBUG
+  halDebug("%s\n", config_text);
+  #endif
+}
+
+void saveConfigFile() {
+  #if DEBUG
+  halDebug("Saving config\n");
+  #endif
+  saveRecord();
+  saveJson();
+}
+
+static void configString(const char *value, char *dst, size_t size) { //keeps the default if the setting is missing
+  if (value) snprintf(dst, size, "%s", value);
+}
+
+bool configSet(const char *name, const char *value) {
+  for (const configField &field : fields) {
+    if (strcmp(field.name, name)==0) {
+      configString(value, field.value, field.size);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool loadJson() {
+  if (!halFileExists(CONFIG_JSON_FILE)) {
+    #if DEBUG
+    halDebug("Config file not found. Forcing configuration page\n");
+    #endif
+    return false;
+  }
+  //file exists, reading and loading
+  #if DEBUG
+  halDebug("Reading config file\n");
+  #endif
+  int size = halFileRead(CONFIG_JSON_FILE, config_text, sizeof(config_text)-1);
+  if (size<0) return false;
+  config_text[size] = 0;
+  #if DEBUG
+  halDebug("Config file size: %d\n", size);
+  #endif
+  DeserializationError error = deserializeJson (config_json,(const char*)config_text);
+  if (error) {
+    #if DEBUG
+    halDebug("%s\n", error.c_str());
+    halDebug("failed to load json config\n");
+    #endif
+    return false;
+  }
+  #if DEBUG
+  halDebug("\nparsed json\n");
+  #endif
+  for (const configField &field : fields) configString(config_json[field.name], field.value, field.size); //settings added later keep their defaults
+  return true;
+}
+
+static void loadRtc() { //newer access point than the record, if the last reset was a soft one
+  configRtc rtc;
+  if (!halRtcRead(CONFIG_RTC_OFFSET, &rtc, sizeof(rtc)) || rtc.magic!=CONFIG_MAGIC) return;
+  if (rtc.crc!=crc32(&rtc, offsetof(configRtc, crc)) || !config_wifi.ssid[0]) return;
+  memcpy(config_wifi.bssid, rtc.bssid, sizeof(rtc.bssid));
+  config_wifi.channel = rtc.channel;
+  bootStats.rtc_valid = true;
+}
+
+void loadConfigFile() {
+  if (loadRecord()) {
+    bootStats.config_source = BOOT_CONFIG_BINARY;
+    loadRtc();
+  }
+  else if (loadJson()) { //first boot with this record version
+    bootStats.config_source = BOOT_CONFIG_JSON;
+    saveRecord();
+  }
+  else no_config_file = true; //set the global flag that config file not found or corrupt and needs to be re-written
+  bootMark(BOOT_CONFIG);
+}
+
+void configWifiUpdate(const char *ssid, const char *psk, const uint8_t *bssid, uint8_t channel, bool save) {
+  configRtc rtc = {};
+  rtc.magic = CONFIG_MAGIC;
+  memcpy(rtc.bssid, bssid, sizeof(rtc.bssid));
+  rtc.channel = channel;
+  rtc.crc = crc32(&rtc, offsetof(configRtc, crc));
+  halRtcWrite(CONFIG_RTC_OFFSET, &rtc, sizeof(rtc));
+  bool network_changed = strcmp(ssid, config_wifi.ssid)!=0 || strcmp(psk, config_wifi.psk)!=0;
+  bool ap_changed = memcmp(bssid, config_wifi.bssid, sizeof(config_wifi.bssid))!=0 || channel!=config_wifi.channel;
+  snprintf(config_wifi.ssid, sizeof(config_wifi.ssid), "%s", ssid);
+  snprintf(config_wifi.psk, sizeof(config_wifi.psk), "%s", psk);
+  memcpy(config_wifi.bssid, bssid, sizeof(config_wifi.bssid));
+  config_wifi.channel = channel;
+  if (network_changed || (save && ap_changed)) { //access point changes within the same network stay in RTC memory
+    #if DEBUG
+    halDebug("Saving access point %02x:%02x:%02x:%02x:%02x:%02x channel %u\n", bssid[0], bssid[1], bssid[2], bssid[3],
+      bssid[4], bssid[5], channel);
+    #endif
+    saveRecord();
+  }
+}
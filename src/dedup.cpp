@@ -0,0 +1,34 @@
+#include "protocol.h"
+#include "dedup.h"
+
+static dedupEntry dedup_table[DEDUP_SENSORS];
+dedupStatistics dedupStats = {};
+
+bool dedupIsNew(uint8_t protocol, uint64_t data, uint32_t now) {
+  uint16_t sensor = protocolSensor(protocol, data);
+  dedupEntry *entry = NULL;
+  dedupEntry *oldest = &dedup_table[0];
+  for (dedupEntry &e : dedup_table) {
+    if (e.used && e.sensor==sensor && e.protocol==protocol) {
+      entry = &e;
+      break;
+    }
+    if (!e.used || (oldest->used && now-e.last_seen > now-oldest->last_seen)) oldest = &e; //free slot or least recently seen sensor
+  }
+  bool is_new;
+  if (entry) {
+    is_new = entry->data!=data || now-entry->last_seen > DEDUP_TIMEOUT;
+  } else {
+    if (oldest->used) dedupStats.evictions++; //sensor got a new address after battery swap or there are more sensors than slots
+    entry = oldest;
+    entry->sensor = sensor;
+    entry->protocol = protocol;
+    entry->used = true;
+    is_new = true;
+  }
+  entry->data = data;
+  entry->last_seen = now;
+  if (is_new) dedupStats.published++;
+  else dedupStats.suppressed++;
+  return is_new;
+}
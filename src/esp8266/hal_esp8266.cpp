@@ -0,0 +1,255 @@
+// ESP8266 implementation of the hardware abstraction layer
+#include <Arduino.h>
+#include <stdarg.h>
+#include <LittleFS.h>             //LittleFS support (replaces SPIFFS)
+#include <WiFiUdp.h>
+#include "hal.h"
+#include "rf_receiver.h"
+#include "capture.h"
+#include "metrics.h"
+#include "stream.h"
+#include "hal_esp8266.h"
+
+WiFiClient espClient;
+PubSubClient mqtt_client(espClient);
+
+uint32_t halMillis() {
+  return millis();
+}
+
+uint32_t halMicros() {
+  return micros();
+}
+
+IRAM_ATTR uint32_t halCycleCount() {
+  return ESP.getCycleCount();
+}
+
+uint32_t halCycleFrequency() {
+  return ESP.getCpuFreqMHz()*1000000UL;
+}
+
+#if RF_SAMPLED
+#include <i2s.h>
+
+void halEdgeSourceBegin() {
+  i2s_rxtx_begin(true, false); //receive only, DMA fills the buffers in the background
+  i2s_set_rate(SAMPLE_RATE);
+  rfSamplesBegin(micros(), SAMPLE_NS);
+}
+
+IRAM_ATTR void halEdgeSourceEnable(bool) {
+  //the DMA keeps running, rfHandleSamples() skips the samples while the governor is backed off
+}
+
+void halSamplePoll() {
+  static uint32_t words[SAMPLE_BLOCK];
+  int16_t left, right;
+  uint16_t count=SAMPLE_BLOCK;
+  while (count==SAMPLE_BLOCK) {
+    count=0;
+    while (count<SAMPLE_BLOCK && i2s_read_sample(&left, &right, false)) words[count++]=(uint32_t)(uint16_t)left<<16 | (uint16_t)right; //left channel is sampled first
+    if (!count) break;
+    uint32_t start=ESP.getCycleCount();
+    rfHandleSamples(words, count);
+    metricsIsr(ESP.getCycleCount()-start); //decoding a block takes the place of the interrupts
+  }
+  if ((int32_t)(micros()-rfSamplesTime())>SAMPLE_SLIP) rfSamplesBegin(micros(), SAMPLE_NS); //loop() stalled and the DMA overwrote samples
+}
+
+#else
+IRAM_ATTR void interruptHandler() {
+  uint32_t start=ESP.getCycleCount();
+  bool state=GPIP(DATAPIN); //input register, digitalRead() is a call with pin checks
+  uint32_t time=micros();
+  captureEdge(state, time); //record the edge if a capture is running
+  rfHandleEdge(state, time);
+  metricsIsr(ESP.getCycleCount()-start);
+}
+
+void halEdgeSourceBegin() {
+  attachInterrupt(digitalPinToInterrupt(DATAPIN), interruptHandler, CHANGE); // attach RF listening interrupt and start receiving
+}
+
+IRAM_ATTR void halEdgeSourceEnable(bool on) { //interrupt type bits of the pin, like attachInterrupt() and detachInterrupt() set them
+  if (on) {
+    GPIEC = 1 << DATAPIN; //discard the edge latched while the interrupt was off
+    GPC(DATAPIN) |= (CHANGE & 0xF) << GPCI;
+  }
+  else GPC(DATAPIN) &= ~(0xF << GPCI);
+}
+
+void halSamplePoll() {
+  //edges are delivered by the interrupt
+}
+#endif
+
+bool halMqttConnect(const char *client_id) {
+  return mqtt_client.connect(client_id);
+}
+
+bool halMqttConnected() {
+  return mqtt_client.connected();
+}
+
+bool halMqttPublish(const char *topic, const char *payload) {
+  return mqtt_client.publish(topic, payload, false);
+}
+
+bool halMqttBeginPublish(const char *topic, size_t len) { //streamed, does not need a client buffer of the message size
+  return mqtt_client.beginPublish(topic, len, false);
+}
+
+bool halMqttWrite(const uint8_t *data, size_t len) {
+  return mqtt_client.write(data, len)==len;
+}
+
+bool halMqttEndPublish() {
+  return mqtt_client.endPublish()==1;
+}
+
+void halMqttLoop() {
+  mqtt_client.loop();
+}
+
+static halMqttHandler mqtt_handler = NULL;
+
+static void mqttCallback(char *topic, uint8_t *payload, unsigned int len) {
+  if (mqtt_handler) mqtt_handler(topic, payload, len);
+}
+
+bool halMqttSubscribe(const char *topic, halMqttHandler handler) { //incoming messages are limited to the client buffer of 256 bytes
+  mqtt_handler = handler;
+  mqtt_client.setCallback(mqttCallback);
+  return mqtt_client.subscribe(topic); //QoS 0
+}
+
+static WiFiUDP stream_udp;
+static WiFiServer *stream_server = NULL; //port is only known after the config is loaded
+static WiFiClient stream_clients[STREAM_CLIENTS];
+static IPAddress stream_ip;
+static uint16_t stream_port_number = 0;
+
+bool halStreamBegin(bool tcp, const char *address, uint16_t port) {
+  if (!port) return false;
+  stream_port_number = port;
+  if (!tcp) return stream_ip.fromString(address);
+  if (!stream_server) stream_server = new WiFiServer(port);
+  stream_server->begin();
+  stream_server->setNoDelay(true); //a record is sent as soon as it is written
+  return true;
+}
+
+bool halStreamSend(const uint8_t *data, size_t len) {
+  if (!stream_server) {
+    bool multicast = stream_ip[0]>=224 && stream_ip[0]<=239;
+    int ok = multicast ? stream_udp.beginPacketMulticast(stream_ip, stream_port_number, WiFi.localIP()) : stream_udp.beginPacket(stream_ip, stream_port_number);
+    return ok && stream_udp.write(data, len)==len && stream_udp.endPacket();
+  }
+  bool ok = true;
+  for (WiFiClient &client : stream_clients) {
+    if (!client.connected()) continue;
+    if (client.write(data, len)!=len) { //send buffer full, the subscriber reconnects and sees the gap
+      client.stop();
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void halStreamAccept() {
+  if (!stream_server || !stream_server->hasClient()) return;
+  WiFiClient client = stream_server->accept();
+  for (WiFiClient &slot : stream_clients) {
+    if (slot.connected()) continue;
+    slot = client;
+    slot.setNoDelay(true);
+    return;
+  }
+  client.stop(); //all slots taken
+}
+
+uint8_t halStreamClients() {
+  uint8_t count = 0;
+  for (WiFiClient &client : stream_clients) count += client.connected();
+  return count;
+}
+
+bool halFileExists(const char *path) {
+  return LittleFS.exists(path);
+}
+
+int halFileRead(const char *path, char *buf, size_t size) {
+  File file = LittleFS.open(path, "r");
+  if (!file) return -1;
+  int len = file.readBytes(buf, size);
+  file.close();
+  return len;
+}
+
+int halFileReadAt(const char *path, size_t offset, char *buf, size_t size) {
+  File file = LittleFS.open(path, "r");
+  if (!file) return -1;
+  int len = file.seek(offset) ? file.readBytes(buf, size) : -1;
+  file.close();
+  return len;
+}
+
+long halFileSize(const char *path) {
+  File file = LittleFS.open(path, "r");
+  if (!file) return -1;
+  long size = file.size();
+  file.close();
+  return size;
+}
+
+bool halFileWrite(const char *path, const char *data, size_t len) {
+  File file = LittleFS.open(path, "w");
+  if (!file) return false;
+  bool ok = file.write((const uint8_t*)data, len)==len;
+  file.close();
+  return ok;
+}
+
+bool halFileAppend(const char *path, const char *data, size_t len) {
+  File file = LittleFS.open(path, "a");
+  if (!file) return false;
+  bool ok = file.write((const uint8_t*)data, len)==len;
+  file.close();
+  return ok;
+}
+
+bool halFileRemove(const char *path) {
+  return LittleFS.remove(path);
+}
+
+#define RTC_FIRST_BLOCK 32 //4 byte blocks of the user memory used by eboot for the OTA command
+
+bool halRtcRead(size_t offset, void *data, size_t size) {
+  if (offset+size>HAL_RTC_SIZE) return false;
+  return ESP.rtcUserMemoryRead(RTC_FIRST_BLOCK+offset/4, (uint32_t*)data, size);
+}
+
+bool halRtcWrite(size_t offset, const void *data, size_t size) {
+  if (offset+size>HAL_RTC_SIZE) return false;
+  return ESP.rtcUserMemoryWrite(RTC_FIRST_BLOCK+offset/4, (uint32_t*)data, size);
+}
+
+void halHeap(halHeapStats &stats) {
+  uint16_t max_block;
+  ESP.getHeapStats(&stats.free, &max_block, &stats.fragmentation); //one walk of the free list for all three
+  stats.max_block = max_block;
+}
+
+void halLed(bool on) {
+  digitalWrite(LEDPIN, on ? LOW : HIGH); //led is active low
+}
+
+void halDebug(const char *format, ...) {
+  char buf[128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  Serial.print(buf);
+}
@@ -0,0 +1,19 @@
+#pragma once
+// ESP8266 (Wemos D1 mini) board definitions shared by the firmware and its HAL implementation
+
+#include <ESP8266WiFi.h>          //esp8266 wifi support required for mqtt client
+#include <PubSubClient.h>         //mqtt client https://github.com/knolleary/pubsubclient
+
+#define DATAPIN D1  // RF input pin. should be able to attach interrupt. internal pin 4
+#define LEDPIN D4     //embedded led internal pin 2. pulled up internally
+#define RESETPIN D7  //reset settings button. internal pin 13
+
+//sampled edge source (RF_SAMPLED): the receiver output is wired to I2SI_DATA (D6, internal pin 12) instead of DATAPIN.
+//I2S receive drives its bit and word clocks out on D7 and D5, so the reset button is only usable during boot.
+#define SAMPLE_RATE 1260 //I2S frames/s of 32 samples, 40.3 kHz: the slowest clock of the I2S dividers, 160MHz/32/63/63
+#define SAMPLE_NS 24806 //sample period at that rate
+#define SAMPLE_BLOCK 64 //words handed to the decoder at once, one DMA buffer
+#define SAMPLE_SLIP 200000 //us the sample clock may fall behind micros() before it is resynchronized, DMA buffers were lost
+
+extern WiFiClient espClient; //wifi client for mqtt
+extern PubSubClient mqtt_client; //mqtt client
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include "hal.h"
+#include "heap.h"
+
+static heapPoint history[HEAP_HISTORY]; //ring, history_next is the point in progress
+static uint8_t history_next = 0;
+static uint8_t history_count = 0; //finished points
+heapStatistics heapStats = {};
+
+static void pointBegin(heapPoint &point, uint32_t uptime) {
+  point.start = uptime-uptime%HEAP_HISTORY_PERIOD;
+  point.free_min = heapStats.now.free;
+  point.max_block_min = heapStats.now.max_block;
+  point.fragmentation_max = heapStats.now.fragmentation;
+}
+
+void heapSample() {
+  halHeap(heapStats.now);
+  uint32_t uptime = halMillis()/1000;
+  heapPoint &point = history[history_next];
+  if (!heapStats.samples++) {
+    heapStats.free_min = heapStats.now.free;
+    heapStats.max_block_min = heapStats.now.max_block;
+    heapStats.fragmentation_max = heapStats.now.fragmentation;
+    pointBegin(point, uptime);
+    return;
+  }
+  if (uptime-point.start>=HEAP_HISTORY_PERIOD) { //period is over, the next point starts with this sample
+    history_next = (history_next+1)%HEAP_HISTORY;
+    if (history_count<HEAP_HISTORY-1) history_count++;
+    pointBegin(history[history_next], uptime);
+  }
+  heapPoint &current = history[history_next];
+  if (heapStats.now.free<heapStats.free_min) heapStats.free_min = heapStats.now.free;
+  if (heapStats.now.max_block<heapStats.max_block_min) heapStats.max_block_min = heapStats.now.max_block;
+  if (heapStats.now.fragmentation>heapStats.fragmentation_max) heapStats.fragmentation_max = heapStats.now.fragmentation;
+  if (heapStats.now.free<current.free_min) current.free_min = heapStats.now.free;
+  if (heapStats.now.max_block<current.max_block_min) current.max_block_min = heapStats.now.max_block;
+  if (heapStats.now.fragmentation>current.fragmentation_max) current.fragmentation_max = heapStats.now.fragmentation;
+}
+
+size_t heapStream(heapSink sink, void *context) {
+  char line[64];
+  int len = snprintf(line, sizeof(line), "uptime_s,free_min,max_block_min,fragmentation_max\n");
+  size_t total = len;
+  if (sink) sink(line, len, context);
+  if (!heapStats.samples) return total;
+  for (uint8_t i=0; i<=history_count; i++) { //oldest first, the point in progress last
+    const heapPoint &point = history[(history_next+HEAP_HISTORY-history_count+i)%HEAP_HISTORY];
+    len = snprintf(line, sizeof(line), "%lu,%lu,%lu,%u\n", (unsigned long)point.start, (unsigned long)point.free_min,
+      (unsigned long)point.max_block_min, point.fragmentation_max);
+    total += len;
+    if (sink) sink(line, len, context);
+  }
+  return total;
+}
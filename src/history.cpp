@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "hal.h"
+#include "protocol.h"
+#include "history.h"
+
+#define HISTORY_DATA_BITS ((HISTORY_BLOCK_SIZE-HISTORY_HEADER_SIZE)*8)
+
+static_assert(sizeof(historyBlock)==HISTORY_BLOCK_SIZE, "history block layout");
+
+enum historyBlockState : uint8_t {
+  HISTORY_FREE,
+  HISTORY_ACTIVE, //samples are added
+  HISTORY_DONE //complete, waiting to be written to the file
+};
+
+struct historyState { //values the next sample is encoded against
+  uint32_t time;
+  int32_t interval;
+  int16_t temperature;
+  uint8_t humidity;
+  uint8_t battery_low;
+};
+
+struct historyOpen { //sensor with an active block
+  int8_t block; //index in the pool, -1 if the slot is free
+  uint32_t last_add; //halMillis(), the least recently updated sensor gives up its slot
+  historyState state;
+};
+
+struct historyReader {
+  const historyBlock *block;
+  uint16_t position; //bit
+  historyState state;
+};
+
+historyStatistics historyStats = {};
+
+static historyBlock pool[HISTORY_RAM_BLOCKS];
+static historyBlockState pool_state[HISTORY_RAM_BLOCKS];
+static historyOpen open_blocks[HISTORY_SENSORS] = {};
+static char flush_buffer[HISTORY_FLUSH_BLOCKS*HISTORY_BLOCK_SIZE]; //blocks appended at once, also the read buffer of historyStream
+static uint32_t next_seq = 1;
+static uint16_t boot = 1;
+static uint8_t segment = 0; //segment the blocks are appended to
+static uint16_t segment_blocks = 0; //blocks in the current segment
+static uint32_t file_blocks = 0;
+static bool begun = false;
+
+static void segmentPath(uint8_t number, char *path) {
+  sprintf(path, HISTORY_FILE, (unsigned)number);
+}
+
+void historyBegin() {
+  for (uint8_t i=0;i<HISTORY_RAM_BLOCKS;i++) pool_state[i] = HISTORY_FREE;
+  for (historyOpen &open : open_blocks) open.block = -1;
+  file_blocks = 0;
+  bool found = false;
+  bool partial = false;
+  uint32_t last_seq = 0;
+  uint16_t last_boot = 0;
+  for (uint8_t s=0;s<HISTORY_SEGMENTS;s++) { //the segment with the newest last block is the current one
+    char path[24];
+    segmentPath(s, path);
+    long size = halFileSize(path);
+    if (size<HISTORY_BLOCK_SIZE) continue;
+    uint16_t blocks = size/HISTORY_BLOCK_SIZE;
+    file_blocks += blocks;
+    historyBlock header;
+    if (halFileReadAt(path, (size_t)(blocks-1)*HISTORY_BLOCK_SIZE, (char*)&header, HISTORY_HEADER_SIZE)!=HISTORY_HEADER_SIZE) continue;
+    if (found && header.seq<=last_seq) continue;
+    found = true;
+    last_seq = header.seq;
+    last_boot = header.boot;
+    segment = s;
+    segment_blocks = blocks;
+    partial = size%HISTORY_BLOCK_SIZE!=0;
+  }
+  if (partial) segment_blocks = HISTORY_SEGMENT_BLOCKS; //write interrupted by a reset, continue in the next segment
+  next_seq = last_seq+1;
+  boot = last_boot+1;
+  begun = true;
+  #if DEBUG
+  halDebug("History: boot %u, segment %u with %u blocks, %lu blocks in files\n", boot, segment, segment_blocks, (unsigned long)file_blocks);
+  #endif
+}
+
+static void putBits(historyBlock &block, uint32_t value, uint8_t count) { //most significant bit first
+  while (count--) {
+    if (value >> count & 1) block.data[block.bits >> 3] |= 0x80 >> (block.bits & 7);
+    block.bits++;
+  }
+}
+
+static uint32_t getBits(historyReader &reader, uint8_t count) {
+  uint32_t value = 0;
+  while (count--) {
+    value = value << 1 | (reader.block->data[reader.position >> 3] >> (7 - (reader.position & 7)) & 1);
+    reader.position++;
+  }
+  return value;
+}
+
+static int32_t getSigned(historyReader &reader, uint8_t count) {
+  uint32_t value = getBits(reader, count);
+  if (count<32 && value >> (count-1)) value |= ~0UL << count; //sign extension
+  return (int32_t)value;
+}
+
+static bool fits(int32_t value, uint8_t bits) { //two's complement range of bits
+  return value >= -(1L << (bits-1)) && value < (1L << (bits-1));
+}
+
+static uint8_t encode(const historyState &state, const historySample &sample, uint64_t &code) { //returns the length in bits
+  uint8_t len = 0;
+  auto put = [&](uint32_t value, uint8_t bits) {
+    code = code << bits | (value & (bits<32 ? (1UL << bits)-1 : 0xFFFFFFFFUL));
+    len += bits;
+  };
+  code = 0;
+  int32_t interval = sample.time-state.time;
+  int32_t dod = interval-state.interval; //delta of delta
+  if (dod==0) put(0, 1);
+  else if (fits(dod, 3)) { put(2, 2); put(dod, 3); }
+  else if (fits(dod, 9)) { put(6, 3); put(dod, 9); }
+  else { put(7, 3); put(dod, 32); }
+  int32_t delta = sample.temperature-state.temperature;
+  if (delta==0) put(0, 1);
+  else if (fits(delta, 3)) { put(2, 2); put(delta, 3); }
+  else if (fits(delta, 7)) { put(6, 3); put(delta, 7); }
+  else { put(7, 3); put(sample.temperature, 12); }
+  delta = sample.humidity-state.humidity;
+  if (sample.battery_low!=state.battery_low || !fits(delta, 2)) { put(3, 2); put(sample.humidity, 7); put(sample.battery_low, 1); }
+  else if (delta==0) put(0, 1);
+  else { put(2, 2); put(delta, 2); }
+  return len;
+}
+
+static void advance(historyState &state, const historySample &sample) {
+  state.interval = sample.time-state.time;
+  state.time = sample.time;
+  state.temperature = sample.temperature;
+  state.humidity = sample.humidity;
+  state.battery_low = sample.battery_low;
+}
+
+static void readerStart(historyReader &reader, const historyBlock &block) {
+  reader.block = &block;
+  reader.position = 0;
+  reader.state = {block.first_time, 0, 0, 0, 0};
+}
+
+static void readerNext(historyReader &reader, historySample &sample) {
+  historyState &state = reader.state;
+  int32_t dod = 0;
+  if (getBits(reader, 1)) {
+    if (!getBits(reader, 1)) dod = getSigned(reader, 3);
+    else if (!getBits(reader, 1)) dod = getSigned(reader, 9);
+    else dod = getSigned(reader, 32);
+  }
+  sample.time = state.time+state.interval+dod;
+  sample.temperature = state.temperature;
+  if (getBits(reader, 1)) {
+    if (!getBits(reader, 1)) sample.temperature += getSigned(reader, 3);
+    else if (!getBits(reader, 1)) sample.temperature += getSigned(reader, 7);
+    else sample.temperature = getSigned(reader, 12);
+  }
+  sample.humidity = state.humidity;
+  sample.battery_low = state.battery_low;
+  if (getBits(reader, 1)) {
+    if (!getBits(reader, 1)) sample.humidity += getSigned(reader, 2);
+    else {
+      sample.humidity = getBits(reader, 7);
+      sample.battery_low = getBits(reader, 1);
+    }
+  }
+  advance(state, sample);
+}
+
+uint8_t historyDecode(const historyBlock &block, historySample *samples) {
+  historyReader reader;
+  readerStart(reader, block);
+  for (uint8_t i=0;i<block.count;i++) readerNext(reader, samples[i]);
+  return block.count;
+}
+
+static int oldestDone() { //-1 if no block is complete
+  int oldest = -1;
+  for (uint8_t i=0;i<HISTORY_RAM_BLOCKS;i++) {
+    if (pool_state[i]==HISTORY_DONE && (oldest<0 || pool[i].seq<pool[oldest].seq)) oldest = i;
+  }
+  return oldest;
+}
+
+static void closeBlock(historyOpen &open) {
+  pool[open.block].seq = next_seq++;
+  pool_state[open.block] = HISTORY_DONE;
+  open.block = -1;
+}
+
+static int8_t allocateBlock() {
+  for (uint8_t i=0;i<HISTORY_RAM_BLOCKS;i++) if (pool_state[i]==HISTORY_FREE) return i;
+  int oldest = oldestDone(); //pool full because the file cannot be written, the oldest complete block is lost
+  historyStats.dropped_blocks++;
+  #if DEBUG
+  halDebug("History: RAM pool full, block %lu dropped\n", (unsigned long)pool[oldest].seq);
+  #endif
+  return oldest;
+}
+
+static void startBlock(historyOpen &open, uint8_t protocol, uint16_t sensor, uint32_t time) {
+  open.block = allocateBlock();
+  pool_state[open.block] = HISTORY_ACTIVE;
+  historyBlock &block = pool[open.block];
+  memset(&block, 0, sizeof(block));
+  block.first_time = time;
+  block.boot = boot;
+  block.sensor = sensor;
+  block.protocol = protocol;
+  open.state = {time, 0, 0, 0, 0};
+  historyStats.blocks++;
+}
+
+void historyAdd(uint8_t protocol, uint64_t data, uint32_t now) {
+  if (!begun) return;
+  sensorReading reading;
+  protocolFields(protocol, data, reading);
+  historySample sample;
+  sample.time = now/1000;
+  sample.temperature = reading.tempC < -2048 ? -2048 : reading.tempC > 2047 ? 2047 : reading.tempC;
+  sample.humidity = reading.humidity > 127 ? 127 : reading.humidity;
+  sample.battery_low = reading.battery_low;
+  uint16_t sensor = protocolSensor(protocol, data);
+  historyOpen *open = NULL;
+  historyOpen *oldest = &open_blocks[0];
+  for (historyOpen &candidate : open_blocks) {
+    if (candidate.block>=0 && pool[candidate.block].protocol==protocol && pool[candidate.block].sensor==sensor) {
+      open = &candidate;
+      break;
+    }
+    if (candidate.block<0) {
+      if (oldest->block>=0) oldest = &candidate; //free slot is taken before any used one
+    }
+    else if (oldest->block>=0 && now-candidate.last_add > now-oldest->last_add) oldest = &candidate;
+  }
+  if (!open) { //new sensor, the least recently updated one is closed if all slots are used
+    open = oldest;
+    if (open->block>=0) closeBlock(*open);
+    startBlock(*open, protocol, sensor, sample.time);
+  }
+  uint64_t code;
+  uint8_t len = encode(open->state, sample, code);
+  historyBlock *block = &pool[open->block];
+  if (block->count==255 || block->bits+len > HISTORY_DATA_BITS) { //block full, the sample starts the next one
+    closeBlock(*open);
+    startBlock(*open, protocol, sensor, sample.time);
+    block = &pool[open->block];
+    len = encode(open->state, sample, code);
+  }
+  if (len>32) putBits(*block, code >> 32, len-32);
+  putBits(*block, code, len>32 ? 32 : len);
+  block->count++;
+  advance(open->state, sample);
+  open->last_add = now;
+  historyStats.samples++;
+  historyStats.sample_bits += len;
+}
+
+static void nextSegment() { //the oldest segment is removed and becomes the current one
+  segment = (segment+1)%HISTORY_SEGMENTS;
+  segment_blocks = 0;
+  char path[24];
+  segmentPath(segment, path);
+  long size = halFileSize(path);
+  if (size<0) return;
+  file_blocks -= size/HISTORY_BLOCK_SIZE;
+  halFileRemove(path);
+  historyStats.segments_removed++;
+}
+
+static bool flushBlocks(uint8_t max) { //append up to max oldest complete blocks, false if none was written
+  uint8_t picked[HISTORY_FLUSH_BLOCKS];
+  uint8_t count = 0;
+  for (int i=oldestDone(); i>=0 && count<max; i=oldestDone()) {
+    picked[count++] = i;
+    pool_state[i] = HISTORY_FREE; //taken out of the search, restored if the write fails
+  }
+  if (!count) return false;
+  uint8_t written = 0;
+  while (written<count) {
+    if (segment_blocks>=HISTORY_SEGMENT_BLOCKS) nextSegment();
+    uint8_t blocks = count-written;
+    if (blocks>HISTORY_SEGMENT_BLOCKS-segment_blocks) blocks = HISTORY_SEGMENT_BLOCKS-segment_blocks;
+    for (uint8_t i=0;i<blocks;i++) memcpy(flush_buffer+i*HISTORY_BLOCK_SIZE, &pool[picked[written+i]], HISTORY_BLOCK_SIZE);
+    char path[24];
+    segmentPath(segment, path);
+    if (!halFileAppend(path, flush_buffer, blocks*HISTORY_BLOCK_SIZE)) {
+      #if DEBUG
+      halDebug("History: failed to write %s\n", path);
+      #endif
+      for (uint8_t i=written;i<count;i++) pool_state[picked[i]] = HISTORY_DONE;
+      return false;
+    }
+    for (uint8_t i=0;i<blocks;i++) {
+      historyStats.flushed_samples += pool[picked[written+i]].count;
+      historyStats.flushed_bits += pool[picked[written+i]].bits;
+    }
+    historyStats.flushed_blocks += blocks;
+    historyStats.file_bytes += blocks*HISTORY_BLOCK_SIZE;
+    historyStats.appends++;
+    segment_blocks += blocks;
+    file_blocks += blocks;
+    written += blocks;
+  }
+  return true;
+}
+
+void historyLoop() {
+  if (!begun) return;
+  uint8_t free_blocks = 0;
+  for (historyBlockState state : pool_state) free_blocks += state==HISTORY_FREE;
+  if (free_blocks<HISTORY_SENSORS) flushBlocks(HISTORY_FLUSH_BLOCKS); //keep a block for every sensor available
+}
+
+void historyFlushAll() {
+  if (!begun) return;
+  for (historyOpen &open : open_blocks) if (open.block>=0) closeBlock(open);
+  while (flushBlocks(HISTORY_FLUSH_BLOCKS));
+}
+
+uint8_t historyRamBlocks() {
+  uint8_t used = 0;
+  for (historyBlockState state : pool_state) used += state!=HISTORY_FREE;
+  return used;
+}
+
+uint32_t historyFileBlocks() {
+  return file_blocks;
+}
+
+void historyQueryBegin(historyQuery &query) {
+  query.protocol = query.address = query.channel = -1;
+  query.last = 0;
+}
+
+bool historyQueryArg(historyQuery &query, const char *name, const char *value) {
+  char *end;
+  if (strcmp(name, "protocol")==0) {
+    for (uint8_t id=0;id<RF_PROTOCOLS;id++) {
+      if (strcasecmp(value, protocolName(id))!=0) continue;
+      query.protocol = id;
+      return true;
+    }
+    return false;
+  }
+  if (strcmp(name, "address")==0) { //hex as in the JSON readings
+    unsigned long address = strtoul(value, &end, 16);
+    if (*end || end==value || address>0xFF) return false;
+    query.address = address;
+    return true;
+  }
+  if (strcmp(name, "channel")==0) {
+    unsigned long channel = strtoul(value, &end, 10);
+    if (*end || end==value || channel>0xFF) return false;
+    query.channel = channel;
+    return true;
+  }
+  if (strcmp(name, "last")==0) {
+    query.last = strtoul(value, &end, 10);
+    return !*end && end!=value;
+  }
+  return false;
+}
+
+struct historyWriter { //collects lines into chunks for the sink, a NULL sink only counts the length
+  historySink sink;
+  void *context;
+  char chunk[HISTORY_CHUNK];
+  size_t len;
+  size_t total;
+};
+
+static void writerFlush(historyWriter &writer) {
+  if (writer.sink && writer.len) writer.sink(writer.chunk, writer.len, writer.context);
+  writer.len = 0;
+}
+
+static void writerLine(historyWriter &writer, const char *line, size_t len) {
+  if (writer.len+len>sizeof(writer.chunk)) writerFlush(writer);
+  memcpy(writer.chunk+writer.len, line, len);
+  writer.len += len;
+  writer.total += len;
+}
+
+static void streamBlock(historyWriter &writer, const historyBlock &block, const historyQuery &query, uint32_t since) {
+  const rfProtocol *protocol = protocolGet(block.protocol);
+  if (!protocol || (query.last && block.boot!=boot)) return;
+  if (query.protocol>=0 && block.protocol!=query.protocol) return;
+  if (query.address>=0 && block.sensor >> 8 != query.address) return;
+  if (query.channel>=0 && (block.sensor & 0xFF)+protocol->channel_offset != query.channel) return;
+  historyReader reader;
+  readerStart(reader, block);
+  for (uint8_t i=0;i<block.count;i++) {
+    historySample sample;
+    readerNext(reader, sample);
+    if (sample.time<since) continue;
+    int temperature = sample.temperature;
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%s,%02X,%u,%u,%lu,%s%d.%d,%u,%u\n", protocol->name, block.sensor >> 8,
+      (block.sensor & 0xFF)+protocol->channel_offset, block.boot, (unsigned long)sample.time, temperature<0 ? "-" : "",
+      abs(temperature)/10, abs(temperature)%10, sample.humidity, sample.battery_low);
+    writerLine(writer, line, len);
+  }
+}
+
+size_t historyStream(const historyQuery &query, historySink sink, void *context) {
+  static const char header[] = "protocol,address,channel,boot,time,temperature_c,humidity,battery_low\n";
+  historyWriter writer;
+  writer.sink = sink;
+  writer.context = context;
+  writer.len = writer.total = 0;
+  writerLine(writer, header, sizeof(header)-1);
+  uint32_t now = halMillis()/1000;
+  uint32_t since = query.last && query.last<now ? now-query.last : 0;
+  static historyBlock block; //the files are never loaded as a whole, HISTORY_FLUSH_BLOCKS blocks are read per file open
+  for (uint8_t i=1;i<=HISTORY_SEGMENTS;i++) { //oldest segment first, the current one last
+    char path[24];
+    segmentPath((segment+i)%HISTORY_SEGMENTS, path);
+    long size = halFileSize(path);
+    for (long offset=0; offset+HISTORY_BLOCK_SIZE<=size; offset+=sizeof(flush_buffer)) { //flush_buffer is free outside of flushBlocks()
+      int len = halFileReadAt(path, offset, flush_buffer, sizeof(flush_buffer));
+      uint8_t blocks = len>0 ? len/HISTORY_BLOCK_SIZE : 0;
+      for (uint8_t b=0;b<blocks;b++) {
+        memcpy(&block, flush_buffer+b*HISTORY_BLOCK_SIZE, HISTORY_BLOCK_SIZE); //the buffer is not aligned for the header fields
+        streamBlock(writer, block, query, since);
+      }
+      if (len<(int)sizeof(flush_buffer)) break;
+    }
+  }
+  uint32_t last_seq = 0; //complete blocks in RAM in the order they were closed
+  for (;;) {
+    int next = -1;
+    for (uint8_t i=0;i<HISTORY_RAM_BLOCKS;i++) {
+      if (pool_state[i]==HISTORY_DONE && pool[i].seq>last_seq && (next<0 || pool[i].seq<pool[next].seq)) next = i;
+    }
+    if (next<0) break;
+    last_seq = pool[next].seq;
+    streamBlock(writer, pool[next], query, since);
+  }
+  for (uint8_t i=0;i<HISTORY_RAM_BLOCKS;i++) if (pool_state[i]==HISTORY_ACTIVE) streamBlock(writer, pool[i], query, since);
+  writerFlush(writer);
+  return writer.total;
+}
@@ -1,25 +1,4 @@
-// CRC check is copied from rtl_433 project https://github.com/merbanan/rtl_433 InFactory sensor plugin.
-
 #include <Arduino.h>
-
-//Defining the time intervals to decode the signal. Times are in microseconds
-#define NEWDATA_MIN 7000 //preamble min
-#define NEWDATA_MAX 9000 //preamble max
-#define ONE_MIN 3200 // 1 min
-#define ONE_MAX 4900 // 1 max
-#define ZERO_MIN 1200 // 0 min
-#define ZERO_MAX 2400 // 0 max
-#define PULSE_MIN 400 // pulse min
-#define PULSE_MAX 900 // pulse max
-
-#define DATAPIN D1  // RF input pin. should be able to attach interrupt. internal pin 4
-#define DATAGRAM 40  // total number of bits to receive
-#define LEDPIN D4     //embedded led internal pin 2. pulled up internally
-#define RESETPIN D7  //reset settings button. internal pin 13
-
-//#define DEBUG true      //enable debugging
-//#define DEBUG433 true   //enable debugging for RF signal
-
 #include <LittleFS.h>             //LittleFS support (replaces SPIFFS)
 #include <ESP8266WiFi.h>          //esp8266 wifi support required for mqtt client
 #include <PubSubClient.h>         //mqtt client https://github.com/knolleary/pubsubclient
@@ -28,60 +7,34 @@
 #include <ArduinoOTA.h>           //ota upgrades support (flash over the wifi)
 #include <ESP8266WebServer.h>     //web server - required for wifiManager
 #include <WiFiManager.h>          //https://github.com/tzapu/WiFiManager
-#include <ArduinoJson.h>          //https://github.com/bblanchon/ArduinoJson
-
-WiFiClient espClient; //wifi client for mqtt
-PubSubClient mqtt_client(espClient); //mqtt client
-ESP8266WebServer webserver(80); //web server on port 80
-
-bool datagram[DATAGRAM]; //datagram array to receive weather sensor data
-
-//define your default values here, if there are different values in config.json, they are overwritten.
-char mqtt_server[65] = "";
-char mqtt_port[6] = "1883";
-char mqtt_topic[65] = "NewentorReceiver433"; //default topic name
-char admin_username[6] = "admin"; //default admin username
-char admin_pass[23] = "p4ssw0rd"; //default admin password for wifi ap, web interface, and OTA
-char hostname[33] = "NewentorReceiver433"; //default mDNS hostname
-
-bool shouldSaveConfig = false;//flag for saving data
-bool no_config_file = false; //flag for not finding config file
 
-double convertFtoC(double f) { //convert F to C and round to 1
-  return round(((f-32.0)*0.55555)*10)/10.0;
-}
+#include "hal.h"
+#include "config.h"
+#include "rf_receiver.h"
+#include "receiver.h"
+#include "capture.h"
+#include "dedup.h"
+#include "outbox.h"
+#include "publisher.h"
+#include "timing.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "history.h"
+#include "sensors.h"
+#include "boot.h"
+#include "predict.h"
+#include "aggregate.h"
+#include "quality.h"
+#include "stream.h"
+#include "page.h"
+#include "heap.h"
+#include "esp8266/hal_esp8266.h"
 
-uint8_t crc4(uint8_t const message[], unsigned nBytes, uint8_t polynomial, uint8_t init) // copied from rtl_433 project
-{
-    unsigned remainder = init << 4; // LSBs are unused
-    unsigned poly = polynomial << 4;
-    unsigned bit;
-
-    while (nBytes--) {
-        remainder ^= *message++;
-        for (bit = 0; bit < 8; bit++) {
-            if (remainder & 0x80) {
-                remainder = (remainder << 1) ^ poly;
-            } else {
-                remainder = (remainder << 1);
-            }
-        }
-    }
-    return remainder >> 4 & 0x0f; // discard the LSBs
-}
+#define WIFI_FAST_TIMEOUT 4000 //ms to join the cached access point before WiFiManager scans and connects
 
-static int infactory_crc_check(uint8_t *b) // copied from rtl_433 project
-{
-    uint8_t msg_crc, crc, msg[5];
-    memcpy(msg, b, 5);
-    msg_crc = msg[1] >> 4;
-    // for CRC computation, channel bits are at the CRC position(!)
-    msg[1] = (msg[1] & 0x0F) | (msg[4] & 0x0F) << 4;
-    // crc4() only works with full bytes
-    crc = crc4(msg, 4, 0x13, 0); // Koopmann 0x9, CCITT-4; FP-4; ITU-T G.704
-    crc ^= msg[4] >> 4; // last nibble is only XORed
-    return (crc == msg_crc);
-}
+ESP8266WebServer webserver(80); //web server on port 80
+static bool restart_pending = false; //restart requested by the web interface
+static uint32_t restart_at = 0; //millis() of the requested restart
 
 //callback notifying us of the need to save config
 void saveConfigCallback () {
@@ -91,262 +44,39 @@ void saveConfigCallback () {
   shouldSaveConfig = true;
 }
 
-void saveConfigFile() {
-  #if DEBUG
-  Serial.println("Saving config");
-  #endif
-  StaticJsonDocument<512> json; //create JSON buffer to write config
-  json["mqtt_server"] = mqtt_server;
-  json["mqtt_port"] = mqtt_port;
-  json["mqtt_topic"] = mqtt_topic;
-  json["admin_pass"] = admin_pass;
-  json["hostname"] = hostname;
-  File configFile = LittleFS.open("/config.json", "w");
-  if (!configFile) {
-    #if DEBUG
-    Serial.println("Failed to open config file for writing");
-    #endif
-  }
-  if (serializeJson(json, configFile)==0) {
-    #if DEBUG
-    Serial.println("Failed to write config file");
-    #endif
-  }
-  #if DEBUG
-  serializeJson(json, Serial);
-  Serial.println();
-  #endif
-  configFile.close();
-}
-
-void loadConfigFile() {
-  if (LittleFS.exists("/config.json")) {
-    //file exists, reading and loading
-    #if DEBUG
-    Serial.println("Reading config file");
-    #endif
-    File configFile = LittleFS.open("/config.json", "r");
-    if (configFile) {
-      #if DEBUG
-      Serial.println("Opened config file");
-      size_t size = configFile.size();
-      Serial.print("Config file size: ");
-      Serial.println(size);
-      #endif
-      StaticJsonDocument<512> json; //create json buffer to store config in memory
-      DeserializationError error = deserializeJson (json,configFile);
-      serializeJson(json, Serial);
-      if (!error) {
-        #if DEBUG
-        Serial.println("\nparsed json");
-        #endif
-        strcpy(mqtt_server, json["mqtt_server"]);
-        strcpy(mqtt_port, json["mqtt_port"]);
-        strcpy(mqtt_topic, json["mqtt_topic"]);
-        strcpy(admin_pass, json["admin_pass"]);
-        strcpy(hostname, json["hostname"]);
-      } else {
-        #if DEBUG
-        Serial.println(error.c_str());
-        Serial.println("failed to load json config");
-        no_config_file = true; //set the global flag that config file not found or corrupt and needs to be re-written
-        #endif
-      }
-      configFile.close();
-    }
-  } else {
-    #if DEBUG
-    Serial.println("Config file not found. Forcing configuration page");
-    #endif
-    no_config_file = true; //set the global flag that config file not found
-  }
-}
-
-void mqttConnect() {  //mqtt server connection function. Will re-try every 5 seconds
-  static unsigned long lastconnectattempt=0; // last time tried to connect
-  unsigned long timesincelastattempt=millis()-lastconnectattempt; //time since last attempt
-  if (timesincelastattempt>5000 || lastconnectattempt==0){
-    #if DEBUG
-    Serial.print("Connecting to MQTT server ");
-    Serial.println(mqtt_server);
-    #endif
-    if (mqtt_client.connect(hostname)) { //connect to MQTT broker using hostname
-      #if DEBUG
-      Serial.println("MQTT connected");
-      #endif
-    } else {
-        #if DEBUG
-        Serial.print("Failed to connect to MQTT, rc=");
-        Serial.println(mqtt_client.state());
-        Serial.println("Will try again in 5 seconds");
-        #endif
-        lastconnectattempt=millis();
-    }
-  }
+static bool staticIpConfig(IPAddress &ip, IPAddress &gw, IPAddress &mask, IPAddress &dns) { //false for DHCP
+  if (!static_ip[0] || !ip.fromString(static_ip) || !gw.fromString(gateway) || !mask.fromString(netmask)) return false;
+  if (!dns_server[0] || !dns.fromString(dns_server)) dns = gw;
+  return true;
 }
 
-void sendDatagram(){
-  char msg[128]=""; //mqtt message json
-  static char oldmsg[128]="z"; //previous mqtt message json
-  static uint32_t lasttime=0; //last millis time message received
-  uint32_t lastmsgtime=millis()-lasttime; //time in ms since last message
-  lasttime=millis();
-  uint8_t databytes[DATAGRAM/8]; //byte array representation of binary datagram
-  for (uint8_t i=0;i<DATAGRAM;i++){
-    bitWrite(databytes[i/8],7-(i%8),datagram[i]); //populate bytes array
-    #if DEBUG433
-    Serial.print(datagram[i]);
-    Serial.print(" ");
-    #endif
-  }
-  int battery_low = (databytes[1] >> 2) & 1; // 0=battery ok, 1=battery low
-  int temp_raw    = (databytes[2] << 4) | (databytes[3] >> 4); // encoded temperature in F
-  int humidity    = (databytes[3] & 0x0F) * 10 + (databytes[4] >> 4); // BCD, 'A0'=100%rH
-  int channel     = databytes[4] & 0x03; // sensor channel 1-3
-  double tempF=(temp_raw-900)/10.0; // calculate real temperature in F
-  double tempC=convertFtoC(tempF);
-  char address[3]=""; // sensor address gets reset every battery change
-  sprintf(address,"%02x",databytes[0]); // sensor address HEX representation
-  #if DEBUG || DEBUG433
-  Serial.println();
-  Serial.print("addr:"); Serial.print(address);
-  Serial.print(" ch:"); Serial.print(channel);
-  Serial.print(" tempF:"); Serial.print(tempF);
-  Serial.print(" tempC:"); Serial.print(tempC);
-  Serial.print(" humid:"); Serial.print(humidity);
-  Serial.print(" batt:");Serial.println(battery_low);
+bool wifiFastConnect() { //join the cached access point directly, skipping the scan
+  if (no_config_file || !config_wifi.ssid[0] || !config_wifi.channel || digitalRead(RESETPIN)==0) return false;
+  #if DEBUG
+  Serial.printf("Joining cached access point on channel %u\n", config_wifi.channel);
   #endif
-  if (!(databytes[4] & 0x0F)) { // check for packet validity
-    #if DEBUG
-    Serial.println ("Invalid packet received.");
-    #endif
-    return;
-  }
-  if (!infactory_crc_check(databytes)) { // perform CRC check
-    #if DEBUG
-    Serial.println ("Invalid packet CRC.");
-    #endif
-    return;
-  }
-  digitalWrite(LEDPIN,LOW); //turn on led to indicate that valid packet is received
-  StaticJsonDocument<128> json; //create JSON buffer to send MQTT message
-  json["SensorAddress"]=address;
-  json["Channel"]=channel;
-  json["TemperatureF"]=tempF;
-  json["TemperatureC"]=tempC;
-  json["Humidity"]=humidity;
-  json["BatteryLow"]=battery_low;
-  serializeJson(json, msg); //convert JSON object to char array
-  if (strcmp(msg,oldmsg)!=0 || lastmsgtime>6000){ //not the same message as before and not received within 6 sec
-    #if DEBUG
-    Serial.print("MQTT topic: "); Serial.println(mqtt_topic);
-    Serial.print("Publishing message: "); Serial.println(msg);
-    #endif
-    if (!mqtt_client.publish(mqtt_topic, msg, false)){
+  WiFi.persistent(false); //the credentials are already stored, no flash write on every boot
+  WiFi.mode(WIFI_STA);
+  IPAddress ip, gw, mask, dns;
+  if (staticIpConfig(ip, gw, mask, dns)) WiFi.config(ip, gw, mask, dns); //no DHCP exchange
+  WiFi.begin(config_wifi.ssid, config_wifi.psk, config_wifi.channel, config_wifi.bssid);
+  uint32_t start = millis();
+  while (WiFi.status()!=WL_CONNECTED) {
+    if (millis()-start>WIFI_FAST_TIMEOUT) {
       #if DEBUG
-      Serial.println ("Failed to publish message. Retrying...");
+      Serial.println("Cached access point not joined, scanning.");
       #endif
-      if (!mqtt_client.publish(mqtt_topic, msg, false)){
-        #if DEBUG
-        Serial.println ("Failed to publish message second time.");
-        #endif
-      }
+      WiFi.persistent(true);
+      return false;
     }
+    delay(10);
   }
-  else {
-    #if DEBUG
-    Serial.println ("Same datagram received, skipping.");
-    #endif
-  }
-  strcpy(oldmsg,msg); // copy message to old message
-  digitalWrite(LEDPIN,HIGH); // turn off led when datagram is sent
-}
-
-IRAM_ATTR void interruptHandler() {
-  static unsigned long duration = 0;
-  static unsigned long lastTime = 0;
-  static unsigned int index = 0;
-  static bool receiving = false;
-  bool state=digitalRead(DATAPIN);
-  unsigned long time = micros();
-  duration = time - lastTime;
-  lastTime = time;
-  
-  if (state){//rising edge
-    if (receiving){
-      if (duration>NEWDATA_MIN && duration<NEWDATA_MAX){ // potentially new data during receiving datagram
-        #if DEBUG433
-        Serial.print("new_new_data ");
-        Serial.println(duration);
-        #endif
-        index=0; //reset index as it seem as a new packet
-      }
-      else if (duration>ONE_MIN && duration<ONE_MAX){ //received 1
-        #if DEBUG433
-        Serial.print("1 ");
-        Serial.println(duration);
-        #endif
-        datagram[index]=1;
-        index++;
-      }
-      else if (duration>ZERO_MIN && duration<ZERO_MAX){ //received 0
-        #if DEBUG433
-        Serial.print("0 ");
-        Serial.println(duration);
-        #endif
-        datagram[index]=0;
-        index++;
-      }
-      else { //intervals do not match
-        #if DEBUG433
-        Serial.print("error_length ");
-        Serial.println(duration);
-        #endif
-        index=0;
-        receiving=false;
-      }
-    }
-    else { //not receiving yet
-      if (duration>NEWDATA_MIN && duration<NEWDATA_MAX){ //new datagram preambula pause ~8ms
-        #if DEBUG433
-        Serial.print("new_data ");
-        Serial.println(duration);
-        #endif
-        index=0;
-        receiving = true;
-      }
-    }
-  }
-  else { //falling edge
-    if (receiving && (duration<PULSE_MIN || duration>PULSE_MAX)){ //out of sync
-      #if DEBUG433
-      Serial.print("error_pulse ");
-      Serial.println(duration);
-      #endif
-      index=0;
-      receiving=false;
-    }
-    else if (receiving) {
-      #if DEBUG433
-      Serial.print("sep ");
-      Serial.println(duration);
-      #endif
-    }
-  }
-  if (index==DATAGRAM){
-    detachInterrupt(digitalPinToInterrupt(DATAPIN)); //stop interrupt to prevent receiving in the middle of processing of the datagram
-    if (mqtt_client.connected()){ //if MQTT is connected then send datagram
-      sendDatagram(); //process and send datagram
-    }
-    else {
-      #if DEBUG
-      Serial.println("MQTT client is not connected!");
-      #endif
-    }
-    index=0;
-    receiving=false;
-    attachInterrupt(digitalPinToInterrupt(DATAPIN), interruptHandler, CHANGE);
-  }
+  WiFi.persistent(true);
+  #if DEBUG
+  Serial.println("Connected to Wifi.");
+  digitalWrite(LEDPIN,HIGH); //turn off led when connection is established
+  #endif
+  return true;
 }
 
 void wifiManagerInit() {
@@ -376,6 +106,8 @@ void wifiManagerInit() {
   wifiManager.setRemoveDuplicateAPs(true); //remove duplicate ssid's from the list
   wifiManager.setTimeout(600); //set wifi manager timeout to 10 minutes
   wifiManager.setSaveConfigCallback(saveConfigCallback); //set config save notify callback
+  IPAddress ip, gw, mask, dns;
+  if (staticIpConfig(ip, gw, mask, dns)) wifiManager.setSTAStaticIPConfig(ip, gw, mask);
   if (no_config_file) { wifiManager.resetSettings(); } //reset wifi settings if no config file was found.
   //add all custom parameters
   wifiManager.addParameter(&custom_hostname_text);
@@ -444,21 +176,146 @@ void wifiManagerInit() {
   #endif
 }
 
+static void webSink(const char *text, size_t len, void *) {
+  webserver.sendContent(text, len);
+}
+
+static void webPage(const char *format, ...) { //chunked html page from a PROGMEM template, see page.h
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, "text/html", "");
+  va_list args;
+  va_start(args, format);
+  pageVprintf(webSink, NULL, format, args);
+  va_end(args);
+  webserver.sendContent(""); //end of the chunked response
+  heapSample(); //the request arguments are still allocated
+}
+
 void handleWebNotFound() {
-  String uri = ESP8266WebServer::urlDecode(webserver.uri());
-  String message = "404 Not Found\n\n";
-  message += "URI: ";
-  message += uri;
-  webserver.send(404, "text/plain", message);
+  char message[128]; //the URI is sent as requested, decoding it would copy it into Strings
+  int len = snprintf(message, sizeof(message), "404 Not Found\n\nURI: %s", webserver.uri().c_str());
+  webserver.send(404, "text/plain", message, (size_t)len<sizeof(message) ? len : sizeof(message)-1);
 }
 
 void handleWebRoot() {
   #if DEBUG
   Serial.println("Web GET request /");
   #endif
-  webserver.send(200, "text/html", F("<html><h2>NewentorReceiver433</h2>\
+  heapSample(); //current values for the heap line
+  const publishModeStatistics &publish = publishModeStats[publisherMode()];
+  uint32_t success = timingStats.frames ? (uint64_t)timingStats.valid*1000/timingStats.frames : 0; //tenths of percent
+  uint32_t per_burst = burstStats.bursts ? (uint64_t)burstStats.frames*100/burstStats.bursts : 0; //hundredths
+  uint32_t sample_bits = historyStats.samples ? (uint64_t)historyStats.sample_bits*10/historyStats.samples : 0; //tenths
+  uint32_t sample_bytes = historyStats.flushed_samples ? (uint64_t)historyStats.file_bytes*100/historyStats.flushed_samples : 0; //hundredths
+  uint32_t amplification = historyStats.flushed_bits ? (uint64_t)historyStats.file_bytes*800/historyStats.flushed_bits : 0; //hundredths
+  uint32_t lost[2][2]; //repeats lost per burst, hundredths, [hold][work ran during the burst]
+  for (uint8_t hold=0;hold<2;hold++) for (uint8_t work=0;work<2;work++) {
+    lost[hold][work] = predictStats.bursts[hold][work] ? (uint64_t)predictStats.lost[hold][work]*100/predictStats.bursts[hold][work] : 0;
+  }
+  webPage(PSTR("<html><h2>NewentorReceiver433</h2>\
+  <p>Frame queue: %u of %u used, high water mark %u, overflows %lu</p>\
+  <p>Datagrams published: %lu, duplicates suppressed: %lu, sensors replaced: %lu</p>\
+  <p>MQTT: %s, next attempt in %lu ms, messages sent %lu, failed %lu, unsendable dropped %lu, connects %lu, connect failures %lu<br>\
+  Outbox: %lu pending, oldest %lu s, spilled to file %lu, dropped %lu<br>\
+  Publish mode %s: %lu messages, %lu readings, %lu payload bytes, last minute %lu messages %lu bytes<br>\
+  Frame stream %s: %lu records, %lu failed, %lu repeats skipped, %u subscribers</p>\
+  <p>Decoder windows (us): pulse %u-%u, zero %u-%u, one %u-%u, preamble %u-%u. <a href=\"/timing/reset\">Reset to defaults</a><br>\
+  Observed 1%%/50%%/99%% (us): pulse %u/%u/%u, zero %u/%u/%u, one %u/%u/%u, preamble %u/%u/%u<br>\
+  Frames: %lu received, %lu passed CRC (%lu.%lu%%), %lu learned, %lu window updates. Frames per burst: %lu.%02lu<br>\
+  Edges/s: %lu accepted, %lu glitches rejected, %lu missed while backed off. Edge storms: %lu, interrupt off %lu ms%s</p>\
+  <p>Burst prediction: %u sensors learned, %lu hits, %lu misses, %lu empty windows, mean error %lu ms, work held %lu times%s<br>\
+  Repeats lost per burst with hold off: %lu.%02lu while work ran, %lu.%02lu otherwise. With hold on: %lu.%02lu while work ran, %lu.%02lu otherwise</p>\
+  <p>Receiver %s, mean quality %lu of %lu bursts. Leader election %s: %lu claims sent, %lu received, %lu readings published, %lu left to other receivers</p>\
+  <p>Aggregates: %u sensors, %u bytes each, %lu messages, %lu failed, %lu restored after reset</p>\
+  <p>Capture: %s, %lu edges, %lu bytes, %lu dropped. <a href=\"/capture.bin\">Download</a><br>\
+  <a href=\"/capture?mode=ram&seconds=60\">Capture 60s to RAM</a> <a href=\"/capture?mode=fs&seconds=600\">Capture 10min to file</a> <a href=\"/capture/stop\">Stop</a></p>\
+  <p>History: %lu samples, %lu.%lu bits encoded and %lu.%02lu bytes on flash per sample, write amplification %lu.%02lu<br>\
+  Blocks: %u in RAM, %lu in files, %lu appends, %lu segments removed, %lu dropped. <a href=\"/history\">Download CSV</a></p>\
+  <p>Boot (ms since power on): setup %lu, file system %lu, settings %lu (%s), WiFi %lu (%s), MQTT %lu, first frame %lu, first publish %lu</p>\
+  <p>Heap: %lu bytes free (lowest %lu), largest block %lu (lowest %lu), fragmentation %u%% (highest %u%%). <a href=\"/heap\">History CSV</a></p>\
+  <p><a href=\"/metrics\">Metrics</a> (Prometheus)</p>\
   <p><input type=\"button\" value=\"Configuration\" onclick=\"window.location.replace('/config')\"></p>\
-  </html>"));
+  </html>"),rfQueuedFrames(),FRAMEQUEUE_SIZE,frameQueueHighWater,(unsigned long)frameQueueOverflows,
+  (unsigned long)dedupStats.published,(unsigned long)dedupStats.suppressed,(unsigned long)dedupStats.evictions,
+  mqtt_client.connected() ? "connected" : "disconnected",(unsigned long)publisherBackoff(),(unsigned long)publisherStats.published,
+  (unsigned long)publisherStats.failed,(unsigned long)publisherStats.dropped,(unsigned long)publisherStats.connects,(unsigned long)publisherStats.connect_failures,
+  (unsigned long)outboxDepth(),(unsigned long)(outboxOldestAge(millis())/1000),(unsigned long)outboxStats.spilled,(unsigned long)outboxStats.dropped,
+  publishModeName(publisherMode()),(unsigned long)publish.messages,(unsigned long)publish.readings,(unsigned long)publish.bytes,
+  (unsigned long)publish.messages_per_period,(unsigned long)publish.bytes_per_period,
+  streamModeName(streamGetMode()),(unsigned long)streamStats.records,(unsigned long)streamStats.failed,(unsigned long)streamStats.repeats,streamClients(),
+  rfTimings.pulse_min,rfTimings.pulse_max,rfTimings.zero_min,rfTimings.zero_max,rfTimings.one_min,rfTimings.one_max,rfTimings.newdata_min,rfTimings.newdata_max,
+  timingPercentile(TIMING_PULSE,1),timingPercentile(TIMING_PULSE,50),timingPercentile(TIMING_PULSE,99),
+  timingPercentile(TIMING_ZERO,1),timingPercentile(TIMING_ZERO,50),timingPercentile(TIMING_ZERO,99),
+  timingPercentile(TIMING_ONE,1),timingPercentile(TIMING_ONE,50),timingPercentile(TIMING_ONE,99),
+  timingPercentile(TIMING_PREAMBLE,1),timingPercentile(TIMING_PREAMBLE,50),timingPercentile(TIMING_PREAMBLE,99),
+  (unsigned long)timingStats.frames,(unsigned long)timingStats.valid,(unsigned long)(success/10),(unsigned long)(success%10),
+  (unsigned long)timingStats.learned,(unsigned long)timingStats.updates,(unsigned long)(per_burst/100),(unsigned long)(per_burst%100),
+  (unsigned long)rfRates.accepted,(unsigned long)rfRates.glitches,(unsigned long)rfRates.suppressed,(unsigned long)rfStats.backoffs,
+  (unsigned long)rfStats.backoff_ms,rfBackedOff() ? " (off now)" : "",
+  predictLearned(),(unsigned long)predictStats.hits,(unsigned long)predictStats.misses,(unsigned long)predictStats.empty,
+  (unsigned long)(predictStats.hits ? predictStats.error_ms/predictStats.hits : 0),(unsigned long)predictStats.holds,predictHolding() ? "" : " (hold off)",
+  (unsigned long)(lost[0][1]/100),(unsigned long)(lost[0][1]%100),(unsigned long)(lost[0][0]/100),(unsigned long)(lost[0][0]%100),
+  (unsigned long)(lost[1][1]/100),(unsigned long)(lost[1][1]%100),(unsigned long)(lost[1][0]/100),(unsigned long)(lost[1][0]%100),
+  qualityReceiver(),(unsigned long)(qualityStats.scored ? qualityStats.score_sum/qualityStats.scored : 0),(unsigned long)qualityStats.scored,
+  qualityElecting() ? "on" : "off",(unsigned long)qualityStats.claims_sent,(unsigned long)qualityStats.claims_received,
+  (unsigned long)qualityStats.won,(unsigned long)qualityStats.lost,
+  aggregateCount(),(unsigned)AGGREGATE_SENSOR_BYTES,(unsigned long)aggregateStats.messages,(unsigned long)aggregateStats.failed,
+  (unsigned long)aggregateStats.restored,
+  captureActive() ? "running" : "stopped",(unsigned long)captureEdges(),(unsigned long)captureBytes(),(unsigned long)captureDropped(),
+  (unsigned long)historyStats.samples,(unsigned long)(sample_bits/10),(unsigned long)(sample_bits%10),(unsigned long)(sample_bytes/100),
+  (unsigned long)(sample_bytes%100),(unsigned long)(amplification/100),(unsigned long)(amplification%100),historyRamBlocks(),
+  (unsigned long)historyFileBlocks(),(unsigned long)historyStats.appends,(unsigned long)historyStats.segments_removed,(unsigned long)historyStats.dropped_blocks,
+  (unsigned long)bootStats.phases[BOOT_SETUP],(unsigned long)bootStats.phases[BOOT_FS],(unsigned long)bootStats.phases[BOOT_CONFIG],
+  bootConfigSourceName(),(unsigned long)bootStats.phases[BOOT_WIFI],bootStats.wifi_cached ? "cached access point" : "scan",
+  (unsigned long)bootStats.phases[BOOT_MQTT],(unsigned long)bootStats.phases[BOOT_FRAME],(unsigned long)bootStats.phases[BOOT_PUBLISH],
+  (unsigned long)heapStats.now.free,(unsigned long)heapStats.free_min,(unsigned long)heapStats.now.max_block,(unsigned long)heapStats.max_block_min,
+  heapStats.now.fragmentation,heapStats.fragmentation_max);
+}
+
+void handleWebMetrics() { //Prometheus text format, sent in chunks so no buffer of the whole page is needed
+  static metricsSnapshot snapshot;
+  metricsTake(snapshot);
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, "text/plain; version=0.0.4", "");
+  metricsPrometheus(snapshot, webSink, NULL);
+  webserver.sendContent(""); //end of the chunked response
+}
+
+void handleWebHistory() { //CSV streamed block by block, neither the file nor the response is buffered whole
+  historyQuery query;
+  historyQueryBegin(query);
+  for (int i=0;i<webserver.args();i++) {
+    if (!historyQueryArg(query, webserver.argName(i).c_str(), webserver.arg(i).c_str())) {
+      return webserver.send(400, "text/plain", "Parameters: protocol, address, channel, last");
+    }
+  }
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, "text/csv", "");
+  historyStream(query, webSink, NULL);
+  webserver.sendContent(""); //end of the chunked response
+}
+
+void handleWebHeap() { //heap history CSV, a few lines
+  webserver.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  webserver.send(200, "text/csv", "");
+  heapStream(webSink, NULL);
+  webserver.sendContent(""); //end of the chunked response
+}
+
+void handleWebApiSensors() { //cached body, a client polling with If-None-Match gets a 304 until a reading changes
+  char uptime[11];
+  snprintf(uptime, sizeof(uptime), "%lu", (unsigned long)(halMillis()/1000));
+  webserver.sendHeader("ETag", sensorsEtag());
+  webserver.sendHeader("X-Uptime", uptime);
+  webserver.sendHeader("Cache-Control", "no-cache");
+  for (int i=0;i<webserver.headers();i++) { //no String key built for the lookup, the name is longer than the inline buffer
+    if (strcmp(webserver.headerName(i).c_str(), "If-None-Match")==0 && sensorsNotModified(webserver.header(i).c_str())) {
+      return webserver.send(304);
+    }
+  }
+  size_t len;
+  const char *body = sensorsJson(len);
+  webserver.send(200, "application/json", body, len);
 }
 
 void handleWebConfig() {
@@ -468,17 +325,109 @@ void handleWebConfig() {
   if (!webserver.authenticate(admin_username, admin_pass)) { //check for authentication
     return webserver.requestAuthentication(); // request authentication
   }
-  char response[961];
-  sprintf(response, "<html><h2>NewentorReceiver433 configuraion</h2><form action=\"/save\" method=\"post\" enctype=\"application/x-www-form-urlencoded\">\
+  webPage(PSTR("<html><h2>NewentorReceiver433 configuraion</h2><form action=\"/save\" method=\"post\" enctype=\"application/x-www-form-urlencoded\">\
   <table style=\"border: 0px\">\
   <tr><td>mDNS hostname:</td><td><input type=\"text\" name=\"hostname\" value=\"%s\"></td></tr>\
   <tr><td>Admin password:</td><td><input type=\"password\" name=\"admin_pass\" value=\"%s\"></td></tr>\
   <tr><td>MQTT server IP:</td><td><input type=\"text\" name=\"mqtt_server\" value=\"%s\"></td></tr>\
   <tr><td>MQTT port:</td><td><input type=\"text\" name=\"mqtt_port\" value=\"%s\"></td></tr>\
   <tr><td>MQTT topic:</td><td><input type=\"text\" name=\"mqtt_topic\" value=\"%s\"></td></tr>\
+  <tr><td>Publish mode:</td><td><select name=\"publish_mode\">\
+  <option value=\"json\"%s>JSON per reading</option><option value=\"batch\"%s>JSON array batch</option><option value=\"binary\"%s>Binary 8 byte records</option>\
+  </select></td></tr>\
+  <tr><td>Batch interval (ms):</td><td><input type=\"text\" name=\"batch_interval\" value=\"%s\"></td></tr>\
+  <tr><td>Batch size (1-%u):</td><td><input type=\"text\" name=\"batch_size\" value=\"%s\"></td></tr>\
+  <tr><td>Frame stream:</td><td><select name=\"stream_mode\">\
+  <option value=\"off\"%s>Off</option><option value=\"udp\"%s>UDP</option><option value=\"tcp\"%s>TCP subscribers</option>\
+  </select></td></tr>\
+  <tr><td>Frame stream UDP address (multicast group or listener):</td><td><input type=\"text\" name=\"stream_address\" value=\"%s\"></td></tr>\
+  <tr><td>Frame stream port:</td><td><input type=\"text\" name=\"stream_port\" value=\"%s\"></td></tr>\
+  <tr><td>Stats topic interval (s, 0 off):</td><td><input type=\"text\" name=\"stats_interval\" value=\"%s\"></td></tr>\
+  <tr><td>Aggregates interval (s, 0 off):</td><td><input type=\"text\" name=\"aggregate_interval\" value=\"%s\"></td></tr>\
+  <tr><td>Aggregates topic (empty for &lt;MQTT topic&gt;/aggregates):</td><td><input type=\"text\" name=\"aggregate_topic\" value=\"%s\"></td></tr>\
+  <tr><td>RF edge storm ceiling (edges/s, 0 off):</td><td><input type=\"text\" name=\"edge_rate_max\" value=\"%s\"></td></tr>\
+  <tr><td>Hold web, OTA and flash writes during expected bursts:</td><td><select name=\"burst_hold\">\
+  <option value=\"1\"%s>On</option><option value=\"0\"%s>Off</option></select></td></tr>\
+  <tr><td>Receiver ID (empty for the hostname):</td><td><input type=\"text\" name=\"receiver_id\" value=\"%s\"></td></tr>\
+  <tr><td>Leader election with other receivers:</td><td><select name=\"leader_election\">\
+  <option value=\"1\"%s>On</option><option value=\"0\"%s>Off</option></select></td></tr>\
+  <tr><td>Static IP (empty for DHCP):</td><td><input type=\"text\" name=\"static_ip\" value=\"%s\"></td></tr>\
+  <tr><td>Gateway:</td><td><input type=\"text\" name=\"gateway\" value=\"%s\"></td></tr>\
+  <tr><td>Netmask:</td><td><input type=\"text\" name=\"netmask\" value=\"%s\"></td></tr>\
+  <tr><td>DNS server:</td><td><input type=\"text\" name=\"dns_server\" value=\"%s\"></td></tr>\
   <tr><td><input type=\"submit\" value=\"Save\"></td><td align=\"right\"><input type=\"button\" value=\"Cancel\" onclick=\"window.location.replace('/')\"></td></tr>\
-  </table></form></html>",hostname,admin_pass,mqtt_server,mqtt_port,mqtt_topic);
-  webserver.send(200, "text/html", response);
+  </table></form></html>"),hostname,admin_pass,mqtt_server,mqtt_port,mqtt_topic,
+  publisherMode()==PUBLISH_JSON ? " selected" : "",publisherMode()==PUBLISH_BATCH ? " selected" : "",publisherMode()==PUBLISH_BINARY ? " selected" : "",
+  batch_interval,PUBLISH_BATCH_MAX,batch_size,streamGetMode()==STREAM_OFF ? " selected" : "",streamGetMode()==STREAM_UDP ? " selected" : "",
+  streamGetMode()==STREAM_TCP ? " selected" : "",stream_address,stream_port,stats_interval,aggregate_interval,aggregate_topic,edge_rate_max,predictHolding() ? " selected" : "",
+  predictHolding() ? "" : " selected",receiver_id,qualityElecting() ? " selected" : "",qualityElecting() ? "" : " selected",static_ip,gateway,netmask,dns_server);
+}
+
+void handleWebCapture() {
+  #if DEBUG
+  Serial.println("Web GET request /capture");
+  #endif
+  if (!webserver.authenticate(admin_username, admin_pass)) { //check for authentication
+    return webserver.requestAuthentication(); // request authentication
+  }
+  captureMode mode = CAPTURE_TO_RAM;
+  unsigned long seconds = 60;
+  for (int i=0;i<webserver.args();i++) { //no String temporaries, like handleWebHistory
+    const char *name = webserver.argName(i).c_str(), *value = webserver.arg(i).c_str();
+    if (strcmp(name, "mode")==0) mode = strcmp(value, "fs")==0 ? CAPTURE_TO_FILE : CAPTURE_TO_RAM;
+    else if (strcmp(name, "seconds")==0) seconds = strtoul(value, NULL, 10);
+  }
+  if (seconds==0 || seconds>UINT32_MAX/1000) seconds=60; //no digits, negative or more ms than fit
+  if (!captureStart(mode, seconds*1000)) {
+    return webserver.send(500, "text/plain", "Failed to start capture");
+  }
+  webserver.sendHeader("Location", "/");
+  webserver.send(303);
+}
+
+void handleWebCaptureStop() {
+  if (!webserver.authenticate(admin_username, admin_pass)) { //check for authentication
+    return webserver.requestAuthentication(); // request authentication
+  }
+  captureStop();
+  webserver.sendHeader("Location", "/");
+  webserver.send(303);
+}
+
+void handleWebTimingReset() {
+  if (!webserver.authenticate(admin_username, admin_pass)) { //check for authentication
+    return webserver.requestAuthentication(); // request authentication
+  }
+  timingReset();
+  webserver.sendHeader("Location", "/");
+  webserver.send(303);
+}
+
+void handleWebCaptureDownload() {
+  #if DEBUG
+  Serial.println("Web GET request /capture.bin");
+  #endif
+  if (!webserver.authenticate(admin_username, admin_pass)) { //check for authentication
+    return webserver.requestAuthentication(); // request authentication
+  }
+  if (captureLastMode()==CAPTURE_TO_FILE) {
+    captureLoop(); //flush what is recorded so far
+    File file = LittleFS.open(CAPTURE_FILE, "r");
+    if (!file) {
+      return webserver.send(404, "text/plain", "No capture");
+    }
+    webserver.streamFile(file, "application/octet-stream");
+    file.close();
+    return;
+  }
+  size_t len;
+  const uint8_t *data = captureData(len);
+  if (!data) {
+    return webserver.send(404, "text/plain", "No capture");
+  }
+  webserver.setContentLength(len);
+  webserver.send(200, "application/octet-stream", "");
+  webserver.sendContent((const char*)data, len);
 }
 
 // void handleWebGetparams() {
@@ -502,34 +451,36 @@ void handleWebSave() {
     Serial.println("NOT AUTHENTICATED FOR POST!");
     return webserver.requestAuthentication(); // request authentication
   }
-  #if DEBUG
-  String arguments="POST arguments:"+String(webserver.args())+"\n";
-  #endif
-  for (int i=0; i<webserver.args();i++){
-    if (webserver.argName(i)=="mqtt_server") {webserver.arg(i).toCharArray(mqtt_server,65);}
-    if (webserver.argName(i)=="mqtt_port") {webserver.arg(i).toCharArray(mqtt_port,6);}
-    if (webserver.argName(i)=="mqtt_topic") {webserver.arg(i).toCharArray(mqtt_topic,65);}
-    if (webserver.argName(i)=="admin_pass") {webserver.arg(i).toCharArray(admin_pass,23);}
-    if (webserver.argName(i)=="hostname") {webserver.arg(i).toCharArray(hostname,33);}
-    #if DEBUG
-    arguments+=webserver.argName(i) + ": " + webserver.arg(i) + "\n";
-    #endif
+  for (int i=0; i<webserver.args();i++){ //names and values are referenced, not copied
+    if (!configSet(webserver.argName(i).c_str(), webserver.arg(i).c_str())) {
+      #if DEBUG
+      Serial.printf("Unknown argument %s\n", webserver.argName(i).c_str());
+      #endif
+    }
   }
   saveConfigFile(); //save config file
-  #if DEBUG
-  Serial.println(arguments);
-  String uri = ESP8266WebServer::urlDecode(webserver.uri());
-  Serial.println(uri);
-  #endif
   webserver.send(200, "text/html", F("<html><h3>Settings saved successfully!<br>Restarting...</h3><script>setTimeout(function(){window.location.replace(\"/\")},3000)</script></html>"));
-  for (int j=0;j<2000;j++){
-    webserver.handleClient(); //do a web server loop routine for ~2 seconds
-    delay(1);
-  }  
-  ESP.reset();
+  restart_pending = true; //restart by the system task, the loop keeps serving the page and receiving meanwhile
+  restart_at = millis()+2000;
+}
+
+void otaTask() {
+  ArduinoOTA.handle(); //do an OTA loop routine
+}
+
+void webTask() {
+  webserver.handleClient(); //do a web server loop routine
+}
+
+void systemTask() {
+  if (restart_pending && (int32_t)(millis()-restart_at)>=0) {
+    historyFlushAll(); //history still in RAM
+    ESP.reset();
+  }
 }
 
 void setup() {
+  bootMark(BOOT_SETUP);
   #if DEBUG || DEBUG433
   Serial.begin(115200); //using maxumum available speed of uart to reduce delay in the interrupt routines.
   Serial.println("\nStarted\n");
@@ -550,7 +501,11 @@ void setup() {
     #if DEBUG
     Serial.println("Mounted file system");
     #endif
-    loadConfigFile(); //read config file from LittleFS
+    bootMark(BOOT_FS);
+    loadConfigFile(); //binary settings record, or the json file
+    outboxBegin(); //readings not published before the reboot
+    timingBegin(); //learned sensor timing
+    historyBegin(); //end of the history log and boot number
   }
   else {
     #if DEBUG
@@ -565,13 +520,20 @@ void setup() {
   }
   //end read config file
 
-  wifiManagerInit(); // run the WiFiManager
+  if (wifiFastConnect()) bootStats.wifi_cached = true;
+  else wifiManagerInit(); // run the WiFiManager
+  bootMark(BOOT_WIFI);
+  configWifiUpdate(WiFi.SSID().c_str(), WiFi.psk().c_str(), WiFi.BSSID(), WiFi.channel(), !bootStats.wifi_cached); //access point for the next boot
   
   //////////////////////////////// MQTT client connect
   mqtt_client.setServer(mqtt_server, atoi(mqtt_port)); //set mqtt server parameters
-  if (!mqtt_client.connected()) {
-    mqttConnect(); //connect to mqtt server
-  }
+  publisherBegin(); //publish mode settings
+  metricsBegin(); //stats topic interval
+  qualityBegin(); //receiver ID and leader election
+  streamBegin(); //frame stream socket, the network is up
+  aggregateBegin(); //aggregates kept in RTC memory over a soft reset
+  espClient.setTimeout(MQTT_CONNECT_TIMEOUT); //bounds the TCP connect, the client connects from loop()
+  mqtt_client.setSocketTimeout(MQTT_SOCKET_TIMEOUT); //bounds the wait for CONNACK
   
   //////////////////////////////// OTA server
   #if DEBUG
@@ -579,6 +541,7 @@ void setup() {
   #endif
   ArduinoOTA.setHostname(hostname); //set OTA host name
   ArduinoOTA.setPassword(admin_pass); // set OTA password
+  ArduinoOTA.onStart([]() { historyFlushAll(); }); //history still in RAM is written before the update
   ArduinoOTA.begin(); // begin OTA routines
   
   /////////////////////////////// mDNS server
@@ -604,6 +567,16 @@ void setup() {
   //webserver.on("/getparams", HTTP_GET, handleWebGetparams);
   webserver.on("/config", HTTP_GET, handleWebConfig);
   webserver.on("/save", HTTP_POST, handleWebSave);
+  webserver.on("/capture", HTTP_GET, handleWebCapture);
+  webserver.on("/capture/stop", HTTP_GET, handleWebCaptureStop);
+  webserver.on("/capture.bin", HTTP_GET, handleWebCaptureDownload);
+  webserver.on("/timing/reset", HTTP_GET, handleWebTimingReset);
+  webserver.on("/metrics", HTTP_GET, handleWebMetrics);
+  webserver.on("/api/sensors", HTTP_GET, handleWebApiSensors);
+  webserver.on("/history", HTTP_GET, handleWebHistory);
+  webserver.on("/heap", HTTP_GET, handleWebHeap);
+  static const char *web_headers[] = {"If-None-Match"};
+  webserver.collectHeaders(web_headers, 1); //request headers are only kept if listed
   webserver.onNotFound(handleWebNotFound);
   #if DEBUG
   Serial.println("Starting Web server");
@@ -618,14 +591,35 @@ void setup() {
   #if DEBUG
   Serial.println("Starting RF433 reception");
   #endif
-  attachInterrupt(digitalPinToInterrupt(DATAPIN), interruptHandler, CHANGE); // attach RF listening interrupt and start receiving
+  rfGovernorBegin(strtoul(edge_rate_max, NULL, 10)); //edge storm ceiling
+  predictBegin(burst_hold[0]=='1'); //learn sensor periods, hold deferrable work while a burst is expected
+  schedulerSetHold(predictHold, predictActivity);
+  halEdgeSourceBegin(); // attach RF listening interrupt and start receiving
+
+  /////////////////////////////  Tasks run from loop(), in priority order
+  bool scheduled = true; //false if a task did not fit into the scheduler table
+  scheduled &= schedulerAdd("rf", processFrames, 0, 2000, SCHEDULER_CRITICAL); //decode received datagrams and queue them to the outbox, before every other task
+  scheduled &= schedulerAdd("mqtt", publisherLoop, 10000, 20000); //mqtt client loop and publish the outbox, reconnects wait for schedulerHolding()
+  scheduled &= schedulerAdd("quality", qualityLoop, 50000, 1000); //publish or drop readings after the leader election
+  scheduled &= schedulerAdd("stream", streamLoop, 100000, 1000); //accept frame stream subscribers
+  scheduled &= schedulerAdd("capture", captureLoop, 10000, 10000); //write RF capture to file
+  scheduled &= schedulerAdd("web", webTask, 5000, 20000, SCHEDULER_DEFERRABLE);
+  scheduled &= schedulerAdd("ota", otaTask, 50000, 1000, SCHEDULER_DEFERRABLE);
+  scheduled &= schedulerAdd("metrics", metricsLoop, 1000000, 10000, SCHEDULER_DEFERRABLE); //stats topic
+  scheduled &= schedulerAdd("aggregate", aggregateLoop, 1000000, 20000, SCHEDULER_DEFERRABLE); //aggregate messages of every sensor
+  scheduled &= schedulerAdd("history", historyLoop, 1000000, 20000, SCHEDULER_DEFERRABLE); //write the oldest history blocks to flash
+  scheduled &= schedulerAdd("timing", timingLoop, 1000000, 20000, SCHEDULER_DEFERRABLE); //save learned decoder windows
+  scheduled &= schedulerAdd("heap", heapSample, HEAP_PERIOD*1000UL, 1000, SCHEDULER_DEFERRABLE); //free heap, largest block and fragmentation
+  scheduled &= schedulerAdd("system", systemTask, 100000, 100, SCHEDULER_DEFERRABLE);
+  #if DEBUG
+  if (!scheduled) { //a task left out never runs, e.g. the restart after saving the settings
+    Serial.println("Scheduler table is full, raise SCHEDULER_TASKS");
+  }
+  #endif
 }
 
 void loop() {
-  if (!mqtt_client.connected()) {
-    mqttConnect(); //reconnect to mqtt server if it gets disconnected
-  }
-  mqtt_client.loop(); //do a mqtt client loop routine
-  ArduinoOTA.handle(); //do an OTA loop routine
-  webserver.handleClient(); //do a web server loop routine
+  uint32_t start = micros();
+  schedulerRun(); //tasks added in setup()
+  metricsLoopTime(micros()-start);
 }
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+#include "rf_receiver.h"
+#include "burst.h"
+#include "dedup.h"
+#include "outbox.h"
+#include "publisher.h"
+#include "aggregate.h"
+#include "quality.h"
+#include "stream.h"
+#include "heap.h"
+#include "metrics.h"
+
+struct metricDescriptor {
+  const char *name;
+  const char *type;
+  const char *help;
+};
+
+static const metricDescriptor descriptors[METRICS] = {
+  {"uptime_seconds", "gauge", "Seconds since boot"},
+  {"rf_edges_total", "counter", "Edges seen by the RF interrupt"},
+  {"rf_preambles_total", "counter", "Preamble pauses starting a datagram"},
+  {"rf_restarts_total", "counter", "Preamble pauses in the middle of a datagram"},
+  {"rf_error_pulse_total", "counter", "Pulses out of the decoder window"},
+  {"rf_error_length_total", "counter", "Pauses out of the decoder windows"},
+  {"rf_frames_total", "counter", "Complete datagrams received"},
+  {"rf_glitches_total", "counter", "Edges of noise spikes dropped by the glitch filter"},
+  {"rf_backoffs_total", "counter", "Edge storms that turned the RF interrupt off"},
+  {"rf_backoff_milliseconds_total", "counter", "Time the RF interrupt was off"},
+  {"rf_edges_suppressed_total", "counter", "Edges missed while the RF interrupt was off, estimated"},
+  {"rf_queue_overflows_total", "counter", "Datagrams dropped because the frame queue was full"},
+  {"datagrams_invalid_total", "counter", "Received datagrams failing the validity check"},
+  {"datagrams_bad_crc_total", "counter", "Received datagrams failing the CRC check"},
+  {"bursts_total", "counter", "Bursts of repeats completed"},
+  {"bursts_failed_total", "counter", "Bursts without a valid datagram"},
+  {"duplicates_suppressed_total", "counter", "Readings dropped by the duplicate filter"},
+  {"mqtt_published_total", "counter", "Messages accepted by the MQTT client"},
+  {"mqtt_publish_failed_total", "counter", "Failed publish calls"},
+  {"mqtt_dropped_total", "counter", "Readings dropped from the outbox because they can not be formatted"},
+  {"mqtt_connect_failures_total", "counter", "Failed MQTT connect attempts"},
+  {"outbox_depth", "gauge", "Readings waiting to be published"},
+  {"outbox_dropped_total", "counter", "Readings lost because the outbox was full"},
+  {"predict_sensors", "gauge", "Sensors with predicted burst windows"},
+  {"predict_hits_total", "counter", "Bursts of learned sensors within the predicted window"},
+  {"predict_misses_total", "counter", "Bursts of learned sensors outside the predicted window"},
+  {"predict_empty_windows_total", "counter", "Predicted windows without a burst"},
+  {"predict_error_milliseconds_total", "counter", "Absolute arrival time error of the hits"},
+  {"predict_holds_total", "counter", "Times deferrable work was held back for a predicted burst"},
+  {"aggregate_sensors", "gauge", "Sensors with sliding window aggregates"},
+  {"aggregate_sensor_bytes", "gauge", "Fixed memory of the aggregates of one sensor"},
+  {"aggregate_messages_total", "counter", "Aggregate messages published"},
+  {"aggregate_failed_total", "counter", "Aggregate messages that failed to publish"},
+  {"aggregate_restored_total", "counter", "Sensors whose aggregates were restored from RTC memory at boot"},
+  {"quality_scored_total", "counter", "Valid bursts given a quality score"},
+  {"quality_score_sum", "counter", "Sum of the quality scores, 0-100 each"},
+  {"quality_claims_sent_total", "counter", "Readings announced to the other receivers"},
+  {"quality_claims_received_total", "counter", "Readings announced by other receivers"},
+  {"quality_elections_won_total", "counter", "Readings published after the leader election"},
+  {"quality_elections_lost_total", "counter", "Readings dropped because another receiver had a better copy"},
+  {"stream_records_total", "counter", "Frame stream records sent"},
+  {"stream_failed_total", "counter", "Frame stream records that did not reach the group or a subscriber"},
+  {"stream_repeats_total", "counter", "Later repeats of a burst not sent on the frame stream"},
+  {"stream_clients", "gauge", "Connected TCP frame stream subscribers"},
+  {"heap_free_bytes", "gauge", "Free heap"},
+  {"heap_free_min_bytes", "gauge", "Lowest free heap sampled since boot"},
+  {"heap_max_block_bytes", "gauge", "Largest block that can be allocated"},
+  {"heap_max_block_min_bytes", "gauge", "Smallest largest block sampled since boot"},
+  {"heap_fragmentation_percent", "gauge", "Heap fragmentation reported by the platform"},
+  {"heap_fragmentation_max_percent", "gauge", "Highest heap fragmentation sampled since boot"},
+  {"cpu_frequency_hertz", "gauge", "Cycle counter frequency of the interrupt duration histogram"},
+};
+
+//series of every scheduler task
+enum taskSeries {TASK_RUNS, TASK_OVERRUNS, TASK_DEFERRALS, TASK_HOLDS, TASK_RUNTIME, TASK_MAX_RUNTIME, TASK_MAX_LATENCY, TASK_SERIES};
+
+static const metricDescriptor task_descriptors[TASK_SERIES] = {
+  {"task_runs_total", "counter", "Scheduler task runs"},
+  {"task_overruns_total", "counter", "Task runs longer than the task budget"},
+  {"task_deferrals_total", "counter", "Passes a due task waited for because the pass budget was used up"},
+  {"task_holds_total", "counter", "Times a deferrable task was held back for a predicted burst"},
+  {"task_runtime_microseconds_total", "counter", "Total task runtime"},
+  {"task_max_runtime_microseconds", "gauge", "Longest task run since boot"},
+  {"task_max_latency_microseconds", "gauge", "Longest wait of a due task since boot"},
+};
+
+static volatile metricsHistogram isr_histogram = {};
+static metricsHistogram loop_histogram = {};
+static metricsHistogram latency_histogram = {};
+static uint32_t stats_period = 0; //stats_interval setting in ms, 0 if the stats topic is off
+static uint32_t stats_next = 0; //halMillis() of the next stats message
+
+static IRAM_ATTR uint8_t bucketOf(uint32_t value, uint32_t bound) { //shift loop, __builtin_clz is not in IRAM
+  uint8_t bucket = 0;
+  while (bucket<METRICS_BUCKETS && value>bound) {
+    bound <<= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+IRAM_ATTR void metricsIsr(uint32_t cycles) {
+  isr_histogram.buckets[bucketOf(cycles, METRICS_ISR_FIRST)]++;
+  isr_histogram.sum += cycles;
+  isr_histogram.count++; //last, loop() checks it to detect an update while copying
+}
+
+static void histogramAdd(metricsHistogram &histogram, uint32_t value, uint32_t first) {
+  histogram.buckets[bucketOf(value, first)]++;
+  histogram.sum += value;
+  histogram.count++;
+}
+
+void metricsLoopTime(uint32_t us) {
+  histogramAdd(loop_histogram, us, METRICS_LOOP_FIRST);
+}
+
+void metricsPublishLatency(uint32_t ms) {
+  histogramAdd(latency_histogram, ms, METRICS_LATENCY_FIRST);
+}
+
+static uint64_t taskValue(const schedulerTask &task, uint8_t series) {
+  switch (series) {
+    case TASK_RUNS: return task.runs;
+    case TASK_OVERRUNS: return task.overruns;
+    case TASK_DEFERRALS: return task.deferrals;
+    case TASK_HOLDS: return task.holds;
+    case TASK_RUNTIME: return task.runtime;
+    case TASK_MAX_RUNTIME: return task.max_runtime;
+    case TASK_MAX_LATENCY: return task.max_latency;
+  }
+  return 0;
+}
+
+void metricsTake(metricsSnapshot &snapshot) {
+  uint32_t *values = snapshot.values;
+  values[METRIC_UPTIME] = halMillis()/1000;
+  values[METRIC_EDGES] = rfStats.edges;
+  values[METRIC_PREAMBLES] = rfStats.preambles;
+  values[METRIC_RESTARTS] = rfStats.restarts;
+  values[METRIC_ERROR_PULSE] = rfStats.error_pulse;
+  values[METRIC_ERROR_LENGTH] = rfStats.error_length;
+  values[METRIC_FRAMES] = rfStats.frames;
+  values[METRIC_GLITCHES] = rfStats.glitches;
+  values[METRIC_BACKOFFS] = rfStats.backoffs;
+  values[METRIC_BACKOFF_TIME] = rfStats.backoff_ms;
+  values[METRIC_SUPPRESSED] = rfStats.suppressed;
+  values[METRIC_QUEUE_OVERFLOWS] = frameQueueOverflows;
+  values[METRIC_INVALID] = burstStats.invalid;
+  values[METRIC_BAD_CRC] = burstStats.bad_crc;
+  values[METRIC_BURSTS] = burstStats.bursts;
+  values[METRIC_BURSTS_FAILED] = burstStats.failed;
+  values[METRIC_DUPLICATES] = dedupStats.suppressed;
+  values[METRIC_PUBLISHED] = publisherStats.published;
+  values[METRIC_PUBLISH_FAILED] = publisherStats.failed;
+  values[METRIC_PUBLISH_DROPPED] = publisherStats.dropped;
+  values[METRIC_CONNECT_FAILURES] = publisherStats.connect_failures;
+  values[METRIC_OUTBOX_DEPTH] = outboxDepth();
+  values[METRIC_OUTBOX_DROPPED] = outboxStats.dropped;
+  values[METRIC_PREDICT_SENSORS] = predictLearned();
+  values[METRIC_PREDICT_HITS] = predictStats.hits;
+  values[METRIC_PREDICT_MISSES] = predictStats.misses;
+  values[METRIC_PREDICT_EMPTY] = predictStats.empty;
+  values[METRIC_PREDICT_ERROR] = predictStats.error_ms;
+  values[METRIC_PREDICT_HOLDS] = predictStats.holds;
+  values[METRIC_AGGREGATE_SENSORS] = aggregateCount();
+  values[METRIC_AGGREGATE_SENSOR_BYTES] = AGGREGATE_SENSOR_BYTES;
+  values[METRIC_AGGREGATE_MESSAGES] = aggregateStats.messages;
+  values[METRIC_AGGREGATE_FAILED] = aggregateStats.failed;
+  values[METRIC_AGGREGATE_RESTORED] = aggregateStats.restored;
+  values[METRIC_QUALITY_SCORED] = qualityStats.scored;
+  values[METRIC_QUALITY_SCORE_SUM] = qualityStats.score_sum;
+  values[METRIC_QUALITY_CLAIMS_SENT] = qualityStats.claims_sent;
+  values[METRIC_QUALITY_CLAIMS_RECEIVED] = qualityStats.claims_received;
+  values[METRIC_QUALITY_WON] = qualityStats.won;
+  values[METRIC_QUALITY_LOST] = qualityStats.lost;
+  values[METRIC_STREAM_RECORDS] = streamStats.records;
+  values[METRIC_STREAM_FAILED] = streamStats.failed;
+  values[METRIC_STREAM_REPEATS] = streamStats.repeats;
+  values[METRIC_STREAM_CLIENTS] = streamClients();
+  heapSample();
+  values[METRIC_HEAP_FREE] = heapStats.now.free;
+  values[METRIC_HEAP_FREE_MIN] = heapStats.free_min;
+  values[METRIC_HEAP_MAX_BLOCK] = heapStats.now.max_block;
+  values[METRIC_HEAP_MAX_BLOCK_MIN] = heapStats.max_block_min;
+  values[METRIC_HEAP_FRAGMENTATION] = heapStats.now.fragmentation;
+  values[METRIC_HEAP_FRAGMENTATION_MAX] = heapStats.fragmentation_max;
+  values[METRIC_CPU_FREQUENCY] = halCycleFrequency();
+  uint32_t count;
+  do { //copy again if an interrupt updated the histogram meanwhile
+    count = isr_histogram.count;
+    for (uint8_t i=0;i<=METRICS_BUCKETS;i++) snapshot.isr.buckets[i] = isr_histogram.buckets[i];
+    snapshot.isr.sum = isr_histogram.sum;
+    snapshot.isr.count = count;
+  } while (count!=isr_histogram.count);
+  snapshot.loop = loop_histogram;
+  snapshot.latency = latency_histogram;
+  snapshot.task_count = schedulerCount();
+  for (uint8_t i=0;i<snapshot.task_count;i++) snapshot.tasks[i] = schedulerGet(i);
+  for (uint8_t i=0;i<BOOT_PHASES;i++) snapshot.boot[i] = bootStats.phases[i];
+  memcpy(snapshot.bursts, predictStats.bursts, sizeof(snapshot.bursts));
+  memcpy(snapshot.lost, predictStats.lost, sizeof(snapshot.lost));
+}
+
+static const char *const hold_labels[2] = {"off", "on"}; //burst_hold setting
+static const char *const work_labels[2] = {"no", "yes"}; //deferrable work ran during the burst
+
+struct metricsWriter { //collects formatted lines into chunks for the sink, a NULL sink only counts the length
+  metricsSink sink;
+  void *context;
+  char chunk[METRICS_CHUNK];
+  size_t len;
+  size_t total;
+};
+
+static void writerFlush(metricsWriter &writer) {
+  if (writer.sink && writer.len) writer.sink(writer.chunk, writer.len, writer.context);
+  writer.len = 0;
+}
+
+static void writerPrintf(metricsWriter &writer, const char *format, ...) {
+  char line[128]; //longest line is a HELP line
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len<0) return;
+  if ((size_t)len>=sizeof(line)) len = sizeof(line)-1;
+  if (writer.len+len>sizeof(writer.chunk)) writerFlush(writer);
+  memcpy(writer.chunk+writer.len, line, len);
+  writer.len += len;
+  writer.total += len;
+}
+
+static void prometheusHistogram(metricsWriter &writer, const char *name, const char *help, const metricsHistogram &histogram, uint32_t first) {
+  writerPrintf(writer, "# HELP " METRICS_PREFIX "%s %s\n", name, help);
+  writerPrintf(writer, "# TYPE " METRICS_PREFIX "%s histogram\n", name);
+  uint32_t cumulative = 0;
+  for (uint8_t i=0;i<METRICS_BUCKETS;i++) {
+    cumulative += histogram.buckets[i];
+    writerPrintf(writer, METRICS_PREFIX "%s_bucket{le=\"%lu\"} %lu\n", name, (unsigned long)first << i, (unsigned long)cumulative);
+  }
+  writerPrintf(writer, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)histogram.count);
+  writerPrintf(writer, METRICS_PREFIX "%s_sum %llu\n", name, (unsigned long long)histogram.sum);
+  writerPrintf(writer, METRICS_PREFIX "%s_count %lu\n", name, (unsigned long)histogram.count);
+}
+
+size_t metricsPrometheus(const metricsSnapshot &snapshot, metricsSink sink, void *context) {
+  metricsWriter writer;
+  writer.sink = sink;
+  writer.context = context;
+  writer.len = writer.total = 0;
+  for (uint8_t i=0;i<METRICS;i++) {
+    const metricDescriptor &metric = descriptors[i];
+    writerPrintf(writer, "# HELP " METRICS_PREFIX "%s %s\n", metric.name, metric.help);
+    writerPrintf(writer, "# TYPE " METRICS_PREFIX "%s %s\n", metric.name, metric.type);
+    writerPrintf(writer, METRICS_PREFIX "%s %lu\n", metric.name, (unsigned long)snapshot.values[i]);
+  }
+  prometheusHistogram(writer, "isr_duration_cycles", "RF interrupt duration in CPU cycles", snapshot.isr, METRICS_ISR_FIRST);
+  prometheusHistogram(writer, "loop_duration_microseconds", "loop() iteration time", snapshot.loop, METRICS_LOOP_FIRST);
+  prometheusHistogram(writer, "publish_latency_milliseconds", "Time from queueing a reading to publishing it", snapshot.latency, METRICS_LATENCY_FIRST);
+  for (uint8_t series=0;series<TASK_SERIES;series++) {
+    const metricDescriptor &metric = task_descriptors[series];
+    writerPrintf(writer, "# HELP " METRICS_PREFIX "%s %s\n", metric.name, metric.help);
+    writerPrintf(writer, "# TYPE " METRICS_PREFIX "%s %s\n", metric.name, metric.type);
+    for (uint8_t i=0;i<snapshot.task_count;i++) {
+      writerPrintf(writer, METRICS_PREFIX "%s{task=\"%s\"} %llu\n", metric.name, snapshot.tasks[i].name,
+        (unsigned long long)taskValue(snapshot.tasks[i], series));
+    }
+  }
+  writerPrintf(writer, "# HELP " METRICS_PREFIX "boot_phase_milliseconds Time from power on until the boot phase was reached, 0 if not yet\n");
+  writerPrintf(writer, "# TYPE " METRICS_PREFIX "boot_phase_milliseconds gauge\n");
+  for (uint8_t i=0;i<BOOT_PHASES;i++) {
+    writerPrintf(writer, METRICS_PREFIX "boot_phase_milliseconds{phase=\"%s\"} %lu\n", bootPhaseName(i), (unsigned long)snapshot.boot[i]);
+  }
+  writerPrintf(writer, "# HELP " METRICS_PREFIX "predict_bursts_total Bursts by burst_hold setting and deferrable work during the burst\n");
+  writerPrintf(writer, "# TYPE " METRICS_PREFIX "predict_bursts_total counter\n");
+  for (uint8_t hold=0;hold<2;hold++) for (uint8_t work=0;work<2;work++) {
+    writerPrintf(writer, METRICS_PREFIX "predict_bursts_total{hold=\"%s\",work=\"%s\"} %lu\n", hold_labels[hold], work_labels[work],
+      (unsigned long)snapshot.bursts[hold][work]);
+  }
+  writerPrintf(writer, "# HELP " METRICS_PREFIX "predict_repeats_lost_total Repeats missing from these bursts\n");
+  writerPrintf(writer, "# TYPE " METRICS_PREFIX "predict_repeats_lost_total counter\n");
+  for (uint8_t hold=0;hold<2;hold++) for (uint8_t work=0;work<2;work++) {
+    writerPrintf(writer, METRICS_PREFIX "predict_repeats_lost_total{hold=\"%s\",work=\"%s\"} %lu\n", hold_labels[hold],
+      work_labels[work], (unsigned long)snapshot.lost[hold][work]);
+  }
+  writerFlush(writer);
+  return writer.total;
+}
+
+static void jsonHistogram(metricsWriter &writer, const char *name, const metricsHistogram &histogram, uint32_t first) {
+  writerPrintf(writer, ",\"%s\":{\"first\":%lu,\"buckets\":[", name, (unsigned long)first);
+  for (uint8_t i=0;i<=METRICS_BUCKETS;i++) writerPrintf(writer, i ? ",%lu" : "%lu", (unsigned long)histogram.buckets[i]);
+  writerPrintf(writer, "],\"sum\":%llu,\"count\":%lu}", (unsigned long long)histogram.sum, (unsigned long)histogram.count);
+}
+
+size_t metricsJson(const metricsSnapshot &snapshot, metricsSink sink, void *context) {
+  metricsWriter writer;
+  writer.sink = sink;
+  writer.context = context;
+  writer.len = writer.total = 0;
+  for (uint8_t i=0;i<METRICS;i++) {
+    writerPrintf(writer, "%c\"%s\":%lu", i ? ',' : '{', descriptors[i].name, (unsigned long)snapshot.values[i]);
+  }
+  jsonHistogram(writer, "isr_duration_cycles", snapshot.isr, METRICS_ISR_FIRST);
+  jsonHistogram(writer, "loop_duration_microseconds", snapshot.loop, METRICS_LOOP_FIRST);
+  jsonHistogram(writer, "publish_latency_milliseconds", snapshot.latency, METRICS_LATENCY_FIRST);
+  writerPrintf(writer, ",\"tasks\":{");
+  for (uint8_t i=0;i<snapshot.task_count;i++) {
+    writerPrintf(writer, "%s\"%s\":{", i ? "," : "", snapshot.tasks[i].name);
+    for (uint8_t series=0;series<TASK_SERIES;series++) {
+      writerPrintf(writer, "%s\"%s\":%llu", series ? "," : "", task_descriptors[series].name,
+        (unsigned long long)taskValue(snapshot.tasks[i], series));
+    }
+    writerPrintf(writer, "}");
+  }
+  writerPrintf(writer, "},\"boot_phase_milliseconds\":{");
+  for (uint8_t i=0;i<BOOT_PHASES;i++) writerPrintf(writer, "%s\"%s\":%lu", i ? "," : "", bootPhaseName(i), (unsigned long)snapshot.boot[i]);
+  writerPrintf(writer, "},\"predict_bursts\":{");
+  for (uint8_t hold=0;hold<2;hold++) for (uint8_t work=0;work<2;work++) { //"hold_on_work_yes":[bursts,lost repeats]
+    writerPrintf(writer, "%s\"hold_%s_work_%s\":[%lu,%lu]", hold || work ? "," : "", hold_labels[hold], work_labels[work],
+      (unsigned long)snapshot.bursts[hold][work], (unsigned long)snapshot.lost[hold][work]);
+  }
+  writerPrintf(writer, "}}");
+  writerFlush(writer);
+  return writer.total;
+}
+
+void metricsBegin() {
+  stats_period = strtoul(stats_interval, NULL, 10)*1000;
+  stats_next = halMillis()+stats_period;
+}
+
+static void mqttSink(const char *text, size_t len, void *context) {
+  bool &ok = *(bool*)context;
+  ok = halMqttWrite((const uint8_t*)text, len) && ok;
+}
+
+void metricsLoop() {
+  if (!stats_period || (int32_t)(halMillis()-stats_next)<0 || !halMqttConnected()) return;
+  stats_next += stats_period;
+  if ((int32_t)(halMillis()-stats_next)>=0) stats_next = halMillis()+stats_period; //was disconnected for a while
+  static metricsSnapshot snapshot;
+  metricsTake(snapshot);
+  char topic[sizeof(mqtt_topic)+sizeof(METRICS_STATS_TOPIC)];
+  snprintf(topic, sizeof(topic), "%s" METRICS_STATS_TOPIC, mqtt_topic);
+  bool ok = halMqttBeginPublish(topic, metricsJson(snapshot, NULL, NULL)); //first pass only measures the length
+  if (ok) {
+    metricsJson(snapshot, mqttSink, &ok);
+    ok = halMqttEndPublish() && ok;
+  }
+  #if DEBUG
+  if (!ok) halDebug("Failed to publish stats\n");
+  #endif
+}
@@ -0,0 +1,296 @@
+// Micro-benchmarks of the decoder hot paths against the old implementations in reference.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "newentor.h"
+#include "rf_receiver.h"
+#include "rf_decoder.h"
+#include "protocol.h"
+#include "sensors.h"
+#include "history.h"
+#include "hal.h"
+#include "hal_linux.h"
+#include "reference.h"
+#include "bench.h"
+
+#define BENCH_FRAMES 1024 //random frames per benchmark round
+
+static volatile uint32_t sink; //keeps the compiler from optimizing the benchmarked code away
+
+static uint64_t benchCycles() { //time stamp counter, or nanoseconds where there is none
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+#endif
+}
+
+static double benchSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+template <typename F> static void benchRun(const char *name, unsigned rounds, unsigned per_round, F body) {
+  body(); //warm up
+  double start = benchSeconds();
+  uint64_t cycles = benchCycles();
+  for (unsigned i=0;i<rounds;i++) body();
+  cycles = benchCycles()-cycles;
+  double elapsed = benchSeconds()-start;
+  double count = (double)rounds*per_round;
+  printf("%-24s %10.2f ns/op %10.1f cycles/op\n", name, elapsed*1e9/count, cycles/count);
+}
+
+static void benchRandomFrames(uint64_t *frames, unsigned count) {
+  srand(1);
+  for (unsigned i=0;i<count;i++) frames[i] = (((uint64_t)rand() << 31) ^ rand()) & DATAGRAM_MASK;
+}
+
+//frame assembly and field extraction: bool array + bitWrite repack (old) vs 64 bit shift register (new)
+static void benchFrame() {
+  static uint64_t frames[BENCH_FRAMES];
+  benchRandomFrames(frames, BENCH_FRAMES);
+  benchRun("frame/bool-array", 2000, BENCH_FRAMES, [&]() {
+    for (unsigned f=0;f<BENCH_FRAMES;f++) {
+      bool datagram[DATAGRAM];
+      for (unsigned index=0;index<DATAGRAM;index++) datagram[index] = (frames[f] >> (DATAGRAM-1-index)) & 1; //per bit work in the interrupt
+      uint8_t databytes[DATAGRAM/8];
+      for (uint8_t i=0;i<DATAGRAM;i++) { //bitWrite(databytes[i/8],7-(i%8),datagram[i])
+        if (datagram[i]) databytes[i/8] |= 1 << (7-(i%8));
+        else databytes[i/8] &= ~(1 << (7-(i%8)));
+      }
+      int battery_low = (databytes[1] >> 2) & 1;
+      int temp_raw    = (databytes[2] << 4) | (databytes[3] >> 4);
+      int humidity    = (databytes[3] & 0x0F) * 10 + (databytes[4] >> 4);
+      int channel     = databytes[4] & 0x03;
+      sink += databytes[0] + battery_low + temp_raw + humidity + channel;
+    }
+  });
+  benchRun("frame/shift-register", 2000, BENCH_FRAMES, [&]() {
+    for (unsigned f=0;f<BENCH_FRAMES;f++) {
+      uint64_t datagram = 0;
+      for (unsigned index=0;index<DATAGRAM;index++) datagram = (datagram << 1) | ((frames[f] >> (DATAGRAM-1-index)) & 1); //per bit work in the interrupt
+      uint64_t data = datagram & DATAGRAM_MASK;
+      sink += newentorAddress(data) + newentorBattery(data) + newentorTempRaw(data) + newentorHumidity(data) + newentorChannel(data);
+    }
+  });
+}
+
+//table driven CRC against the bitwise reference, equivalence is checked by test/test_crc
+static void benchCrc() {
+  static uint64_t frames[BENCH_FRAMES];
+  benchRandomFrames(frames, BENCH_FRAMES);
+  for (unsigned f=0;f<BENCH_FRAMES;f+=2) { //half of the frames valid, so both outcomes are measured
+    frames[f] = (frames[f] & ~(0xFULL << 28)) | (uint64_t)(newentorCrc4(((frames[f] >> 8) & 0xFF0FFFFF) | (uint32_t)(frames[f] & 0x0F) << 20) ^ ((frames[f] >> 4) & 0x0f)) << 28;
+  }
+  static uint8_t bytes[BENCH_FRAMES][5];
+  for (unsigned f=0;f<BENCH_FRAMES;f++) newentorToBytes(frames[f], bytes[f]);
+  benchRun("crc/bitwise", 2000, BENCH_FRAMES, [&]() {
+    for (unsigned f=0;f<BENCH_FRAMES;f++) sink += infactory_crc_check_bitwise(bytes[f]);
+  });
+  benchRun("crc/table", 2000, BENCH_FRAMES, [&]() {
+    for (unsigned f=0;f<BENCH_FRAMES;f++) sink += newentorCrcCheck(frames[f]);
+  });
+}
+
+//integer message encoder against double math + ArduinoJson, identical output is checked by test/test_json
+static void benchJson() {
+  static uint64_t frames[BENCH_FRAMES];
+  benchRandomFrames(frames, BENCH_FRAMES);
+  char msg[NEWENTOR_JSON_SIZE];
+  benchRun("json/double-arduinojson", 200, BENCH_FRAMES, [&]() {
+    for (unsigned f=0;f<BENCH_FRAMES;f++) sink += jsonArduinoJson(frames[f], 6, msg, sizeof(msg));
+  });
+  benchRun("json/integer", 200, BENCH_FRAMES, [&]() {
+    for (unsigned f=0;f<BENCH_FRAMES;f++) sink += jsonInteger(frames[f], 6, msg, sizeof(msg));
+  });
+}
+
+//decoder set cost per edge as protocols are added: Newentor edges fed through sets of 1, 4 and 8 decoders.
+//the extra descriptors only exist here, with timing that never matches Newentor so every one of them runs its reject path
+#define BENCH_PROTOCOL(name, id, preamble, one, zero) \
+  static constexpr rfProtocol name = {#name, id, 36, 4, false, {preamble-400, preamble+400, one-300, one+300, zero-200, zero+200, 150, 350}, \
+    nexusCheck, {28, 8}, {24, 2}, {27, 1}, {12, 12}, {0, 8}, 0, RF_TEMP_C_SIGNED, RF_HUMIDITY_BINARY};
+BENCH_PROTOCOL(benchProtocol2, RF_PROTOCOLS+0, 5800, 1300, 650)
+BENCH_PROTOCOL(benchProtocol3, RF_PROTOCOLS+1, 6400, 1500, 750)
+BENCH_PROTOCOL(benchProtocol4, RF_PROTOCOLS+2, 7000, 1700, 850)
+BENCH_PROTOCOL(benchProtocol5, RF_PROTOCOLS+3, 11000, 3000, 1100)
+BENCH_PROTOCOL(benchProtocol6, RF_PROTOCOLS+4, 12000, 3200, 1150)
+BENCH_PROTOCOL(benchProtocol7, RF_PROTOCOLS+5, 13000, 4800, 2800)
+
+struct benchOutput {
+  static unsigned long frames;
+  static void frame(uint64_t data, uint8_t protocol, uint32_t, bool) { frames++; sink += data ^ protocol; }
+  static rfFrameTiming *timing() { static rfFrameTiming buffer; return &buffer; }
+};
+unsigned long benchOutput::frames;
+
+struct benchEdge {
+  bool state;
+  uint16_t duration;
+};
+
+template <class Set> static void benchDecoderSet(const char *name, const benchEdge *edges, unsigned count) {
+  static Set decoders;
+  benchOutput::frames = 0;
+  benchRun(name, 200, count, [&]() {
+    for (unsigned i=0;i<count;i++) decoders.edge(edges[i].state, edges[i].duration, i);
+  });
+  printf("%-24s %10lu frames per round\n", "", benchOutput::frames/201);
+}
+
+static void benchProtocols() {
+  static uint64_t frames[BENCH_FRAMES/8];
+  benchRandomFrames(frames, BENCH_FRAMES/8);
+  static benchEdge edges[BENCH_FRAMES/8*protocolNewentor.repeats*(2*DATAGRAM+4)];
+  unsigned count = 0;
+  srand(3);
+  for (uint64_t data : frames) {
+    for (unsigned repeat=0;repeat<protocolNewentor.repeats;repeat++) {
+      edges[count++] = {true, (uint16_t)(8400+rand()%200)};
+      for (int bit=DATAGRAM-1;bit>=0;bit--) {
+        edges[count++] = {false, (uint16_t)(450+rand()%100)};
+        edges[count++] = {true, (uint16_t)(((data >> bit) & 1 ? 3950 : 1950)+rand()%100)};
+      }
+      edges[count++] = {false, (uint16_t)(450+rand()%100)};
+      edges[count++] = {true, 2000}; //gap between repeats
+    }
+  }
+  benchDecoderSet<rfDecoderSet<benchOutput, protocolNewentor>>("protocols/1", edges, count);
+  benchDecoderSet<rfDecoderSet<benchOutput, protocolNewentor, protocolNexus, benchProtocol2, benchProtocol3>>("protocols/4", edges, count);
+  benchDecoderSet<rfDecoderSet<benchOutput, protocolNewentor, protocolNexus, benchProtocol2, benchProtocol3, benchProtocol4,
+    benchProtocol5, benchProtocol6, benchProtocol7>>("protocols/8", edges, count);
+}
+
+//api/sensors response: rendered for every request against served from the cache, 8 sensors
+static void benchSensors() {
+  static uint64_t frames[SENSORS_MAX];
+  benchRandomFrames(frames, SENSORS_MAX);
+  for (unsigned i=0;i<SENSORS_MAX;i++) sensorsUpdate(RF_PROTOCOL_NEWENTOR, (frames[i] & ~(0xFFULL << 32)) | (uint64_t)i << 32 | 1, 6, i*1000);
+  size_t len;
+  benchRun("sensors/render", 20000, 1, [&]() {
+    sensorsUpdate(RF_PROTOCOL_NEWENTOR, (frames[0] & ~(0xFFULL << 32)) | 1, 6, 0); //same sensor, invalidates the cache
+    sink += sensorsJson(len)[0] + len;
+  });
+  benchRun("sensors/cached", 20000, 1, [&]() {
+    sink += sensorsNotModified("\"0\"") + sensorsJson(len)[0] + len;
+  });
+  printf("sensors response: %u sensors, %zu bytes\n", sensorsCount(), len);
+}
+
+static void historyCollect(const char *text, size_t len, void *context) {
+  std::string &csv = *(std::string*)context;
+  csv.append(text, len);
+}
+
+//history encoding: a day of readings every minute from 8 Nexus sensors with random walk values, written to a temporary
+//directory and read back through the CSV stream
+static void benchHistory() {
+  char dir[] = "/tmp/historyXXXXXX";
+  if (!mkdtemp(dir)) return perror("mkdtemp");
+  halLinuxSetRoot(dir);
+  historyBegin();
+  historyStats = {};
+  const unsigned sensors = 8, readings = 24*60;
+  int temperature[sensors], humidity[sensors];
+  std::vector<std::string> expected;
+  srand(1);
+  for (unsigned i=0;i<sensors;i++) {
+    temperature[i] = 200+rand()%50-25;
+    humidity[i] = 40+rand()%20;
+  }
+  double start = benchSeconds();
+  for (unsigned minute=0;minute<readings;minute++) {
+    for (unsigned i=0;i<sensors;i++) {
+      if (rand()%3==0) temperature[i] += rand()%5-2;
+      if (rand()%8==0) humidity[i] += rand()%3-1;
+      uint32_t time = minute*60+i*7+rand()%3-1+1; //jitter of a second
+      uint64_t data = (uint64_t)(0x40+i) << 28 | (uint64_t)(i%3) << 24 | (uint64_t)(temperature[i] & 0xFFF) << 12 | 0xF00 | humidity[i];
+      historyAdd(RF_PROTOCOL_NEXUS, data, time*1000);
+      char line[64];
+      snprintf(line, sizeof(line), "nexus,%02X,%u,%u,%lu,%d.%d,%d,0\n", 0x40+i, i%3+1, 1, (unsigned long)time, temperature[i]/10,
+        temperature[i]%10, humidity[i]);
+      expected.push_back(line);
+    }
+    historyLoop(); //the history task runs every second, once per minute gives the same writes
+  }
+  double elapsed = benchSeconds()-start;
+  historyFlushAll();
+  std::string csv;
+  historyQuery query;
+  historyQueryBegin(query);
+  start = benchSeconds();
+  historyStream(query, historyCollect, &csv);
+  double stream = benchSeconds()-start;
+  unsigned mismatches = 0, lines = 0;
+  for (unsigned i=0;i<sensors;i++) { //blocks of different sensors interleave, compare the samples of every sensor in order
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "nexus,%02X,", 0x40+i);
+    size_t position = 0, index = i;
+    while ((position = csv.find(prefix, position))!=std::string::npos) {
+      size_t end = csv.find('\n', position)+1;
+      if (index>=expected.size() || csv.compare(position, end-position, expected[index])!=0) mismatches++;
+      index += sensors;
+      lines++;
+      position = end;
+    }
+  }
+  const historyStatistics &stats = historyStats;
+  double samples_per_block = (double)stats.samples/stats.blocks;
+  printf("%-24s %10.2f ns/op\n", "history/add", elapsed*1e9/stats.samples);
+  printf("%-24s %10.2f ns/op\n", "history/stream", stream*1e9/lines);
+  printf("history: %lu samples, %.2f bits encoded, %.2f bytes in blocks, %.2f bytes on flash per sample (CSV %.1f)\n",
+    (unsigned long)stats.samples, (double)stats.sample_bits/stats.samples, (double)stats.blocks*HISTORY_BLOCK_SIZE/stats.samples,
+    (double)stats.file_bytes/stats.flushed_samples, (double)csv.size()/lines);
+  printf("history: %.1f samples per block, RAM pool covers %.1f h of 8 sensors, file ring %.1f days\n", samples_per_block,
+    HISTORY_RAM_BLOCKS*samples_per_block*60/sensors/3600, HISTORY_SEGMENTS*HISTORY_SEGMENT_BLOCKS*samples_per_block*60/sensors/86400);
+  printf("history: %lu appends, %lu bytes written, write amplification %.2f, %u of %zu samples read back, %u mismatches\n",
+    (unsigned long)stats.appends, (unsigned long)stats.file_bytes, stats.file_bytes*8.0/stats.flushed_bits, lines, expected.size(), mismatches);
+  for (unsigned s=0;s<HISTORY_SEGMENTS;s++) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/history%u.bin", dir, s);
+    unlink(path);
+  }
+  rmdir(dir);
+}
+
+struct benchEntry {
+  const char *name;
+  void (*run)();
+};
+
+static const benchEntry benchmarks[] = {
+  {"frame", benchFrame},
+  {"crc", benchCrc},
+  {"json", benchJson},
+  {"protocols", benchProtocols},
+  {"sensors", benchSensors},
+  {"history", benchHistory},
+};
+
+int cmdBench(int argc, char **argv) {
+  int ran = 0;
+  for (const benchEntry &bench : benchmarks) {
+    bool selected = argc==0;
+    for (int i=0;i<argc;i++) if (strcmp(argv[i], bench.name)==0) selected = true;
+    if (selected) {
+      bench.run();
+      ran++;
+    }
+  }
+  if (!ran) {
+    fprintf(stderr, "unknown benchmark\n");
+    return 2;
+  }
+  return 0;
+}
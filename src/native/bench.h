@@ -0,0 +1,4 @@
+#pragma once
+// Micro-benchmarks of the decoder hot paths for the native build
+
+int cmdBench(int argc, char **argv); //"program bench [name...]", runs all benchmarks without names
@@ -0,0 +1,513 @@
+// Linux implementation of the hardware abstraction layer
+#include <stdarg.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "hal.h"
+#include "hal_linux.h"
+#include "stream.h"
+
+static bool simulated_clock = false; //clock follows the replayed edges instead of the system clock
+static uint32_t simulated_us = 0;
+static char fs_root[256] = ".";
+static FILE *publish_out = stdout;
+static char broker_host[128] = ""; //empty: messages are written to publish_out instead of a broker
+static char broker_port[8] = "1883";
+static int broker_socket = -1;
+static uint32_t broker_last_send = 0; //halMillis() of the last packet sent, for keep alive
+
+static uint64_t monotonicMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+void halLinuxSetTime(uint32_t us) {
+  simulated_clock = true;
+  simulated_us = us;
+}
+
+void halLinuxSetRoot(const char *dir) {
+  snprintf(fs_root, sizeof(fs_root), "%s", dir);
+}
+
+void halLinuxSetOutput(FILE *out) {
+  publish_out = out;
+}
+
+void halLinuxSetBroker(const char *host, const char *port) {
+  snprintf(broker_host, sizeof(broker_host), "%s", host);
+  snprintf(broker_port, sizeof(broker_port), "%s", port);
+}
+
+uint32_t halMillis() {
+  if (simulated_clock) return simulated_us/1000;
+  static uint64_t start = monotonicMicros();
+  return (monotonicMicros()-start)/1000;
+}
+
+uint32_t halMicros() {
+  if (simulated_clock) return simulated_us;
+  static uint64_t start = monotonicMicros();
+  return monotonicMicros()-start;
+}
+
+uint32_t halCycleCount() { //no portable cycle counter, nanoseconds instead
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+uint32_t halCycleFrequency() {
+  return 1000000000;
+}
+
+void halEdgeSourceBegin() {
+  //edges are fed to rfHandleEdge() by the host program reading an edge file
+}
+
+static bool edge_source_on = true;
+
+void halEdgeSourceEnable(bool on) {
+  edge_source_on = on;
+}
+
+bool halLinuxEdgeSourceEnabled() {
+  return edge_source_on;
+}
+
+void halSamplePoll() {
+  //samples are fed to rfHandleSamples() by the host program generating them
+}
+
+//minimal MQTT 3.1.1 client: CONNECT, QoS 0 PUBLISH and SUBSCRIBE, PINGREQ
+
+#define BROKER_TIMEOUT 1000 //ms for TCP connect and CONNACK
+#define BROKER_KEEPALIVE 15 //seconds
+#define BROKER_RECEIVE_SIZE 1024 //longest incoming packet, longer ones are skipped
+
+static uint8_t receive_buf[BROKER_RECEIVE_SIZE]; //incoming packets not parsed yet
+static size_t receive_len = 0;
+static size_t receive_skip = 0; //bytes of an oversized packet still to be discarded
+static halMqttHandler subscribe_handler = NULL;
+
+static void brokerClose() {
+  if (broker_socket>=0) close(broker_socket);
+  broker_socket = -1;
+  receive_len = 0;
+  receive_skip = 0;
+}
+
+static bool brokerSend(const uint8_t *data, size_t len) {
+  while (len) {
+    ssize_t sent = send(broker_socket, data, len, MSG_NOSIGNAL);
+    if (sent<0 && errno==EINTR) continue;
+    if (sent<0 && errno==EAGAIN) {
+      struct pollfd pfd = {broker_socket, POLLOUT, 0};
+      if (poll(&pfd, 1, BROKER_TIMEOUT)==1) continue;
+    }
+    if (sent<=0) {
+      brokerClose();
+      return false;
+    }
+    data += sent;
+    len -= sent;
+  }
+  broker_last_send = halMillis();
+  return true;
+}
+
+static size_t mqttHeader(uint8_t *buf, uint8_t type, size_t remaining) { //fixed header with variable length encoding
+  size_t len = 0;
+  buf[len++] = type;
+  do {
+    uint8_t byte = remaining & 0x7F;
+    remaining >>= 7;
+    buf[len++] = remaining ? byte | 0x80 : byte;
+  } while (remaining);
+  return len;
+}
+
+static size_t mqttString(uint8_t *buf, const char *str) {
+  size_t len = strlen(str);
+  buf[0] = len >> 8;
+  buf[1] = len;
+  memcpy(buf+2, str, len);
+  return len+2;
+}
+
+bool halMqttConnect(const char *client_id) {
+  if (!broker_host[0]) return publish_out!=NULL;
+  brokerClose();
+  struct addrinfo hints = {}, *addr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(broker_host, broker_port, &hints, &addr)!=0) return false;
+  broker_socket = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (broker_socket<0) {
+    freeaddrinfo(addr);
+    return false;
+  }
+  fcntl(broker_socket, F_SETFL, O_NONBLOCK);
+  int one = 1;
+  setsockopt(broker_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  int rc = connect(broker_socket, addr->ai_addr, addr->ai_addrlen);
+  freeaddrinfo(addr);
+  if (rc<0 && errno!=EINPROGRESS) {
+    brokerClose();
+    return false;
+  }
+  struct pollfd pfd = {broker_socket, POLLOUT, 0};
+  int err = 0;
+  socklen_t errlen = sizeof(err);
+  if (poll(&pfd, 1, BROKER_TIMEOUT)!=1 || getsockopt(broker_socket, SOL_SOCKET, SO_ERROR, &err, &errlen)!=0 || err) {
+    brokerClose();
+    return false;
+  }
+  uint8_t packet[256];
+  uint8_t body[200];
+  size_t body_len = mqttString(body, "MQTT");
+  body[body_len++] = 4; //protocol level 3.1.1
+  body[body_len++] = 0x02; //clean session
+  body[body_len++] = BROKER_KEEPALIVE >> 8;
+  body[body_len++] = BROKER_KEEPALIVE & 0xFF;
+  body_len += mqttString(body+body_len, client_id);
+  size_t len = mqttHeader(packet, 0x10, body_len);
+  memcpy(packet+len, body, body_len);
+  if (!brokerSend(packet, len+body_len)) return false;
+  pfd.events = POLLIN;
+  uint8_t connack[4];
+  if (poll(&pfd, 1, BROKER_TIMEOUT)!=1 || recv(broker_socket, connack, sizeof(connack), 0)!=4 || connack[0]!=0x20 || connack[3]!=0) {
+    brokerClose();
+    return false;
+  }
+  return true;
+}
+
+bool halMqttConnected() {
+  if (!broker_host[0]) return publish_out!=NULL;
+  return broker_socket>=0;
+}
+
+static uint8_t *message = NULL; //message being assembled by halMqttBeginPublish/halMqttWrite
+static size_t message_len = 0, message_size = 0; //bytes written, total packet size
+static size_t message_topic = 0, message_payload = 0; //offsets of the topic and the payload
+
+bool halMqttBeginPublish(const char *topic, size_t len) {
+  if (!halMqttConnected()) return false;
+  free(message);
+  size_t topic_len = strlen(topic);
+  uint8_t header[8];
+  size_t header_len = mqttHeader(header, 0x30, 2+topic_len+len);
+  message_size = header_len+2+topic_len+len;
+  message = (uint8_t*)malloc(message_size);
+  if (!message) return false;
+  memcpy(message, header, header_len);
+  message_topic = header_len+2;
+  message_len = header_len + mqttString(message+header_len, topic);
+  message_payload = message_len;
+  return true;
+}
+
+bool halMqttWrite(const uint8_t *data, size_t len) {
+  if (!message || message_len+len>message_size) return false;
+  memcpy(message+message_len, data, len);
+  message_len += len;
+  return true;
+}
+
+static void printMessage() { //"topic payload" line, payloads that are not text are printed as hex
+  fprintf(publish_out, "%.*s ", (int)(message_payload-message_topic), (const char*)message+message_topic);
+  bool text = true;
+  for (size_t i=message_payload; i<message_len; i++) {
+    if (message[i]<0x20 || message[i]>0x7E) text = false;
+  }
+  for (size_t i=message_payload; i<message_len; i++) {
+    if (text) fputc(message[i], publish_out);
+    else fprintf(publish_out, "%02x", message[i]);
+  }
+  fputc('\n', publish_out);
+  fflush(publish_out);
+}
+
+bool halMqttEndPublish() {
+  bool ok = message && message_len==message_size;
+  if (ok) {
+    if (!broker_host[0]) printMessage();
+    else ok = broker_socket>=0 && brokerSend(message, message_len);
+  }
+  free(message);
+  message = NULL;
+  return ok;
+}
+
+bool halMqttPublish(const char *topic, const char *payload) {
+  size_t len = strlen(payload);
+  if (!halMqttBeginPublish(topic, len)) return false;
+  halMqttWrite((const uint8_t*)payload, len);
+  return halMqttEndPublish();
+}
+
+bool halMqttSubscribe(const char *topic, halMqttHandler handler) {
+  subscribe_handler = handler;
+  if (!broker_host[0]) return true; //no other receivers without a broker
+  if (broker_socket<0) return false;
+  uint8_t packet[300];
+  size_t topic_len = strlen(topic);
+  if (topic_len>sizeof(packet)-10) return false;
+  size_t len = mqttHeader(packet, 0x82, 2+2+topic_len+1);
+  packet[len++] = 0; //packet identifier 1
+  packet[len++] = 1;
+  len += mqttString(packet+len, topic);
+  packet[len++] = 0; //QoS 0
+  return brokerSend(packet, len);
+}
+
+static int packetLength(size_t pos, size_t &remaining) { //bytes of the fixed header, 0 if incomplete, -1 if malformed
+  remaining = 0;
+  for (size_t header=1; header<=4; header++) {
+    if (pos+header>=receive_len) return 0;
+    uint8_t byte = receive_buf[pos+header];
+    remaining |= (size_t)(byte & 0x7F) << (7*(header-1));
+    if (!(byte & 0x80)) return header+1;
+  }
+  return -1;
+}
+
+static void brokerReceive() { //dispatch the complete packets in receive_buf, PUBLISH goes to the handler, others are ignored
+  size_t pos = 0;
+  while (pos<receive_len) {
+    size_t remaining;
+    int header = packetLength(pos, remaining);
+    if (header<0) {
+      brokerClose();
+      return;
+    }
+    if (header==0) break;
+    if (header+remaining>sizeof(receive_buf)) { //too long for the buffer, skip it
+      receive_skip = header+remaining-(receive_len-pos);
+      pos = receive_len;
+      break;
+    }
+    if (pos+header+remaining>receive_len) break;
+    const uint8_t *packet = receive_buf+pos+header;
+    if ((receive_buf[pos] & 0xF0)==0x30 && remaining>=2 && subscribe_handler) {
+      size_t topic_len = packet[0] << 8 | packet[1];
+      size_t id_len = (receive_buf[pos] & 0x06) ? 2 : 0; //QoS 1 and 2 have a packet identifier
+      char topic[256];
+      if (2+topic_len+id_len<=remaining && topic_len<sizeof(topic)) {
+        memcpy(topic, packet+2, topic_len);
+        topic[topic_len] = 0;
+        subscribe_handler(topic, packet+2+topic_len+id_len, remaining-2-topic_len-id_len);
+      }
+    }
+    pos += header+remaining;
+  }
+  memmove(receive_buf, receive_buf+pos, receive_len-pos);
+  receive_len -= pos;
+}
+
+void halMqttLoop() {
+  if (broker_socket<0) return;
+  ssize_t len;
+  while (true) {
+    if (receive_skip) {
+      uint8_t discard[512];
+      len = recv(broker_socket, discard, receive_skip<sizeof(discard) ? receive_skip : sizeof(discard), 0);
+      if (len>0) receive_skip -= len;
+    }
+    else {
+      len = recv(broker_socket, receive_buf+receive_len, sizeof(receive_buf)-receive_len, 0);
+      if (len>0) {
+        receive_len += len;
+        brokerReceive();
+        if (broker_socket<0) return;
+      }
+    }
+    if (len<=0) break;
+  }
+  if (len==0 || (len<0 && errno!=EAGAIN && errno!=EINTR)) { //broker closed the connection
+    brokerClose();
+    return;
+  }
+  if (halMillis()-broker_last_send > BROKER_KEEPALIVE*1000/2) {
+    const uint8_t ping[2] = {0xC0, 0x00};
+    brokerSend(ping, sizeof(ping));
+  }
+}
+
+//frame stream: udp socket sending to the configured address, or a listening socket with STREAM_CLIENTS subscribers
+
+static int stream_socket = -1; //udp socket or listening socket
+static bool stream_tcp = false;
+static struct sockaddr_in stream_target = {};
+static int stream_clients[STREAM_CLIENTS] = {-1, -1};
+
+bool halStreamBegin(bool tcp, const char *address, uint16_t port) {
+  if (stream_socket>=0) close(stream_socket);
+  stream_tcp = tcp;
+  stream_socket = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if (stream_socket<0 || !port) return false;
+  stream_target.sin_family = AF_INET;
+  stream_target.sin_port = htons(port);
+  if (!tcp) {
+    unsigned char ttl = 1, loop = 1; //stay on the LAN, listeners on this host get the records too
+    setsockopt(stream_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(stream_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    return inet_pton(AF_INET, address, &stream_target.sin_addr)==1;
+  }
+  int one = 1;
+  setsockopt(stream_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  stream_target.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(stream_socket, (struct sockaddr*)&stream_target, sizeof(stream_target))!=0 || listen(stream_socket, STREAM_CLIENTS)!=0) {
+    close(stream_socket);
+    stream_socket = -1;
+    return false;
+  }
+  fcntl(stream_socket, F_SETFL, O_NONBLOCK);
+  return true;
+}
+
+bool halStreamSend(const uint8_t *data, size_t len) {
+  if (stream_socket<0) return false;
+  if (!stream_tcp) return sendto(stream_socket, data, len, 0, (struct sockaddr*)&stream_target, sizeof(stream_target))==(ssize_t)len;
+  bool ok = true;
+  for (int &client : stream_clients) {
+    if (client<0) continue;
+    if (send(client, data, len, MSG_NOSIGNAL | MSG_DONTWAIT)!=(ssize_t)len) { //send buffer full or gone, the subscriber reconnects
+      close(client);
+      client = -1;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void halStreamAccept() {
+  if (!stream_tcp || stream_socket<0) return;
+  int client = accept(stream_socket, NULL, NULL);
+  if (client<0) return;
+  int one = 1;
+  setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  for (int &slot : stream_clients) {
+    if (slot>=0) continue;
+    slot = client;
+    return;
+  }
+  close(client); //all slots taken
+}
+
+uint8_t halStreamClients() {
+  uint8_t count = 0;
+  for (int client : stream_clients) count += client>=0;
+  return count;
+}
+
+static void fsPath(const char *path, char *buf, size_t size) {
+  snprintf(buf, size, "%s%s%s", fs_root, path[0]=='/' ? "" : "/", path);
+}
+
+bool halFileExists(const char *path) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  return access(full, F_OK)==0;
+}
+
+int halFileReadAt(const char *path, size_t offset, char *buf, size_t size) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  FILE *file = fopen(full, "rb");
+  if (!file) return -1;
+  int len = fseek(file, offset, SEEK_SET)==0 ? (int)fread(buf, 1, size, file) : -1;
+  fclose(file);
+  return len;
+}
+
+long halFileSize(const char *path) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  struct stat st;
+  if (stat(full, &st)!=0) return -1;
+  return st.st_size;
+}
+
+int halFileRead(const char *path, char *buf, size_t size) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  FILE *file = fopen(full, "rb");
+  if (!file) return -1;
+  size_t len = fread(buf, 1, size, file);
+  fclose(file);
+  return len;
+}
+
+bool halFileWrite(const char *path, const char *data, size_t len) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  FILE *file = fopen(full, "wb");
+  if (!file) return false;
+  bool ok = fwrite(data, 1, len, file)==len;
+  return fclose(file)==0 && ok;
+}
+
+bool halFileAppend(const char *path, const char *data, size_t len) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  FILE *file = fopen(full, "ab");
+  if (!file) return false;
+  bool ok = fwrite(data, 1, len, file)==len;
+  return fclose(file)==0 && ok;
+}
+
+bool halFileRemove(const char *path) {
+  char full[512];
+  fsPath(path, full, sizeof(full));
+  return remove(full)==0;
+}
+
+static uint8_t rtc_memory[HAL_RTC_SIZE]; //there are no soft resets, the memory starts cleared like after power on
+
+bool halRtcRead(size_t offset, void *data, size_t size) {
+  if (offset+size>HAL_RTC_SIZE) return false;
+  memcpy(data, rtc_memory+offset, size);
+  return true;
+}
+
+bool halRtcWrite(size_t offset, const void *data, size_t size) {
+  if (offset+size>HAL_RTC_SIZE) return false;
+  memcpy(rtc_memory+offset, data, size);
+  return true;
+}
+
+void halHeap(halHeapStats &stats) { //free bytes of the malloc arena, it grows on demand so there is no largest block
+  stats = {};
+  #if defined(__GLIBC__) && (__GLIBC__>2 || __GLIBC_MINOR__>=33)
+  struct mallinfo2 info = mallinfo2();
+  stats.free = info.fordblks;
+  stats.max_block = info.fordblks;
+  #endif
+}
+
+void halLed(bool on) {
+  (void)on;
+}
+
+void halDebug(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+}
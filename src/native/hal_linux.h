@@ -0,0 +1,11 @@
+#pragma once
+// Linux implementation details of the hardware abstraction layer used by the native build
+
+#include <stdint.h>
+#include <stdio.h>
+
+void halLinuxSetTime(uint32_t us); //switch the clock to simulated time, used when replaying recorded edges
+void halLinuxSetRoot(const char *dir); //directory used as the filesystem root
+void halLinuxSetOutput(FILE *out); //published messages are written to this stream as "topic payload" lines
+void halLinuxSetBroker(const char *host, const char *port); //publish to an MQTT broker instead of the output stream
+bool halLinuxEdgeSourceEnabled(); //false while the governor has turned the edge interrupt off, the host drops the edges
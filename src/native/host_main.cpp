@@ -0,0 +1,469 @@
+// Native (Linux) build of the receiver. Runs the decoder and publisher without the ESP8266 hardware.
+//
+// Usage:
+//   program [-d dir] decode [protocol:]<hex>... decode datagrams given as hex, 10 digits for Newentor (default),
+//                                              9 for nexus
+//   program [-d dir] [-m host:port] [-r] [-v] edges <file|->
+//                                              feed recorded edges through the whole receive pipeline, -r paces
+//                                              the edges in real time instead of replaying them at full speed, -v prints the metrics
+//   program encode <edges> <capture>           convert an edge file to the binary capture format
+//   program [-v] [-f] replay <capture>         run a binary capture through the decoder at full speed and report statistics,
+//                                              -f keeps the default decoder windows instead of learning the sensor timing
+//   program bench [name...]                    run micro-benchmarks of the decoder hot paths
+//   program [-d dir] serve <port> [edges]      feed the edges like edges does, then serve /api/sensors, /metrics,
+//                                              /history and /heap over HTTP
+//   program loadgen <host:port> [path] [seconds] [connections]
+//                                              measure requests/s of an endpoint, plain and with If-None-Match
+//   program [-f] sim [seconds] [name=value,...]...
+//                                              frame error rate of generated sensor signals over a grid of jitter, dropouts,
+//                                              glitches and collisions, out=capture.bin saves the edges of a single run
+//
+// Edge files contain one edge per line: "<level> <time in microseconds>", level is 1 for rising and 0 for falling edge.
+// Published messages are printed to stdout as "topic payload" lines, or sent to the MQTT broker given with -m.
+// The filesystem root (config.json, outbox, history) is the current directory unless set with -d. Readings still in the
+// outbox when the program exits are published on the next run.
+
+#ifndef PIO_UNIT_TESTING //the unit tests in test/ bring their own main()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "hal.h"
+#include "config.h"
+#include "newentor.h"
+#include "protocol.h"
+#include "rf_receiver.h"
+#include "receiver.h"
+#include "capture.h"
+#include "hal_linux.h"
+#include "bench.h"
+#include "dedup.h"
+#include "outbox.h"
+#include "publisher.h"
+#include "timing.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "history.h"
+#include "heap.h"
+#include "boot.h"
+#include "predict.h"
+#include "aggregate.h"
+#include "quality.h"
+#include "stream.h"
+#include "http_linux.h"
+#include "loadgen.h"
+#include "listen.h"
+#include "simulate.h"
+
+static bool verbose = false;
+static bool realtime = false;
+
+static const char *statusName(newentorStatus status) {
+  switch (status) {
+    case NEWENTOR_OK: return "ok";
+    case NEWENTOR_INVALID: return "invalid";
+    case NEWENTOR_BAD_CRC: return "bad_crc";
+  }
+  return "?";
+}
+
+static int cmdDecode(int argc, char **argv) {
+  int failed = 0;
+  for (int i=0;i<argc;i++) {
+    uint8_t protocol = RF_PROTOCOL_NEWENTOR;
+    const char *hex = argv[i];
+    const char *colon = strchr(hex, ':');
+    if (colon) { //protocol:datagram
+      for (protocol=0; protocol<RF_PROTOCOLS && strncmp(hex, protocolName(protocol), colon-hex)!=0; protocol++) {}
+      hex = colon+1;
+    }
+    const rfProtocol *descriptor = protocolGet(protocol);
+    char *end;
+    uint64_t data = strtoull(hex, &end, 16);
+    if (!descriptor || *end || end-hex!=(descriptor->bits+3)/4) {
+      fprintf(stderr, "%s: expected [protocol:]datagram, %d hex digits for Newentor\n", argv[i], DATAGRAM/4);
+      return 2;
+    }
+    sensorReading reading;
+    newentorStatus status = protocolDecode(protocol, data, reading);
+    char msg[NEWENTOR_JSON_SIZE] = "";
+    if (status==NEWENTOR_OK) newentorToJson(reading, msg, sizeof(msg));
+    printf("%s %s %s\n", argv[i], statusName(status), msg);
+    if (status!=NEWENTOR_OK) failed++;
+  }
+  return failed ? 1 : 0;
+}
+
+static void metricsStderr(const char *text, size_t len, void *) {
+  fwrite(text, 1, len, stderr);
+}
+
+static void realtimeWait(uint32_t until) { //keep the tasks running until the edge is due
+  int32_t wait;
+  while ((wait = until-halMicros())>0) {
+    schedulerRun();
+    usleep(wait>1000 ? 1000 : wait);
+  }
+}
+
+static unsigned long host_suppressed = 0; //edges dropped while the governor had the edge source off
+
+static void hostEdge(bool state, uint32_t time) { //the interrupt of the device
+  if (!halLinuxEdgeSourceEnabled()) {
+    host_suppressed++;
+    return;
+  }
+  rfHandleEdge(state, time);
+}
+
+static void printFrontEnd(FILE *out) {
+  fprintf(out, "front end: %lu glitch edges dropped, %lu backoffs, %lu ms off, %lu edges suppressed (estimate %lu)\n",
+    (unsigned long)rfStats.glitches, (unsigned long)rfStats.backoffs, (unsigned long)rfStats.backoff_ms, host_suppressed,
+    (unsigned long)rfStats.suppressed);
+}
+
+static int cmdEdges(const char *path) {
+  FILE *in = strcmp(path, "-")==0 ? stdin : fopen(path, "r");
+  if (!in) {
+    perror(path);
+    return 2;
+  }
+  halEdgeSourceBegin();
+  schedulerAdd("rf", processFrames, 0, 2000, SCHEDULER_CRITICAL); //same tasks as the firmware without web and OTA
+  schedulerAdd("mqtt", publisherLoop, 10000, 20000);
+  schedulerAdd("quality", qualityLoop, 50000, 1000);
+  schedulerAdd("stream", streamLoop, 100000, 1000);
+  schedulerAdd("metrics", metricsLoop, 1000000, 10000, SCHEDULER_DEFERRABLE);
+  schedulerAdd("history", historyLoop, 1000000, 20000, SCHEDULER_DEFERRABLE);
+  schedulerAdd("timing", timingLoop, 1000000, 20000, SCHEDULER_DEFERRABLE);
+  schedulerAdd("aggregate", aggregateLoop, 1000000, 20000, SCHEDULER_DEFERRABLE);
+  schedulerAdd("heap", heapSample, HEAP_PERIOD*1000UL, 1000, SCHEDULER_DEFERRABLE);
+  unsigned level;
+  unsigned long time = 0, first = 0;
+  uint32_t base = halMicros();
+  bool started = false;
+  while (fscanf(in, "%u %lu", &level, &time)==2) {
+    uint32_t start;
+    if (realtime) {
+      if (!started) first = time;
+      started = true;
+      realtimeWait(base+(time-first));
+      start = halCycleCount();
+      hostEdge(level, base+(time-first));
+    }
+    else {
+      halLinuxSetTime(time);
+      start = halCycleCount();
+      hostEdge(level, time);
+    }
+    metricsIsr(halCycleCount()-start);
+    start = halCycleCount();
+    schedulerRun();
+    metricsLoopTime((halCycleCount()-start)/1000);
+  }
+  if (in!=stdin) fclose(in);
+  if (realtime) realtimeWait(halMicros()+BURST_GAP+1);
+  else halLinuxSetTime(time+BURST_GAP+1); //complete the last burst
+  processFrames();
+  if (qualityElecting()) { //end the elections of the last readings, claims of other receivers arrive meanwhile
+    if (realtime) {
+      uint32_t end = halMillis()+QUALITY_ELECTION;
+      while ((int32_t)(halMillis()-end)<0) {
+        publisherLoop();
+        usleep(10000);
+      }
+    }
+    else halLinuxSetTime(time+BURST_GAP+1+QUALITY_ELECTION*1000);
+    qualityLoop();
+  }
+  while (outboxDepth() && (realtime || halMqttConnected())) { //simulated clock does not advance, no reconnects
+    publisherLoop();
+    if (realtime) usleep(10000);
+  }
+  historyFlushAll(); //like before a restart of the device
+  printFrontEnd(stderr);
+  fprintf(stderr, "frame queue high water mark %u, overflows %lu\n", frameQueueHighWater, (unsigned long)frameQueueOverflows);
+  fprintf(stderr, "published %lu, duplicates suppressed %lu, sensors replaced %lu\n", (unsigned long)dedupStats.published,
+    (unsigned long)dedupStats.suppressed, (unsigned long)dedupStats.evictions);
+  fprintf(stderr, "mqtt sent %lu, failed %lu, dropped %lu, connects %lu, connect failures %lu\n", (unsigned long)publisherStats.published,
+    (unsigned long)publisherStats.failed, (unsigned long)publisherStats.dropped, (unsigned long)publisherStats.connects, (unsigned long)publisherStats.connect_failures);
+  const publishModeStatistics &mode = publishModeStats[publisherMode()];
+  fprintf(stderr, "%s mode: %lu messages, %lu readings, %lu payload bytes, %.1f bytes/reading\n", publishModeName(publisherMode()),
+    (unsigned long)mode.messages, (unsigned long)mode.readings, (unsigned long)mode.bytes, mode.readings ? (double)mode.bytes/mode.readings : 0.0);
+  fprintf(stderr, "outbox pending %lu, spilled to file %lu, dropped %lu\n", (unsigned long)outboxDepth(),
+    (unsigned long)outboxStats.spilled, (unsigned long)outboxStats.dropped);
+  fprintf(stderr, "history %lu samples, %.1f bits/sample, %lu blocks in files, %lu bytes written\n", (unsigned long)historyStats.samples,
+    historyStats.samples ? (double)historyStats.sample_bits/historyStats.samples : 0.0, (unsigned long)historyFileBlocks(),
+    (unsigned long)historyStats.file_bytes);
+  fprintf(stderr, "prediction: %u sensors learned, %lu hits, %lu misses, %lu empty windows, %lu holds%s\n", predictLearned(),
+    (unsigned long)predictStats.hits, (unsigned long)predictStats.misses, (unsigned long)predictStats.empty,
+    (unsigned long)predictStats.holds, predictHolding() ? "" : " (hold off)");
+  fprintf(stderr, "quality: receiver %s, mean %.1f of %lu bursts, election %s: %lu claims sent, %lu received, %lu won, %lu lost\n",
+    qualityReceiver(), qualityStats.scored ? (double)qualityStats.score_sum/qualityStats.scored : 0.0, (unsigned long)qualityStats.scored,
+    qualityElecting() ? "on" : "off", (unsigned long)qualityStats.claims_sent, (unsigned long)qualityStats.claims_received,
+    (unsigned long)qualityStats.won, (unsigned long)qualityStats.lost);
+  if (streamGetMode()!=STREAM_OFF) fprintf(stderr, "frame stream %s: %lu records, %lu failed, %lu repeats skipped\n",
+    streamModeName(streamGetMode()), (unsigned long)streamStats.records, (unsigned long)streamStats.failed, (unsigned long)streamStats.repeats);
+  fprintf(stderr, "aggregates: %u sensors, %u bytes each, %lu messages, %lu failed, %lu restored\n", aggregateCount(),
+    (unsigned)AGGREGATE_SENSOR_BYTES, (unsigned long)aggregateStats.messages, (unsigned long)aggregateStats.failed,
+    (unsigned long)aggregateStats.restored);
+  if (verbose) {
+    aggregateSensor sensor;
+    char json[AGGREGATE_JSON_SIZE];
+    for (uint8_t i=0;i<AGGREGATE_SENSORS;i++) if (aggregateGet(i, sensor) && aggregateJson(sensor, json, sizeof(json))) fprintf(stderr, "%s\n", json);
+  }
+  fprintf(stderr, "boot (ms):");
+  for (uint8_t i=0;i<BOOT_PHASES;i++) if (bootStats.phases[i]) fprintf(stderr, " %s %lu", bootPhaseName(i), (unsigned long)bootStats.phases[i]);
+  fprintf(stderr, ", settings from %s\n", bootConfigSourceName());
+  if (verbose) { //same text as /metrics of the device
+    static metricsSnapshot snapshot;
+    metricsTake(snapshot);
+    metricsPrometheus(snapshot, metricsStderr, NULL);
+  }
+  return 0;
+}
+
+static void bodyAppend(const char *text, size_t len, void *context) {
+  std::vector<char> &body = *(std::vector<char>*)context;
+  body.insert(body.end(), text, text+len);
+}
+
+static void httpHandle(const httpRequest &request, int client) { //same endpoints and headers as the device
+  char headers[128];
+  if (strcmp(request.path, "/api/sensors")==0) {
+    snprintf(headers, sizeof(headers), "ETag: %s\r\nX-Uptime: %lu\r\nCache-Control: no-cache\r\n", sensorsEtag(),
+      (unsigned long)(halMillis()/1000));
+    if (sensorsNotModified(request.if_none_match)) return httpLinuxSend(client, 304, headers, "application/json", "", 0);
+    size_t len;
+    const char *body = sensorsJson(len);
+    return httpLinuxSend(client, 200, headers, "application/json", body, len);
+  }
+  if (strcmp(request.path, "/metrics")==0) {
+    static metricsSnapshot snapshot;
+    std::vector<char> body;
+    metricsTake(snapshot);
+    metricsPrometheus(snapshot, bodyAppend, &body);
+    return httpLinuxSend(client, 200, NULL, "text/plain; version=0.0.4", body.data(), body.size());
+  }
+  if (strncmp(request.path, "/history", 8)==0 && (request.path[8]==0 || request.path[8]=='?')) {
+    historyQuery query;
+    historyQueryBegin(query);
+    char parameters[sizeof(request.path)];
+    strcpy(parameters, request.path[8] ? request.path+9 : "");
+    for (char *save, *parameter = strtok_r(parameters, "&", &save); parameter; parameter = strtok_r(NULL, "&", &save)) {
+      char *value = strchr(parameter, '=');
+      if (value) *value++ = 0;
+      if (!value || !historyQueryArg(query, parameter, value)) {
+        return httpLinuxSend(client, 400, NULL, "text/plain", "Parameters: protocol, address, channel, last\n", 45);
+      }
+    }
+    std::vector<char> body; //the device streams the chunks, the host server sends with a Content-Length
+    historyStream(query, bodyAppend, &body);
+    return httpLinuxSend(client, 200, NULL, "text/csv", body.data(), body.size());
+  }
+  if (strcmp(request.path, "/heap")==0) {
+    std::vector<char> body;
+    heapStream(bodyAppend, &body);
+    return httpLinuxSend(client, 200, NULL, "text/csv", body.data(), body.size());
+  }
+  httpLinuxSend(client, 404, NULL, "text/plain", "404 Not Found\n", 14);
+}
+
+static int cmdServe(const char *port, const char *edges_path) {
+  if (!httpLinuxBegin(port, httpHandle)) return 1;
+  if (edges_path) {
+    int result = cmdEdges(edges_path);
+    if (result) return result;
+  }
+  else {
+    schedulerAdd("rf", processFrames, 0, 2000, SCHEDULER_CRITICAL);
+  }
+  schedulerAdd("http", httpLinuxLoop, 0, 20000);
+  fprintf(stderr, "serving on port %s, %u sensors\n", port, sensorsCount());
+  for (;;) {
+    schedulerRun();
+    usleep(100); //the host has no interrupts to wait for
+  }
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), in))>0) data.insert(data.end(), buf, buf+len);
+  fclose(in);
+  return true;
+}
+
+static int cmdEncode(const char *edges_path, const char *capture_path) {
+  FILE *in = strcmp(edges_path, "-")==0 ? stdin : fopen(edges_path, "r");
+  if (!in) {
+    perror(edges_path);
+    return 2;
+  }
+  FILE *out = fopen(capture_path, "wb");
+  if (!out) {
+    perror(capture_path);
+    return 2;
+  }
+  unsigned level;
+  unsigned long time;
+  uint32_t last = 0;
+  unsigned long edges = 0;
+  while (fscanf(in, "%u %lu", &level, &time)==2) {
+    uint8_t buf[CAPTURE_HEADER_SIZE];
+    if (edges==0) { //capture starts at the first edge
+      last = time;
+      fwrite(buf, 1, captureEncodeHeader(buf, last), out);
+    }
+    fwrite(buf, 1, captureEncodeEdge(buf, time-last, level), out);
+    last = time;
+    edges++;
+  }
+  if (in!=stdin) fclose(in);
+  long size = ftell(out);
+  fclose(out);
+  fprintf(stderr, "%lu edges, %ld bytes\n", edges, size);
+  return 0;
+}
+
+static uint32_t replay_first; //time of the first edge of the replayed capture
+
+static void replayBurst(const rfBurst &burst) {
+  if (!verbose) return;
+  char msg[NEWENTOR_JSON_SIZE] = "";
+  sensorReading reading;
+  if (burst.valid && protocolDecode(burst.protocol, burst.data, reading)==NEWENTOR_OK) {
+    reading.confidence = burst.agree;
+    newentorToJson(reading, msg, sizeof(msg));
+  }
+  printf("%.6f burst %s %010llx %u/%u %s %s\n", (burst.time-replay_first)/1e6, protocolName(burst.protocol), (unsigned long long)burst.data, burst.agree, burst.repeats,
+    burst.valid ? "ok" : "failed", msg);
+}
+
+static int cmdReplay(const char *path) {
+  std::vector<uint8_t> data;
+  if (!readFile(path, data)) return 2;
+  captureReader reader;
+  if (!captureReaderBegin(reader, data.data(), data.size())) {
+    fprintf(stderr, "%s: not a capture file\n", path);
+    return 2;
+  }
+  uint32_t first = reader.time;
+  replay_first = first;
+  unsigned long status_count[NEWENTOR_BAD_CRC+1] = {};
+  unsigned long protocol_frames[RF_PROTOCOLS] = {};
+  bool state;
+  uint32_t time;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (captureReadEdge(reader, state, time)) {
+    hostEdge(state, time);
+    rfGovernorPoll(time);
+    rfFrame frame;
+    while (rfReadFrame(frame)) {
+      timingLearn(frame);
+      sensorReading reading;
+      newentorStatus status = protocolDecode(frame.protocol, frame.data, reading);
+      status_count[status]++;
+      protocol_frames[frame.protocol]++;
+      if (verbose) printf("%.6f frame %s %010llx %s\n", (frame.time-first)/1e6, protocolName(frame.protocol), (unsigned long long)frame.data, statusName(status));
+      burstAdd(frame, qualityMargin(frame), replayBurst);
+    }
+  }
+  burstPoll(time+BURST_GAP+1, replayBurst);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+  if (reader.pos!=reader.len) fprintf(stderr, "warning: truncated edge at offset %zu\n", reader.pos);
+  printf("capture: %zu bytes, %.3f s of air, %.2f bytes/edge\n", data.size(), (time-first)/1e6,
+    rfStats.edges ? (double)(data.size()-CAPTURE_HEADER_SIZE)/rfStats.edges : 0.0);
+  printf("edges: %lu, preambles: %lu, restarts: %lu\n", (unsigned long)rfStats.edges, (unsigned long)rfStats.preambles, (unsigned long)rfStats.restarts);
+  printf("errors: error_pulse %lu, error_length %lu, invalid %lu, bad_crc %lu\n", (unsigned long)rfStats.error_pulse,
+    (unsigned long)rfStats.error_length, status_count[NEWENTOR_INVALID], status_count[NEWENTOR_BAD_CRC]);
+  printFrontEnd(stdout);
+  printf("frames: %lu received, %lu ok\n", (unsigned long)rfStats.frames, status_count[NEWENTOR_OK]);
+  for (uint8_t protocol=0; protocol<RF_PROTOCOLS; protocol++) {
+    if (protocol_frames[protocol]) printf("  %s: %lu frames\n", protocolName(protocol), protocol_frames[protocol]);
+  }
+  printf("bursts: %lu, %lu valid, %lu recovered by vote, %lu failed, %.2f frames/burst\n", (unsigned long)burstStats.bursts,
+    (unsigned long)burstStats.valid, (unsigned long)burstStats.recovered, (unsigned long)burstStats.failed,
+    burstStats.bursts ? (double)burstStats.frames/burstStats.bursts : 0.0);
+  printf("timing: pulse %u-%u, zero %u-%u, one %u-%u, preamble %u-%u us, learned from %lu frames, %lu updates\n",
+    rfTimings.pulse_min, rfTimings.pulse_max, rfTimings.zero_min, rfTimings.zero_max, rfTimings.one_min, rfTimings.one_max,
+    rfTimings.newdata_min, rfTimings.newdata_max, (unsigned long)timingStats.learned, (unsigned long)timingStats.updates);
+  for (uint8_t cls=0; cls<TIMING_CLASSES; cls++) {
+    printf("observed %s: 1%% %u, 50%% %u, 99%% %u us\n", timingClassName((timingClass)cls), timingPercentile((timingClass)cls, 1),
+      timingPercentile((timingClass)cls, 50), timingPercentile((timingClass)cls, 99));
+  }
+  printf("decode throughput: %.0f edges/s (%.3f ms)\n", elapsed>0 ? rfStats.edges/elapsed : 0.0, elapsed*1000);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int arg = 1;
+  while (arg<argc && argv[arg][0]=='-') {
+    if (strcmp(argv[arg], "-d")==0 && arg+1<argc) {
+      halLinuxSetRoot(argv[arg+1]);
+      arg += 2;
+    }
+    else if (strcmp(argv[arg], "-v")==0) {
+      verbose = true;
+      arg++;
+    }
+    else if (strcmp(argv[arg], "-f")==0) {
+      timingSetAdaptive(false);
+      arg++;
+    }
+    else if (strcmp(argv[arg], "-r")==0) {
+      realtime = true;
+      arg++;
+    }
+    else if (strcmp(argv[arg], "-m")==0 && arg+1<argc) {
+      char host[128];
+      snprintf(host, sizeof(host), "%s", argv[arg+1]);
+      char *port = strrchr(host, ':');
+      if (port) *port++ = 0;
+      halLinuxSetBroker(host, port ? port : "1883");
+      arg += 2;
+    }
+    else break;
+  }
+  if (arg>=argc) {
+    fprintf(stderr, "usage: %s [-d dir] [-v] [-f] [-r] [-m host:port] decode <hex>...|edges <file|->|encode <edges> <capture>|replay <capture>|bench [name...]|serve <port> [edges]|loadgen <host:port> [path] [seconds] [connections]|listen udp|tcp <address:port> [seconds]|sim [seconds] [name=value,...]\n", argv[0]);
+    return 2;
+  }
+  bootMark(BOOT_SETUP);
+  bootMark(BOOT_FS); //no file system to mount
+  loadConfigFile();
+  outboxBegin();
+  publisherBegin();
+  metricsBegin();
+  timingBegin();
+  historyBegin();
+  aggregateBegin();
+  qualityBegin();
+  streamBegin();
+  rfGovernorBegin(strtoul(edge_rate_max, NULL, 10));
+  predictBegin(burst_hold[0]=='1');
+  schedulerSetHold(predictHold, predictActivity);
+  const char *cmd = argv[arg++];
+  if (strcmp(cmd, "decode")==0) return cmdDecode(argc-arg, argv+arg);
+  if (strcmp(cmd, "edges")==0 && arg<argc) return cmdEdges(argv[arg]);
+  if (strcmp(cmd, "encode")==0 && arg+1<argc) return cmdEncode(argv[arg], argv[arg+1]);
+  if (strcmp(cmd, "replay")==0 && arg<argc) return cmdReplay(argv[arg]);
+  if (strcmp(cmd, "bench")==0) return cmdBench(argc-arg, argv+arg);
+  if (strcmp(cmd, "serve")==0 && arg<argc) return cmdServe(argv[arg], arg+1<argc ? argv[arg+1] : NULL);
+  if (strcmp(cmd, "loadgen")==0) return cmdLoadgen(argc-arg, argv+arg);
+  if (strcmp(cmd, "listen")==0) return cmdListen(argc-arg, argv+arg, verbose);
+  if (strcmp(cmd, "sim")==0) return cmdSimulate(argc-arg, argv+arg);
+  fprintf(stderr, "unknown command %s\n", cmd);
+  return 2;
+}
+#endif
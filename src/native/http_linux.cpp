@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "http_linux.h"
+
+struct httpClient {
+  int fd; //-1 if the slot is free
+  size_t len;
+  char request[HTTP_REQUEST_SIZE];
+};
+
+static int listen_fd = -1;
+static httpHandler request_handler = NULL;
+static httpClient clients[HTTP_CLIENTS];
+static bool close_after_response = false; //set for the client being served if it asked to close
+
+static const char *statusText(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+  }
+  return "Error";
+}
+
+bool httpLinuxBegin(const char *port, httpHandler handler) {
+  struct addrinfo hints = {}, *result;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(NULL, port, &hints, &result)!=0) return false;
+  listen_fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+  int one = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  bool ok = listen_fd>=0 && bind(listen_fd, result->ai_addr, result->ai_addrlen)==0 && listen(listen_fd, HTTP_CLIENTS)==0;
+  freeaddrinfo(result);
+  if (!ok) {
+    perror("http listen");
+    return false;
+  }
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+  for (httpClient &client : clients) client.fd = -1;
+  request_handler = handler;
+  return true;
+}
+
+static bool sendAll(int fd, struct iovec *iov, int count) { //blocks until written, responses are small
+  while (count>0) {
+    ssize_t sent = writev(fd, iov, count);
+    if (sent<0) {
+      if (errno!=EAGAIN && errno!=EINTR) return false;
+      struct pollfd p = {fd, POLLOUT, 0};
+      poll(&p, 1, 100);
+      continue;
+    }
+    while (count>0 && (size_t)sent>=iov->iov_len) {
+      sent -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count>0) {
+      iov->iov_base = (char*)iov->iov_base+sent;
+      iov->iov_len -= sent;
+    }
+  }
+  return true;
+}
+
+void httpLinuxSend(int client, int status, const char *headers, const char *content_type, const char *body, size_t len) {
+  char head[512];
+  int head_len = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n%sContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n", status,
+    statusText(status), headers ? headers : "", content_type, status==304 ? 0 : len, close_after_response ? "Connection: close\r\n" : "");
+  struct iovec iov[2] = {{head, (size_t)head_len}, {(void*)body, status==304 ? 0 : len}};
+  if (!sendAll(client, iov, 2)) close_after_response = true;
+}
+
+static void headerValue(const char *head, const char *name, char *value, size_t size) { //empty if the header is missing
+  value[0] = 0;
+  size_t name_len = strlen(name);
+  for (const char *line = strstr(head, "\r\n"); line; line = strstr(line+2, "\r\n")) {
+    if (strncasecmp(line+2, name, name_len)!=0 || line[2+name_len]!=':') continue;
+    const char *start = line+3+name_len;
+    while (*start==' ') start++;
+    const char *end = strstr(start, "\r\n");
+    size_t len = end ? (size_t)(end-start) : strlen(start);
+    if (len>=size) len = size-1;
+    memcpy(value, start, len);
+    value[len] = 0;
+    return;
+  }
+}
+
+static bool serve(httpClient &client) { //false if the connection has to be closed
+  for (;;) {
+    char *end = (char*)memmem(client.request, client.len, "\r\n\r\n", 4);
+    if (!end) return client.len<sizeof(client.request)-1; //request head incomplete, or too long
+    *end = 0;
+    httpRequest request;
+    char method[8];
+    if (sscanf(client.request, "%7s %255s", method, request.path)!=2) return false;
+    headerValue(client.request, "If-None-Match", request.if_none_match, sizeof(request.if_none_match));
+    char connection[16];
+    headerValue(client.request, "Connection", connection, sizeof(connection));
+    close_after_response = strcasecmp(connection, "close")==0;
+    if (strcmp(method, "GET")!=0) httpLinuxSend(client.fd, 405, NULL, "text/plain", "", 0);
+    else request_handler(request, client.fd);
+    size_t used = end+4-client.request; //keep pipelined requests
+    memmove(client.request, end+4, client.len-used);
+    client.len -= used;
+    if (close_after_response) return false;
+  }
+}
+
+void httpLinuxLoop() {
+  if (listen_fd<0) return;
+  for (;;) { //accept all pending connections
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd<0) break;
+    httpClient *free_slot = NULL;
+    for (httpClient &client : clients) if (client.fd<0) { free_slot = &client; break; }
+    if (!free_slot) {
+      close(fd);
+      continue;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    free_slot->fd = fd;
+    free_slot->len = 0;
+  }
+  struct pollfd fds[HTTP_CLIENTS];
+  httpClient *polled[HTTP_CLIENTS];
+  int count = 0;
+  for (httpClient &client : clients) {
+    if (client.fd<0) continue;
+    polled[count] = &client;
+    fds[count++] = {client.fd, POLLIN, 0};
+  }
+  if (!count || poll(fds, count, 0)<=0) return;
+  for (int i=0;i<count;i++) {
+    if (!fds[i].revents) continue;
+    httpClient &client = *polled[i];
+    ssize_t got = recv(client.fd, client.request+client.len, sizeof(client.request)-1-client.len, 0);
+    if (got<0 && (errno==EAGAIN || errno==EINTR)) continue;
+    if (got>0) client.len += got;
+    if (got<=0 || !serve(client)) { //closed by the client, failed or asked to close
+      close(client.fd);
+      client.fd = -1;
+    }
+  }
+}
@@ -0,0 +1,19 @@
+#pragma once
+// Minimal HTTP/1.1 server of the native build, serves the same endpoints as the device web server for testing and
+// load measurements. Single threaded and non-blocking, runs as a scheduler task. GET only, keep-alive supported.
+
+#include <stddef.h>
+
+#define HTTP_CLIENTS 64 //concurrent connections
+#define HTTP_REQUEST_SIZE 2048 //longest request head
+
+struct httpRequest {
+  char path[256];
+  char if_none_match[64]; //empty if the header is missing
+};
+
+typedef void (*httpHandler)(const httpRequest &request, int client);
+
+bool httpLinuxBegin(const char *port, httpHandler handler); //listen on all addresses
+void httpLinuxLoop(); //accept connections and serve complete requests
+void httpLinuxSend(int client, int status, const char *headers, const char *content_type, const char *body, size_t len); //headers are "Name: value\r\n" lines
@@ -0,0 +1,199 @@
+// Frame stream listener. udp binds the port and joins the group if the address is a multicast group, tcp connects to
+// the receiver and reconnects when the connection drops. Every record is checked against the expected sequence number.
+// The receiver and the listener share no clock: the receiver part of the latency (last edge to sending) is in the
+// record, the network transit is measured against the fastest record since the receiver started, so the total is
+// exact up to the transit time of that fastest record, well below 1 ms on a LAN.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <algorithm>
+#include "protocol.h"
+#include "stream.h"
+#include "listen.h"
+
+struct listenSample {
+  uint32_t age; //us from the last edge to sending, receiver clock
+  int64_t transit; //arrival minus sending, includes the unknown clock offset
+};
+
+struct listenResult {
+  unsigned long records;
+  unsigned long lost; //gaps in the sequence
+  unsigned long reordered; //late or duplicate records
+  unsigned long restarts; //sequence started again at 0, receiver rebooted
+  unsigned long malformed;
+  std::vector<listenSample> segment; //records since the last restart, transit offsets are only comparable within one
+  std::vector<uint32_t> receiver_us, total_us;
+  uint32_t next; //expected sequence number
+  bool started;
+};
+
+static uint64_t listenMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static uint32_t fieldGet(const uint8_t *p, uint8_t bytes) { //big endian
+  uint32_t value = 0;
+  for (uint8_t i=0; i<bytes; i++) value = value << 8 | p[i];
+  return value;
+}
+
+static void segmentClose(listenResult &result) { //transit above the fastest record of the segment
+  int64_t fastest = INT64_MAX;
+  for (const listenSample &s : result.segment) fastest = std::min(fastest, s.transit);
+  for (const listenSample &s : result.segment) {
+    result.receiver_us.push_back(s.age);
+    result.total_us.push_back(s.age+(uint32_t)(s.transit-fastest));
+  }
+  result.segment.clear();
+}
+
+static void recordReceived(listenResult &result, const uint8_t *record, size_t len, uint64_t arrival, bool verbose) {
+  if (len!=STREAM_RECORD_SIZE || record[0]!=STREAM_VERSION) {
+    result.malformed++;
+    return;
+  }
+  uint32_t seq = fieldGet(record+2, 4);
+  uint64_t time = (uint64_t)fieldGet(record+6, 4) << 32 | fieldGet(record+10, 4);
+  uint32_t age = fieldGet(record+14, 4);
+  uint64_t data = 0;
+  for (uint8_t i=0; i<5; i++) data = data << 8 | record[18+i];
+  result.records++;
+  if (result.started && seq==0 && result.next!=0) { //receiver started again
+    result.restarts++;
+    segmentClose(result);
+  }
+  else if (result.started && seq<result.next) {
+    result.reordered++;
+    return;
+  }
+  else if (result.started) result.lost += seq-result.next;
+  result.started = true;
+  result.next = seq+1;
+  listenSample sample = {age, (int64_t)arrival-(int64_t)(time+age)};
+  result.segment.push_back(sample);
+  if (verbose) printf("%lu %s %010llx receive %.6f s, sent after %lu us, margin %u\n", (unsigned long)seq, protocolName(record[1]),
+    (unsigned long long)data, time/1e6, (unsigned long)age, record[23]);
+}
+
+static int listenUdp(const char *address, const char *port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd<0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)); //several listeners of one group on this host
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(atoi(port));
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  struct in_addr group;
+  if (bind(fd, (struct sockaddr*)&local, sizeof(local))!=0 || inet_pton(AF_INET, address, &group)!=1) {
+    close(fd);
+    return -1;
+  }
+  if (IN_MULTICAST(ntohl(group.s_addr))) {
+    struct ip_mreq membership = {};
+    membership.imr_multiaddr = group;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership))!=0) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+static int listenTcp(const char *host, const char *port) {
+  struct addrinfo hints = {}, *addr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &addr)!=0) return -1;
+  int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (fd>=0 && connect(fd, addr->ai_addr, addr->ai_addrlen)!=0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addr);
+  return fd;
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, unsigned p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size()-1, values.size()*p/100)];
+}
+
+int cmdListen(int argc, char **argv, bool verbose) {
+  if (argc<2 || (strcmp(argv[0], "udp")!=0 && strcmp(argv[0], "tcp")!=0)) {
+    fprintf(stderr, "listen udp|tcp address:port [seconds]\n");
+    return 2;
+  }
+  bool tcp = strcmp(argv[0], "tcp")==0;
+  char host[128];
+  snprintf(host, sizeof(host), "%s", argv[1]);
+  char *port = strrchr(host, ':');
+  if (port) *port++ = 0;
+  else port = (char*)"4333";
+  double seconds = argc>2 ? atof(argv[2]) : 60;
+  int fd = tcp ? listenTcp(host, port) : listenUdp(host, port);
+  if (fd<0 && !tcp) {
+    fprintf(stderr, "can not listen on %s\n", argv[1]);
+    return 1;
+  }
+  listenResult result = {};
+  uint8_t buf[4096];
+  size_t buffered = 0; //tcp bytes of an incomplete record
+  unsigned long reconnects = 0;
+  uint64_t end = listenMicros()+(uint64_t)(seconds*1e6);
+  while (listenMicros()<end) {
+    if (fd<0) { //tcp subscriber reconnects, the records meanwhile show up as lost
+      usleep(100000);
+      fd = listenTcp(host, port);
+      if (fd>=0) reconnects++;
+      buffered = 0;
+      continue;
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 100)!=1) continue;
+    ssize_t len = recv(fd, buf+buffered, sizeof(buf)-buffered, 0);
+    uint64_t arrival = listenMicros();
+    if (len<=0) {
+      if (len<0 && (errno==EINTR || errno==EAGAIN)) continue;
+      close(fd);
+      fd = -1;
+      continue;
+    }
+    if (!tcp) {
+      recordReceived(result, buf, len, arrival, verbose);
+      continue;
+    }
+    buffered += len;
+    size_t pos = 0;
+    for (; buffered-pos>=STREAM_RECORD_SIZE; pos+=STREAM_RECORD_SIZE) recordReceived(result, buf+pos, STREAM_RECORD_SIZE, arrival, verbose);
+    memmove(buf, buf+pos, buffered-pos);
+    buffered -= pos;
+  }
+  if (fd>=0) close(fd);
+  segmentClose(result);
+  printf("%s %s: %lu records, %lu lost, %lu reordered, %lu malformed, %lu receiver restarts", argv[0], argv[1], result.records,
+    result.lost, result.reordered, result.malformed, result.restarts);
+  if (tcp) printf(", %lu reconnects", reconnects);
+  printf("\n");
+  printf("latency (us)  p50 %lu, p90 %lu, p99 %lu, max %lu: last edge to sending\n", (unsigned long)percentile(result.receiver_us, 50),
+    (unsigned long)percentile(result.receiver_us, 90), (unsigned long)percentile(result.receiver_us, 99), (unsigned long)percentile(result.receiver_us, 100));
+  printf("latency (us)  p50 %lu, p90 %lu, p99 %lu, max %lu: last edge to delivery, above the fastest transit\n",
+    (unsigned long)percentile(result.total_us, 50), (unsigned long)percentile(result.total_us, 90), (unsigned long)percentile(result.total_us, 99),
+    (unsigned long)percentile(result.total_us, 100));
+  return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+// Frame stream listener of the native build, reports lost records and the latency from the last edge of a datagram
+// to its delivery for the udp and tcp transports of stream.h
+
+int cmdListen(int argc, char **argv, bool verbose); //"program listen udp|tcp address:port [seconds]"
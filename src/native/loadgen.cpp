@@ -0,0 +1,175 @@
+// Keep-alive HTTP load generator. Every connection sends one GET, waits for the complete response and sends the next.
+// The path is loaded twice: unconditional requests, then with If-None-Match set to the ETag of the first response.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "loadgen.h"
+
+#define LOADGEN_CONNECTIONS_MAX 256
+#define LOADGEN_BUFFER 8192
+
+struct loadgenConnection {
+  int fd;
+  size_t len; //bytes of the response received
+  char response[LOADGEN_BUFFER];
+};
+
+struct loadgenResult {
+  unsigned long requests;
+  unsigned long status_ok; //200
+  unsigned long status_not_modified; //304
+  unsigned long status_other;
+  unsigned long long bytes;
+};
+
+static double loadgenSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static int loadgenConnect(const char *host, const char *port) {
+  struct addrinfo hints = {}, *result;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &result)!=0) return -1;
+  int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+  if (fd>=0 && connect(fd, result->ai_addr, result->ai_addrlen)!=0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd>=0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+static bool loadgenSend(int fd, const char *request, size_t len) {
+  return send(fd, request, len, MSG_NOSIGNAL)==(ssize_t)len;
+}
+
+static bool responseComplete(loadgenConnection &connection, int &status, size_t &size) { //size of the whole response
+  connection.response[connection.len] = 0;
+  char *end = strstr(connection.response, "\r\n\r\n");
+  if (!end) return false;
+  status = atoi(connection.response+9); //"HTTP/1.1 200"
+  const char *length = strcasestr(connection.response, "\r\nContent-Length:");
+  size = end+4-connection.response + (length && length<end ? strtoul(length+17, NULL, 10) : 0);
+  return connection.len>=size;
+}
+
+static void headerValue(const char *response, const char *name, char *value, size_t size) {
+  value[0] = 0;
+  const char *line = strcasestr(response, name);
+  if (!line) return;
+  line += strlen(name);
+  while (*line==' ') line++;
+  size_t len = strcspn(line, "\r\n");
+  if (len>=size) len = size-1;
+  memcpy(value, line, len);
+  value[len] = 0;
+}
+
+static bool loadgenRun(const char *host, const char *port, const char *request, unsigned connections, double seconds, loadgenResult &result) {
+  static loadgenConnection conns[LOADGEN_CONNECTIONS_MAX];
+  struct pollfd fds[LOADGEN_CONNECTIONS_MAX];
+  size_t request_len = strlen(request);
+  result = {};
+  for (unsigned i=0;i<connections;i++) {
+    conns[i].fd = loadgenConnect(host, port);
+    conns[i].len = 0;
+    if (conns[i].fd<0 || !loadgenSend(conns[i].fd, request, request_len)) {
+      fprintf(stderr, "connect to %s:%s failed\n", host, port);
+      for (unsigned j=0;j<=i;j++) if (conns[j].fd>=0) close(conns[j].fd);
+      return false;
+    }
+    fds[i] = {conns[i].fd, POLLIN, 0};
+  }
+  double end = loadgenSeconds()+seconds;
+  bool ok = true;
+  while (ok && loadgenSeconds()<end) {
+    if (poll(fds, connections, 100)<0 && errno!=EINTR) break;
+    for (unsigned i=0;i<connections && ok;i++) {
+      if (!fds[i].revents) continue;
+      loadgenConnection &connection = conns[i];
+      ssize_t got = recv(connection.fd, connection.response+connection.len, sizeof(connection.response)-1-connection.len, 0);
+      if (got<=0) {
+        fprintf(stderr, "connection closed by the server\n");
+        ok = false;
+        break;
+      }
+      connection.len += got;
+      int status;
+      size_t size;
+      if (!responseComplete(connection, status, size)) continue;
+      result.requests++;
+      result.bytes += size;
+      if (status==200) result.status_ok++;
+      else if (status==304) result.status_not_modified++;
+      else result.status_other++;
+      memmove(connection.response, connection.response+size, connection.len-size);
+      connection.len -= size;
+      ok = loadgenSend(connection.fd, request, request_len);
+    }
+  }
+  for (unsigned i=0;i<connections;i++) close(conns[i].fd);
+  return ok;
+}
+
+static void loadgenReport(const char *name, const loadgenResult &result, double seconds) {
+  printf("%-12s %10.0f requests/s, %lu requests: %lu 200, %lu 304, %lu other, %.1f bytes/request\n", name, result.requests/seconds,
+    result.requests, result.status_ok, result.status_not_modified, result.status_other, result.requests ? (double)result.bytes/result.requests : 0.0);
+}
+
+int cmdLoadgen(int argc, char **argv) {
+  if (argc<1) {
+    fprintf(stderr, "loadgen host:port [path] [seconds] [connections]\n");
+    return 2;
+  }
+  char host[128];
+  snprintf(host, sizeof(host), "%s", argv[0]);
+  char *port = strrchr(host, ':');
+  if (port) *port++ = 0;
+  const char *path = argc>1 ? argv[1] : "/api/sensors";
+  double seconds = argc>2 ? atof(argv[2]) : 5;
+  unsigned connections = argc>3 ? atoi(argv[3]) : 8;
+  if (connections<1 || connections>LOADGEN_CONNECTIONS_MAX) connections = 8;
+  char request[512];
+  snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, host);
+  loadgenConnection first = {};
+  first.fd = loadgenConnect(host, port ? port : "80");
+  int status = 0;
+  size_t size = 0;
+  if (first.fd<0 || !loadgenSend(first.fd, request, strlen(request))) {
+    fprintf(stderr, "connect to %s failed\n", argv[0]);
+    return 1;
+  }
+  while (!responseComplete(first, status, size)) { //first response for the ETag
+    ssize_t got = recv(first.fd, first.response+first.len, sizeof(first.response)-1-first.len, 0);
+    if (got<=0) break;
+    first.len += got;
+  }
+  close(first.fd);
+  char etag[64];
+  headerValue(first.response, "\r\nETag:", etag, sizeof(etag));
+  printf("%s: status %d, %zu bytes, ETag %s, %u connections\n", path, status, size, etag[0] ? etag : "none", connections);
+  loadgenResult result;
+  if (!loadgenRun(host, port ? port : "80", request, connections, seconds, result)) return 1;
+  loadgenReport("plain", result, seconds);
+  if (!etag[0]) return 0;
+  snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nIf-None-Match: %s\r\n\r\n", path, host, etag);
+  if (!loadgenRun(host, port ? port : "80", request, connections, seconds, result)) return 1;
+  loadgenReport("conditional", result, seconds);
+  return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+// HTTP load generator for measuring the requests/s of the web endpoints of the native build
+
+int cmdLoadgen(int argc, char **argv); //"program loadgen host:port [path] [seconds] [connections]"
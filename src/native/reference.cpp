@@ -0,0 +1,43 @@
+// Implementations as they were before their optimized replacements
+#include <stdio.h>
+#include <string.h>
+#include <ArduinoJson.h>          //https://github.com/bblanchon/ArduinoJson
+#include "newentor.h"
+#include "reference.h"
+
+int infactory_crc_check_bitwise(const uint8_t *b) {
+  uint8_t msg_crc, crc, msg[5];
+  memcpy(msg, b, 5);
+  msg_crc = msg[1] >> 4;
+  msg[1] = (msg[1] & 0x0F) | (msg[4] & 0x0F) << 4;
+  crc = crc4(msg, 4, 0x13, 0);
+  crc ^= msg[4] >> 4;
+  return (crc == msg_crc);
+}
+
+size_t jsonArduinoJson(uint64_t data, uint8_t confidence, char *msg, size_t size) {
+  int battery_low = newentorBattery(data);
+  int temp_raw    = newentorTempRaw(data);
+  int humidity    = newentorHumidity(data);
+  int channel     = newentorChannel(data);
+  double tempF=(temp_raw-900)/10.0;
+  double tempC=convertFtoC(tempF);
+  char address[3]="";
+  sprintf(address,"%02x",newentorAddress(data));
+  StaticJsonDocument<128> json;
+  json["SensorAddress"]=address;
+  json["Channel"]=channel;
+  json["TemperatureF"]=tempF;
+  json["TemperatureC"]=tempC;
+  json["Humidity"]=humidity;
+  json["BatteryLow"]=battery_low;
+  json["Confidence"]=confidence;
+  return serializeJson(json, msg, size);
+}
+
+size_t jsonInteger(uint64_t data, uint8_t confidence, char *msg, size_t size) {
+  sensorReading reading;
+  newentorFields(data, reading);
+  reading.confidence = confidence;
+  return newentorToJson(reading, msg, size);
+}
@@ -0,0 +1,10 @@
+#pragma once
+// Implementations as they were before their optimized replacements, kept for the equivalence tests in test/ and as
+// the baseline of the benchmarks
+
+#include <stdint.h>
+#include <stddef.h>
+
+int infactory_crc_check_bitwise(const uint8_t *b); //rtl_433 InFactory CRC check on the bitwise crc4()
+size_t jsonArduinoJson(uint64_t data, uint8_t confidence, char *msg, size_t size); //message json with double math, ArduinoJson and sprintf
+size_t jsonInteger(uint64_t data, uint8_t confidence, char *msg, size_t size); //the same message through newentorToJson()
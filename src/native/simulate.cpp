@@ -0,0 +1,500 @@
+// Synthetic multi-sensor RF signal generator and frame error rate benchmark.
+//
+// Builds valid Newentor datagrams for a number of sensors transmitting at their own period, turns every burst into the
+// pulses of the receiver output and adds the impairments of a real installation:
+//   jitter   every pause is off by up to this many us and every pulse by up to half of it, on top of a clock deviation
+//            of up to 2% per sensor
+//   dropout  percent of the repeats that fade out at a random bit
+//   glitch   noise spikes per second of air, 10 to 200 us long, they invert the receiver output
+//   collide  percent of the transmissions moved to start inside the previous transmission of another sensor
+//   period   seconds between the transmissions of a sensor, sensors with random phase also collide on their own
+//   storm    noise edges per second while no sensor transmits, a superregenerative receiver outputs noise until a
+//            transmission captures it. Above edge_rate_max the governor turns the edge interrupt off
+//   sample   0 feeds the edges to the receiver like the interrupt does, with processFrames() after every edge and
+//            every 10 ms. Otherwise the output is sampled every this many us and handed to the block decoder of the
+//            sampled edge source (RF_SAMPLED) in every 10 ms pass of processFrames()
+// Overlapping transmissions are OR-ed like on air. The readings that reach the outbox are matched against the
+// transmissions.
+//
+// Every combination of the parameter lists is run in a child process, so every run starts from a fresh decoder,
+// learned timing, burst and duplicate filter state and from an empty file system in a temporary directory.
+// Reported per run:
+//   FER      transmissions whose reading was not published
+//   dup      published readings of a transmission that was already published
+//   false    published readings that match no transmission (CRC collisions of broken datagrams)
+//   pred     bursts of sensors with learned periods that arrived inside their predicted window, learn is the number
+//            of these sensors
+//   us/frame processing time of the edges, in the interrupt and the processFrames() after them, per datagram out of the
+//            decoder. The loop passes between the edges are not counted, in sampled mode every pass is
+//   decode   CPU time per second of air of the edge handler or the block decoder alone, the same signal decoded again
+//            with only the frame queue drained
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include "newentor.h"
+#include "rf_receiver.h"
+#include "receiver.h"
+#include "capture.h"
+#include "outbox.h"
+#include "timing.h"
+#include "history.h"
+#include "predict.h"
+#include "hal.h"
+#include "hal_linux.h"
+#include "simulate.h"
+
+#define SIM_SECONDS 3600 //default length of air simulated per run
+#define SIM_SECONDS_MAX 4200 //edge times are 32 bit microseconds
+#define SIM_START 1000000 //us, time of the first edge
+#define SIM_SENSORS_MAX 32
+#define SIM_PULSE 650 //us, nominal Newentor timing as measured on the air
+#define SIM_ZERO 1800
+#define SIM_ONE 4000
+#define SIM_PREAMBLE 8100
+#define SIM_SYNC 3 //short pulses before the preamble
+#define SIM_REPEAT_GAP 2000 //us between the repeats of a burst
+#define SIM_SKEW 20 //per mille, largest clock deviation of a sensor
+#define SIM_PERIOD_JITTER 50000 //us the transmissions of a sensor drift from its period
+#define SIM_GLITCH_MIN 10 //us
+#define SIM_GLITCH_MAX 200
+#define SIM_LOOP_PERIOD 10000 //us, processFrames() runs at least this often like in the scheduler of the firmware
+#define SIM_MATCH_WINDOW 2000000 //us after a transmission that its reading can be published, a burst completes after BURST_GAP
+#define SIM_MATCH_LOOKBACK 5000000 //us, longest time from the start of a transmission to the publishing of its reading
+
+#define SIM_SAMPLE_MAX 100 //us, longest sample period of the sampled edge source
+
+enum simAxis {SIM_AXIS_SENSORS, SIM_AXIS_JITTER, SIM_AXIS_DROPOUT, SIM_AXIS_GLITCH, SIM_AXIS_COLLIDE, SIM_AXIS_PERIOD, SIM_AXIS_SAMPLE,
+  SIM_AXIS_STORM, SIM_AXES};
+
+static const char *const axis_names[SIM_AXES] = {"sensors", "jitter", "dropout", "glitch", "collide", "period", "sample", "storm"};
+static const char *const axis_defaults[SIM_AXES] = {"1,4,8", "0,250,500", "0,30", "0,20,100", "0,10", "50", "0,25", "0"};
+
+struct simSensor {
+  uint8_t address;
+  uint8_t channel;
+  int temperature; //tenths of F
+  int humidity;
+  int skew; //per mille
+};
+
+struct simTransmission {
+  uint32_t start; //us
+  uint32_t duration;
+  uint64_t data;
+  uint8_t sensor;
+  bool overlap; //on air at the same time as another transmission
+  bool received;
+  std::vector<uint32_t> pulses; //start and end of every pulse relative to start
+};
+
+struct simPublished {
+  uint64_t data;
+  uint32_t time; //ms
+};
+
+static int simRandom(int min, int max) { //inclusive
+  return min + rand()%(max-min+1);
+}
+
+static uint64_t simDatagram(const simSensor &sensor) { //valid Newentor datagram with the CRC set
+  uint64_t data = (uint64_t)sensor.address << 32 | (uint64_t)((sensor.temperature+900) & 0xFFF) << 12 |
+    (uint64_t)(sensor.humidity/10) << 8 | (uint64_t)(sensor.humidity%10) << 4 | sensor.channel;
+  uint32_t body = ((data >> 8) & 0xFF0FFFFF) | (uint32_t)(data & 0x0F) << 20; //same layout as newentorCrcCheck()
+  data |= (uint64_t)(newentorCrc4(body) ^ ((data >> 4) & 0x0F)) << 28;
+  uint8_t bytes[5];
+  newentorToBytes(data, bytes);
+  if (!infactory_crc_check(bytes)) fprintf(stderr, "sim: generated datagram %010llx fails the CRC check\n", (unsigned long long)data);
+  return data;
+}
+
+static uint32_t simDuration(int nominal, int skew, unsigned jitter) {
+  int duration = nominal + nominal*skew/1000 + (jitter ? simRandom(-(int)jitter, jitter) : 0);
+  return duration < 1 ? 1 : duration;
+}
+
+static void simEncode(simTransmission &tx, const simSensor &sensor, unsigned jitter, unsigned dropout) { //pulses of the burst
+  uint32_t t = 0;
+  for (uint8_t repeat=0; repeat<BURST_REPEATS; repeat++) {
+    int cut = (unsigned)simRandom(0, 99) < dropout ? simRandom(0, DATAGRAM-1) : -1; //bit at which the repeat fades out
+    auto pulse = [&](int pause, bool heard) {
+      uint32_t width = simDuration(SIM_PULSE, sensor.skew, jitter/2);
+      if (heard) {
+        tx.pulses.push_back(t);
+        tx.pulses.push_back(t+width);
+      }
+      t += width + simDuration(pause, sensor.skew, jitter);
+    };
+    for (uint8_t i=0;i<SIM_SYNC;i++) pulse(SIM_PULSE, true);
+    pulse(SIM_PREAMBLE, true);
+    for (int bit=0; bit<DATAGRAM; bit++) pulse((tx.data >> (DATAGRAM-1-bit)) & 1 ? SIM_ONE : SIM_ZERO, cut<0 || bit<cut);
+    pulse(SIM_REPEAT_GAP, cut<0);
+  }
+  tx.duration = t;
+}
+
+static void simRemoveDir(const char *dir) {
+  DIR *d = opendir(dir);
+  if (d) {
+    for (struct dirent *entry; (entry = readdir(d));) {
+      if (entry->d_name[0]=='.') continue;
+      char path[512];
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      unlink(path);
+    }
+    closedir(d);
+  }
+  rmdir(dir);
+}
+
+static bool simWriteCapture(const char *path, const std::vector<uint32_t> &edges) {
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[CAPTURE_HEADER_SIZE > CAPTURE_MAX_EDGE_SIZE ? CAPTURE_HEADER_SIZE : CAPTURE_MAX_EDGE_SIZE];
+  uint32_t last = edges.empty() ? SIM_START : edges[0];
+  fwrite(buf, 1, captureEncodeHeader(buf, last), out);
+  for (size_t i=0;i<edges.size();i++) {
+    fwrite(buf, 1, captureEncodeEdge(buf, edges[i]-last, !(i & 1)), out);
+    last = edges[i];
+  }
+  fclose(out);
+  return true;
+}
+
+static void simSamples(const std::vector<uint32_t> &edges, uint32_t end, unsigned sample, std::vector<uint32_t> &words) { //receiver output sampled every sample us
+  bool level = false;
+  size_t next = 0;
+  uint32_t t = SIM_START;
+  for (; t+32*sample<=end; ) {
+    uint32_t word = 0;
+    for (uint8_t bit=0; bit<32; bit++, t += sample) {
+      for (; next<edges.size() && edges[next]<=t; next++) level = !(next & 1);
+      word = word<<1 | level;
+    }
+    words.push_back(word);
+  }
+}
+
+static double simDecode(const std::vector<uint32_t> &edges, const std::vector<uint32_t> &words, unsigned sample, uint32_t end) { //seconds of CPU
+  struct timespec start, stop;                 //in the edge handler or block decoder, without the rest of the pipeline
+  rfFrame frame;
+  size_t next = 0;
+  rfGovernorExpect(false); //no burst predictions without the rest of the pipeline
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (sample) {
+    rfSamplesBegin(SIM_START, sample*1000);
+    size_t per_loop = SIM_LOOP_PERIOD/(32*sample); //words collected between two passes of loop()
+    for (; next<words.size(); next += per_loop) {
+      rfHandleSamples(&words[next], std::min(per_loop, words.size()-next));
+      while (rfReadFrame(frame)) {}
+      rfGovernorPoll(rfSamplesTime());
+    }
+  }
+  else {
+    for (uint32_t t = SIM_START+SIM_LOOP_PERIOD; t<end; t += SIM_LOOP_PERIOD) {
+      for (; next<edges.size() && edges[next]<t; next++) {
+        if (halLinuxEdgeSourceEnabled()) rfHandleEdge(!(next & 1), edges[next]);
+      }
+      while (rfReadFrame(frame)) {}
+      rfGovernorPoll(t);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  return (stop.tv_sec-start.tv_sec) + (stop.tv_nsec-start.tv_nsec)/1e9;
+}
+
+static void simRun(const unsigned *value, unsigned seconds, unsigned seed, const char *capture_path) { //one run, in the child
+  unsigned sensor_count = value[SIM_AXIS_SENSORS], jitter = value[SIM_AXIS_JITTER], dropout = value[SIM_AXIS_DROPOUT];
+  unsigned glitch = value[SIM_AXIS_GLITCH], collide = value[SIM_AXIS_COLLIDE], period = value[SIM_AXIS_PERIOD]*1000000;
+  unsigned sample = value[SIM_AXIS_SAMPLE], storm = value[SIM_AXIS_STORM];
+  srand(seed);
+  simSensor sensors[SIM_SENSORS_MAX];
+  for (unsigned i=0;i<sensor_count;i++) {
+    sensors[i].address = 0x11 + i*0x1D; //distinct addresses
+    sensors[i].channel = i%3+1;
+    sensors[i].temperature = simRandom(500, 800);
+    sensors[i].humidity = simRandom(30, 70);
+    sensors[i].skew = simRandom(-SIM_SKEW, SIM_SKEW);
+  }
+  uint32_t end = SIM_START + seconds*1000000U;
+  std::vector<simTransmission> transmissions;
+  for (unsigned i=0;i<sensor_count;i++) {
+    uint32_t sensor_period = period + (int)period/1000*sensors[i].skew;
+    for (uint32_t t = SIM_START + (uint32_t)(rand()%(period/1000))*1000; t<end-SIM_MATCH_WINDOW;
+      t += sensor_period + simRandom(-SIM_PERIOD_JITTER, SIM_PERIOD_JITTER)) {
+      simSensor &sensor = sensors[i];
+      if (rand()%3==0) sensor.temperature += simRandom(-3, 3);
+      if (rand()%4==0) sensor.humidity = std::min(95, std::max(5, sensor.humidity+simRandom(-1, 1)));
+      simTransmission tx = {};
+      tx.start = t;
+      tx.data = simDatagram(sensor);
+      tx.sensor = i;
+      transmissions.push_back(tx);
+    }
+  }
+  srand(seed+1); //impairments do not change the schedule and the readings
+  for (simTransmission &tx : transmissions) simEncode(tx, sensors[tx.sensor], jitter, dropout);
+  auto byStart = [](const simTransmission &a, const simTransmission &b) { return a.start<b.start; };
+  std::sort(transmissions.begin(), transmissions.end(), byStart);
+  for (size_t i=1;i<transmissions.size();i++) { //forced collisions
+    if ((unsigned)simRandom(0, 99)>=collide) continue;
+    for (size_t j=i; j-->0;) {
+      if (transmissions[j].sensor==transmissions[i].sensor) continue;
+      transmissions[i].start = transmissions[j].start + rand()%transmissions[j].duration;
+      break;
+    }
+  }
+  std::sort(transmissions.begin(), transmissions.end(), byStart);
+  uint32_t busy_until = 0; //end of the transmissions so far
+  simTransmission *longest = NULL; //transmission that ends at busy_until
+  unsigned overlaps = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> pulses; //on air, OR of all transmitters
+  for (simTransmission &tx : transmissions) {
+    if (longest && tx.start<busy_until) tx.overlap = longest->overlap = true;
+    if (!longest || tx.start+tx.duration>busy_until) {
+      busy_until = tx.start+tx.duration;
+      longest = &tx;
+    }
+    for (size_t p=0;p<tx.pulses.size();p+=2) pulses.push_back({tx.start+tx.pulses[p], tx.start+tx.pulses[p+1]});
+  }
+  for (const simTransmission &tx : transmissions) overlaps += tx.overlap;
+  std::sort(pulses.begin(), pulses.end());
+  std::vector<uint32_t> toggles; //receiver output changes, the level starts low
+  for (size_t p=0;p<pulses.size();) {
+    uint32_t rise = pulses[p].first, fall = pulses[p].second;
+    for (p++; p<pulses.size() && pulses[p].first<=fall; p++) fall = std::max(fall, pulses[p].second);
+    toggles.push_back(rise);
+    toggles.push_back(fall);
+  }
+  if (storm) { //noise pulses and pauses of random length in the quiet time between transmissions
+    uint32_t spacing = 1000000/storm; //us, mean time between the noise edges
+    uint32_t quiet = SIM_START; //end of the last transmission
+    for (size_t i=0;i<=transmissions.size();i++) {
+      uint32_t until = i<transmissions.size() ? transmissions[i].start : end;
+      for (uint32_t t = quiet+spacing; t+2*spacing<until; t += 2*spacing) {
+        toggles.push_back(t);
+        toggles.push_back(t+simRandom(spacing/2+1, spacing*3/2));
+      }
+      if (i<transmissions.size()) quiet = std::max(quiet, transmissions[i].start+transmissions[i].duration);
+    }
+  }
+  for (unsigned long i=0, count=(unsigned long)glitch*seconds; i<count; i++) { //a glitch inverts the output for a while
+    uint32_t t = SIM_START + (uint32_t)(((uint64_t)rand() << 16 ^ rand()) % ((uint64_t)seconds*1000000));
+    toggles.push_back(t);
+    toggles.push_back(t+simRandom(SIM_GLITCH_MIN, SIM_GLITCH_MAX));
+  }
+  std::sort(toggles.begin(), toggles.end());
+  std::vector<uint32_t> edges;
+  edges.reserve(toggles.size());
+  for (size_t i=0;i<toggles.size();i++) { //two toggles at the same time cancel
+    if (i+1<toggles.size() && toggles[i]==toggles[i+1]) i++;
+    else edges.push_back(toggles[i]);
+  }
+  if (capture_path && !simWriteCapture(capture_path, edges)) return;
+  uint32_t finish = std::max(end, edges.empty() ? 0 : edges.back())+BURST_GAP+SIM_LOOP_PERIOD;
+  std::vector<uint32_t> words;
+  if (sample) simSamples(edges, finish, sample, words);
+
+  std::vector<simPublished> published;
+  unsigned long suppressed = 0;
+  auto drain = [&]() {
+    outboxRecord record;
+    while (outboxPeek(record)) {
+      published.push_back({record.data, record.time});
+      outboxPop(1);
+    }
+  };
+  struct timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint32_t loop_time = SIM_START; //loop() also runs between the edges, it completes the bursts without all repeats
+  double idle = 0; //seconds spent in these passes
+  auto loopUntil = [&](uint32_t until) {
+    if (loop_time>=until) return;
+    struct timespec idle_start, idle_stop;
+    clock_gettime(CLOCK_MONOTONIC, &idle_start);
+    for (; loop_time<until; loop_time += SIM_LOOP_PERIOD) {
+      halLinuxSetTime(loop_time);
+      processFrames();
+      drain();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &idle_stop);
+    idle += (idle_stop.tv_sec-idle_start.tv_sec) + (idle_stop.tv_nsec-idle_start.tv_nsec)/1e9;
+  };
+  if (sample) { //sampled edge source, the samples since the last pass are decoded in every pass of loop()
+    rfSamplesBegin(SIM_START, sample*1000);
+    size_t next = 0;
+    for (; loop_time<finish; loop_time += SIM_LOOP_PERIOD) {
+      size_t count = 0;
+      while (next+count<words.size() && SIM_START+(next+count+1)*32*sample<=loop_time) count++;
+      if (count) rfHandleSamples(&words[next], count);
+      next += count;
+      halLinuxSetTime(loop_time);
+      processFrames();
+      drain();
+    }
+  }
+  else {
+    for (size_t i=0;i<edges.size();i++) {
+      loopUntil(edges[i]);
+      loop_time = edges[i]+SIM_LOOP_PERIOD; //processFrames() runs after the edge
+      halLinuxSetTime(edges[i]);
+      if (halLinuxEdgeSourceEnabled()) rfHandleEdge(!(i & 1), edges[i]); //the interrupt of the device
+      else suppressed++;
+      processFrames();
+      drain();
+    }
+    loopUntil(finish); //complete the last bursts
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  double elapsed = (stop.tv_sec-start.tv_sec) + (stop.tv_nsec-start.tv_nsec)/1e9 - idle;
+
+  unsigned long received = 0, duplicates = 0, false_readings = 0, lost_overlap = 0;
+  for (const simPublished &reading : published) {
+    uint64_t time = (uint64_t)reading.time*1000;
+    simTransmission *match = NULL;
+    auto after = std::upper_bound(transmissions.begin(), transmissions.end(), time,
+      [](uint64_t t, const simTransmission &tx) { return t<tx.start; });
+    for (auto tx = after; tx!=transmissions.begin();) {
+      --tx;
+      if (time-tx->start > SIM_MATCH_LOOKBACK) break;
+      if (tx->data==reading.data && time <= (uint64_t)tx->start+tx->duration+SIM_MATCH_WINDOW) {
+        match = &*tx;
+        break;
+      }
+    }
+    if (!match) false_readings++;
+    else if (match->received) duplicates++;
+    else {
+      match->received = true;
+      received++;
+    }
+  }
+  for (const simTransmission &tx : transmissions) if (!tx.received && tx.overlap) lost_overlap++;
+  size_t sent = transmissions.size();
+  uint32_t predicted = predictStats.hits+predictStats.misses;
+  uint32_t frames = rfStats.frames, edge_count = rfStats.edges+suppressed;
+  double decode = simDecode(edges, words, sample, finish); //again, for the CPU time of the front end alone
+  printf("%7u %6u %7u %6u %7u %6u %6u %6u | %5zu %7.1f %8lu | %6.2f %8lu %6.2f %5lu | %6.2f %5u | %8lu %8.2f %9.1f\n", sensor_count,
+    jitter, dropout, glitch, collide, period/1000000, sample, storm, sent, sent ? 100.0*overlaps/sent : 0.0, (unsigned long)frames,
+    sent ? 100.0*(sent-received)/sent : 0.0, lost_overlap, published.size() ? 100.0*duplicates/published.size() : 0.0, false_readings,
+    predicted ? 100.0*predictStats.hits/predicted : 0.0, predictLearned(),
+    (unsigned long)edge_count, frames ? elapsed*1e6/frames : 0.0, decode*1e6/seconds);
+}
+
+static bool simParseList(const char *text, std::vector<unsigned> &values) {
+  values.clear();
+  for (const char *p = text; *p;) {
+    char *end;
+    unsigned long value = strtoul(p, &end, 10);
+    if (end==p || (*end && *end!=',')) return false;
+    values.push_back(value);
+    p = *end ? end+1 : end;
+  }
+  return !values.empty();
+}
+
+int cmdSimulate(int argc, char **argv) {
+  unsigned seconds = SIM_SECONDS, seed = 1;
+  const char *capture_path = NULL;
+  std::vector<unsigned> axes[SIM_AXES];
+  for (uint8_t a=0;a<SIM_AXES;a++) simParseList(axis_defaults[a], axes[a]);
+  for (int i=0;i<argc;i++) {
+    const char *equals = strchr(argv[i], '=');
+    if (!equals) {
+      seconds = strtoul(argv[i], NULL, 10);
+      continue;
+    }
+    size_t name_len = equals-argv[i];
+    bool known = false;
+    for (uint8_t a=0;a<SIM_AXES;a++) {
+      if (strlen(axis_names[a])==name_len && strncmp(argv[i], axis_names[a], name_len)==0) known = simParseList(equals+1, axes[a]);
+    }
+    if (strncmp(argv[i], "seed=", 5)==0) {
+      seed = strtoul(equals+1, NULL, 10);
+      known = true;
+    }
+    if (strncmp(argv[i], "out=", 4)==0) {
+      capture_path = equals+1;
+      known = true;
+    }
+    if (!known) {
+      fprintf(stderr, "sim: invalid parameter %s, expected seconds, seed=, out= or one of", argv[i]);
+      for (uint8_t a=0;a<SIM_AXES;a++) fprintf(stderr, " %s=", axis_names[a]);
+      fprintf(stderr, " with comma separated values\n");
+      return 2;
+    }
+  }
+  if (seconds<1 || seconds>SIM_SECONDS_MAX || axes[SIM_AXIS_SENSORS].back()>SIM_SENSORS_MAX) {
+    fprintf(stderr, "sim: 1-%u seconds and up to %u sensors\n", SIM_SECONDS_MAX, SIM_SENSORS_MAX);
+    return 2;
+  }
+  for (unsigned sensors : axes[SIM_AXIS_SENSORS]) {
+    if (sensors<1 || sensors>SIM_SENSORS_MAX) {
+      fprintf(stderr, "sim: 1-%u sensors\n", SIM_SENSORS_MAX);
+      return 2;
+    }
+  }
+  for (unsigned sample : axes[SIM_AXIS_SAMPLE]) {
+    if (sample>SIM_SAMPLE_MAX) {
+      fprintf(stderr, "sim: sample period up to %u us, 0 feeds the edges to the edge interrupt handler\n", SIM_SAMPLE_MAX);
+      return 2;
+    }
+  }
+  for (unsigned period : axes[SIM_AXIS_PERIOD]) {
+    if (period<1 || period>seconds) {
+      fprintf(stderr, "sim: period has to be 1 to %u seconds\n", seconds);
+      return 2;
+    }
+  }
+  size_t runs = 1;
+  for (const std::vector<unsigned> &axis : axes) runs *= axis.size();
+  if (capture_path && runs>1) {
+    fprintf(stderr, "sim: out= needs a single value for every parameter\n");
+    return 2;
+  }
+  printf("%zu runs of %u s of air, seed %u\n", runs, seconds, seed);
+  printf("sensors jitter dropout glitch collide period sample  storm |    tx overlap%%   frames |   FER%% lost_ovl   dup%% false |  pred%% learn |    edges us/frame decode_us/s\n");
+  fflush(stdout);
+  size_t index[SIM_AXES] = {};
+  for (size_t run=0; run<runs; run++) {
+    unsigned value[SIM_AXES];
+    for (uint8_t a=0;a<SIM_AXES;a++) value[a] = axes[a][index[a]];
+    pid_t pid = fork();
+    if (pid<0) {
+      perror("fork");
+      return 1;
+    }
+    if (pid==0) { //fresh receiver state in every run
+      char dir[] = "/tmp/simXXXXXX";
+      if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        _exit(1);
+      }
+      halLinuxSetRoot(dir);
+      timingReset();
+      outboxBegin();
+      historyBegin();
+      simRun(value, seconds, seed, capture_path);
+      fflush(stdout);
+      simRemoveDir(dir);
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+      fprintf(stderr, "sim: run %zu failed\n", run+1);
+      return 1;
+    }
+    for (int a=SIM_AXES-1; a>=0 && ++index[a]==axes[a].size(); a--) index[a] = 0; //next combination, last parameter fastest
+  }
+  return 0;
+}
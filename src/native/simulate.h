@@ -0,0 +1,4 @@
+#pragma once
+// Synthetic RF signal generator and frame error rate benchmark of the receive pipeline for the native build
+
+int cmdSimulate(int argc, char **argv); //"program sim [seconds] [name=value,value...]...", see simulate.cpp for the parameters
@@ -0,0 +1,159 @@
+#include <math.h>
+#include <string.h>
+#include "newentor.h"
+#include "protocol.h"
+
+double convertFtoC(double f) { //convert F to C and round to 1
+  return round(((f-32.0)*0.55555)*10)/10.0;
+}
+
+int newentorFtoC(int tempF) {
+  //(F-32)*0.55555 in tenths, rounded half away from zero like round(). 12 bit range never hits an exact half
+  int32_t scaled = (int32_t)(tempF-320)*55555;
+  return (scaled + (scaled>=0 ? 50000 : -50000)) / 100000;
+}
+
+uint8_t crc4(uint8_t const message[], unsigned nBytes, uint8_t polynomial, uint8_t init) // copied from rtl_433 project
+{
+    unsigned remainder = init << 4; // LSBs are unused
+    unsigned poly = polynomial << 4;
+    unsigned bit;
+
+    while (nBytes--) {
+        remainder ^= *message++;
+        for (bit = 0; bit < 8; bit++) {
+            if (remainder & 0x80) {
+                remainder = (remainder << 1) ^ poly;
+            } else {
+                remainder = (remainder << 1);
+            }
+        }
+    }
+    return remainder >> 4 & 0x0f; // discard the LSBs
+}
+
+struct crc4Table {
+  uint8_t next[16]; //next crc for (crc ^ nibble)
+};
+
+constexpr crc4Table crc4MakeTable(uint8_t polynomial) { //crc4() applied to one nibble at a time
+  crc4Table table = {};
+  for (unsigned nibble=0;nibble<16;nibble++) {
+    unsigned remainder = nibble << 4;
+    for (unsigned bit=0;bit<4;bit++) {
+      remainder = (remainder & 0x80) ? (remainder << 1) ^ (polynomial << 4) : remainder << 1;
+    }
+    table.next[nibble] = remainder >> 4 & 0x0f;
+  }
+  return table;
+}
+
+//16 bytes, small enough to stay in RAM where it is also safe to read from interrupt context
+static constexpr crc4Table crc4_table = crc4MakeTable(0x13); // Koopmann 0x9, CCITT-4; FP-4; ITU-T G.704
+
+uint8_t newentorCrc4(uint32_t body) {
+  uint8_t crc = 0;
+  for (int shift=28;shift>=0;shift-=4) {
+    crc = crc4_table.next[crc ^ ((body >> shift) & 0x0f)];
+  }
+  return crc;
+}
+
+bool newentorCrcCheck(uint64_t data) {
+  // for CRC computation, channel bits are at the CRC position(!)
+  uint32_t body = ((data >> 8) & 0xFF0FFFFF) | (uint32_t)(data & 0x0F) << 20;
+  uint8_t crc = newentorCrc4(body) ^ ((data >> 4) & 0x0f); // last nibble is only XORed
+  return crc == newentorCrc(data);
+}
+
+int infactory_crc_check(const uint8_t *b) // rtl_433 InFactory check on the table driven crc
+{
+    return newentorCrcCheck(newentorFromBytes(b));
+}
+
+newentorStatus newentorCheck(uint64_t data) {
+  if (!newentorValid(data)) { // check for packet validity
+    return NEWENTOR_INVALID;
+  }
+  if (!newentorCrcCheck(data)) { // perform CRC check before decoding the fields
+    return NEWENTOR_BAD_CRC;
+  }
+  return NEWENTOR_OK;
+}
+
+void newentorFields(uint64_t data, sensorReading &reading) {
+  static const char hex[] = "0123456789abcdef";
+  reading.battery_low = newentorBattery(data);
+  reading.confidence  = 1;
+  reading.protocol    = RF_PROTOCOL_NEWENTOR;
+  reading.humidity    = newentorHumidity(data);
+  reading.channel     = newentorChannel(data);
+  reading.tempF=newentorTempRaw(data)-900; // calculate real temperature in tenths of F
+  reading.tempC=newentorFtoC(reading.tempF);
+  uint8_t address = newentorAddress(data);
+  reading.address[0] = hex[address >> 4]; // sensor address HEX representation
+  reading.address[1] = hex[address & 0x0F];
+  reading.address[2] = 0;
+}
+
+newentorStatus newentorDecode(uint64_t data, sensorReading &reading) {
+  newentorStatus status = newentorCheck(data);
+  if (status==NEWENTOR_OK) newentorFields(data, reading);
+  return status;
+}
+
+static char *jsonText(char *p, const char *text) {
+  while (*text) *p++ = *text++;
+  return p;
+}
+
+static char *jsonUint(char *p, unsigned value) {
+  char digits[10];
+  uint8_t len = 0;
+  do {
+    digits[len++] = '0' + value%10;
+    value /= 10;
+  } while (value);
+  while (len) *p++ = digits[--len];
+  return p;
+}
+
+static char *jsonTenths(char *p, int tenths) { //same format as ArduinoJson for doubles with 1 decimal: 18.9, -7.3, 20
+  if (tenths<0) {
+    *p++ = '-';
+    tenths = -tenths;
+  }
+  p = jsonUint(p, tenths/10);
+  if (tenths%10) {
+    *p++ = '.';
+    *p++ = '0' + tenths%10;
+  }
+  return p;
+}
+
+size_t newentorToJson(const sensorReading &reading, char *buf, size_t size) {
+  if (size<NEWENTOR_JSON_SIZE) return 0; //longest message is 121 characters, 140 with a protocol name
+  char *p = buf;
+  p = jsonText(p, "{\"SensorAddress\":\"");
+  p = jsonText(p, reading.address);
+  p = jsonText(p, "\",\"Channel\":");
+  p = jsonUint(p, reading.channel);
+  p = jsonText(p, ",\"TemperatureF\":");
+  p = jsonTenths(p, reading.tempF);
+  p = jsonText(p, ",\"TemperatureC\":");
+  p = jsonTenths(p, reading.tempC);
+  p = jsonText(p, ",\"Humidity\":");
+  p = jsonUint(p, reading.humidity);
+  p = jsonText(p, ",\"BatteryLow\":");
+  p = jsonUint(p, reading.battery_low);
+  p = jsonText(p, ",\"Confidence\":");
+  p = jsonUint(p, reading.confidence);
+  if (reading.protocol!=RF_PROTOCOL_NEWENTOR) { //messages of Newentor sensors stay as they were before other protocols
+    p = jsonText(p, ",\"Protocol\":\"");
+    p = jsonText(p, protocolName(reading.protocol));
+    p = jsonText(p, "\"");
+  }
+  p = jsonText(p, "}");
+  *p = 0;
+  return p-buf;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "outbox.h"
+
+static_assert((OUTBOX_RAM_SIZE & (OUTBOX_RAM_SIZE-1))==0, "OUTBOX_RAM_SIZE must be a power of 2");
+static_assert(sizeof(outboxRecord)==16, "outboxRecord is stored in the log file as is");
+
+static outboxRecord ram[OUTBOX_RAM_SIZE];
+static uint16_t ram_head = 0; //next record to write, only used from the main loop
+static uint16_t ram_tail = 0; //oldest record
+static uint32_t file_records = 0; //records in the log file
+static uint32_t file_read = 0; //first record in the log file that is not in RAM yet
+static uint32_t file_reboot = 0; //records before this index were queued before the reboot
+outboxStatistics outboxStats = {};
+
+static uint16_t ramCount() {
+  return (uint16_t)(ram_head-ram_tail);
+}
+
+static void filePosSave() {
+  char pos[12];
+  int len = snprintf(pos, sizeof(pos), "%u", (unsigned)file_read);
+  halFileWrite(OUTBOX_POS_FILE, pos, len);
+}
+
+static void fileReset() { //whole log was published
+  halFileRemove(OUTBOX_FILE);
+  halFileRemove(OUTBOX_POS_FILE);
+  file_records = 0;
+  file_read = 0;
+  file_reboot = 0;
+}
+
+void outboxBegin() {
+  long size = halFileSize(OUTBOX_FILE);
+  if (size<=0) {
+    fileReset();
+    return;
+  }
+  file_records = size/sizeof(outboxRecord); //a record torn by a power loss is ignored
+  char pos[12] = "";
+  if (halFileRead(OUTBOX_POS_FILE, pos, sizeof(pos)-1)>0) file_read = strtoul(pos, NULL, 10);
+  if (file_read>=file_records) {
+    fileReset();
+    return;
+  }
+  file_reboot = file_records;
+  #if DEBUG
+  halDebug("Outbox: %u records pending from before the reboot\n", (unsigned)(file_records-file_read));
+  #endif
+}
+
+bool outboxPush(const outboxRecord &record) {
+  outboxStats.queued++;
+  if (!file_records && ramCount()<OUTBOX_RAM_SIZE) { //log is not in use, RAM has room
+    ram[ram_head++ & (OUTBOX_RAM_SIZE-1)] = record;
+    return true;
+  }
+  if (file_records-file_read>=OUTBOX_FILE_RECORDS || !halFileAppend(OUTBOX_FILE, (const char*)&record, sizeof(record))) {
+    outboxStats.queued--;
+    outboxStats.dropped++;
+    return false;
+  }
+  file_records++;
+  outboxStats.spilled++;
+  return true;
+}
+
+static void ramRefill() { //move the next records of the log to the empty RAM ring
+  uint32_t count = file_records-file_read;
+  if (count>OUTBOX_RAM_SIZE) count = OUTBOX_RAM_SIZE;
+  int len = halFileReadAt(OUTBOX_FILE, file_read*sizeof(outboxRecord), (char*)ram, count*sizeof(outboxRecord));
+  if (len<(int)sizeof(outboxRecord)) { //log is unreadable, give up on it
+    outboxStats.dropped += file_records-file_read;
+    fileReset();
+    return;
+  }
+  count = len/sizeof(outboxRecord);
+  for (uint32_t i=0; i<count; i++) {
+    if (file_read+i<file_reboot) ram[i].time = 0; //time of the previous boot is meaningless
+  }
+  filePosSave(); //previous batch is published, resume from this batch after a reboot
+  ram_tail = 0;
+  ram_head = count;
+  file_read += count;
+}
+
+uint8_t outboxPeekMany(outboxRecord *records, uint8_t max) {
+  if (!ramCount()) {
+    if (file_read==file_records) return 0;
+    ramRefill();
+  }
+  uint8_t count = ramCount()<max ? ramCount() : max;
+  for (uint8_t i=0; i<count; i++) records[i] = ram[(ram_tail+i) & (OUTBOX_RAM_SIZE-1)];
+  return count;
+}
+
+bool outboxPeek(outboxRecord &record) {
+  return outboxPeekMany(&record, 1)==1;
+}
+
+void outboxPop(uint8_t count) {
+  if (count>ramCount()) count = ramCount();
+  ram_tail += count;
+  if (!ramCount() && file_records && file_read==file_records) fileReset(); //last batch of the log is published, RAM takes new records again
+}
+
+uint32_t outboxDepth() {
+  return ramCount() + (file_records-file_read);
+}
+
+uint32_t outboxOldestAge(uint32_t now) {
+  if (ramCount()) {
+    uint32_t time = ram[ram_tail & (OUTBOX_RAM_SIZE-1)].time;
+    return time ? now-time : now;
+  }
+  outboxRecord record;
+  if (file_read==file_records || halFileReadAt(OUTBOX_FILE, file_read*sizeof(record), (char*)&record, sizeof(record))!=sizeof(record)) return 0;
+  return file_read<file_reboot || !record.time ? now : now-record.time;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "page.h"
+
+struct pageWriter { //collects the page into chunks for the sink, a NULL sink only counts the length
+  pageSink sink;
+  void *context;
+  char chunk[PAGE_CHUNK];
+  size_t len;
+  size_t total;
+};
+
+static void writerFlush(pageWriter &writer) {
+  if (writer.sink && writer.len) writer.sink(writer.chunk, writer.len, writer.context);
+  writer.len = 0;
+}
+
+static void writerPut(pageWriter &writer, const char *text, size_t len) {
+  while (len) {
+    if (writer.len==sizeof(writer.chunk)) writerFlush(writer);
+    size_t n = sizeof(writer.chunk)-writer.len;
+    if (n>len) n = len;
+    memcpy(writer.chunk+writer.len, text, n);
+    writer.len += n;
+    writer.total += n;
+    text += n;
+    len -= n;
+  }
+}
+
+static void writerEscape(pageWriter &writer, const char *text) {
+  for (const char *c=text; *c; c++) {
+    switch (*c) {
+      case '&': writerPut(writer, "&amp;", 5); break;
+      case '<': writerPut(writer, "&lt;", 4); break;
+      case '>': writerPut(writer, "&gt;", 4); break;
+      case '"': writerPut(writer, "&quot;", 6); break;
+      case '\'': writerPut(writer, "&#39;", 5); break;
+      default: writerPut(writer, c, 1);
+    }
+  }
+}
+
+size_t pageVprintf(pageSink sink, void *context, const char *format, va_list args) {
+  pageWriter writer;
+  writer.sink = sink;
+  writer.context = context;
+  writer.len = writer.total = 0;
+  const char *p = format;
+  char c;
+  while ((c = pgm_read_byte(p++))) {
+    if (c!='%') {
+      writerPut(writer, &c, 1);
+      continue;
+    }
+    char spec[12] = "%"; //conversion copied from flash for snprintf
+    uint8_t len = 1, longs = 0;
+    while ((c = pgm_read_byte(p++)) && len<sizeof(spec)-2) {
+      if (c=='l') longs++;
+      else if (!strchr("0123456789-+ #", c)) break;
+      spec[len++] = c;
+    }
+    spec[len++] = c;
+    spec[len] = 0;
+    char number[24];
+    int n = 0;
+    switch (c) {
+      case '%': writerPut(writer, "%", 1); break;
+      case 's': {
+        const char *text = va_arg(args, const char*);
+        writerEscape(writer, text ? text : "");
+        break;
+      }
+      case 'u': case 'x': case 'X':
+        n = longs ? snprintf(number, sizeof(number), spec, va_arg(args, unsigned long)) : snprintf(number, sizeof(number), spec, va_arg(args, unsigned));
+        break;
+      case 'd':
+        n = longs ? snprintf(number, sizeof(number), spec, va_arg(args, long)) : snprintf(number, sizeof(number), spec, va_arg(args, int));
+        break;
+      default: //unsupported conversion is copied, a '%' at the end of the template too
+        if (!c) p--;
+        writerPut(writer, spec, c ? len : len-1);
+    }
+    if (n>0) writerPut(writer, number, (size_t)n<sizeof(number) ? n : sizeof(number)-1);
+  }
+  writerFlush(writer);
+  return writer.total;
+}
+
+size_t pagePrintf(pageSink sink, void *context, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  size_t len = pageVprintf(sink, context, format, args);
+  va_end(args);
+  return len;
+}
@@ -0,0 +1,163 @@
+#include "hal.h"
+#include "protocol.h"
+#include "predict.h"
+
+struct predictActivityRun {
+  uint32_t start;
+  uint32_t end;
+};
+
+static predictSensor sensors[PREDICT_SENSORS];
+static predictActivityRun activities[PREDICT_ACTIVITIES]; //ring of the last runs of deferrable tasks
+static uint8_t activity_next = 0;
+static bool hold_enabled = true;
+static bool holding = false; //result of the last predictHold()
+predictStatistics predictStats = {};
+
+void predictBegin(bool hold) {
+  hold_enabled = hold;
+}
+
+bool predictHolding() {
+  return hold_enabled;
+}
+
+static uint32_t repeatLength(uint8_t protocol) { //us, nominal duration of one datagram from the descriptor timing
+  const rfProtocol *p = protocolGet(protocol);
+  if (!p) return 0;
+  const rfTiming &t = p->timing;
+  uint32_t bit = (t.pulse_min+t.pulse_max)/2 + (t.zero_min+t.zero_max+t.one_min+t.one_max)/4; //half ones, half zeros
+  return (t.newdata_min+t.newdata_max)/2 + p->bits*bit;
+}
+
+static uint8_t burstRepeats(uint8_t protocol) { //repeats of a complete burst, longer transmissions are split into bursts
+  const rfProtocol *p = protocolGet(protocol);
+  return !p ? 0 : p->repeats<BURST_REPEATS ? p->repeats : BURST_REPEATS;
+}
+
+static uint32_t margin(const predictSensor &s) {
+  uint32_t m = PREDICT_MARGIN_MIN + 4*s.deviation;
+  return m<PREDICT_MARGIN_MAX ? m : PREDICT_MARGIN_MAX;
+}
+
+static void lossCount(const rfBurst &burst) { //repeats missing from the burst, and whether deferrable work ran meanwhile
+  uint32_t repeat = repeatLength(burst.protocol);
+  uint8_t expected = burstRepeats(burst.protocol);
+  uint32_t start = burst.time-repeat; //burst.time is the end of the first repeat
+  uint32_t length = expected*repeat;
+  bool busy = false;
+  for (const predictActivityRun &run : activities) {
+    if (run.start==run.end) continue; //unused
+    if ((int32_t)(run.end-start)>0 && (int32_t)(run.start-(start+length))<0) busy = true;
+  }
+  predictStats.bursts[hold_enabled][busy]++;
+  if (burst.repeats<expected) predictStats.lost[hold_enabled][busy] += expected-burst.repeats;
+}
+
+void predictBurst(const rfBurst &burst) {
+  lossCount(burst);
+  if (!burst.valid) return;
+  uint16_t id = protocolSensor(burst.protocol, burst.data);
+  predictSensor *s = NULL;
+  predictSensor *oldest = &sensors[0];
+  for (predictSensor &e : sensors) {
+    if (e.used && e.sensor==id && e.protocol==burst.protocol) {
+      s = &e;
+      break;
+    }
+    if (!e.used || (oldest->used && burst.time-e.last > burst.time-oldest->last)) oldest = &e; //free slot or least recently seen
+  }
+  if (!s) {
+    s = oldest;
+    *s = {};
+    s->sensor = id;
+    s->protocol = burst.protocol;
+    s->used = true;
+    s->last = burst.time;
+    return;
+  }
+  uint32_t interval = burst.time-s->last;
+  if (interval<PREDICT_PERIOD_MIN) return; //rest of the same transmission
+  if (s->intervals==0) { //first interval is the period
+    if (interval<=PREDICT_PERIOD_MAX) {
+      s->period = interval;
+      s->deviation = 0;
+      s->intervals = 1;
+    }
+    s->last = burst.time;
+    return;
+  }
+  uint32_t skips = (interval+s->period/2)/s->period; //periods since the last burst, more than 1 if transmissions were lost
+  if (skips<1 || skips>PREDICT_SKIPS_MAX) { //silent for too long or the period changed, learn again
+    s->intervals = 0;
+    s->last = burst.time;
+    return;
+  }
+  int32_t error = (int32_t)(interval-skips*s->period);
+  uint32_t abs_error = error<0 ? -error : error;
+  bool hit = abs_error<=margin(*s);
+  if (s->intervals<PREDICT_MIN_INTERVALS && !hit) { //first interval spanned a lost transmission or was a stray burst
+    s->period = interval;
+    s->deviation = 0;
+    s->intervals = 1;
+    s->last = burst.time;
+    return;
+  }
+  if (s->intervals>=PREDICT_MIN_INTERVALS) {
+    if (hit) {
+      predictStats.hits++;
+      predictStats.error_ms += abs_error/1000;
+      s->misses = 0;
+    }
+    else predictStats.misses++;
+    predictStats.empty += skips-1;
+    if (!hit && ++s->misses>=PREDICT_MISSES_MAX) { //the period is wrong
+      s->intervals = 0;
+      s->misses = 0;
+      s->last = burst.time;
+      return;
+    }
+  }
+  if (hit) s->period += error/(int32_t)skips/8; //moving average, a miss only moves the phase
+  s->deviation += ((int32_t)abs_error/(int32_t)skips-(int32_t)s->deviation)/4;
+  if (s->intervals<255) s->intervals++;
+  s->last = burst.time;
+}
+
+static bool windowOpen(uint32_t now) {
+  for (const predictSensor &s : sensors) {
+    if (!s.used || s.intervals<PREDICT_MIN_INTERVALS) continue;
+    uint32_t since = now-s.last;
+    uint32_t n = (since+s.period/2)/s.period;
+    if (n==0) n = 1;
+    if (n>PREDICT_SKIPS_MAX) continue; //sensor gone quiet
+    int32_t offset = (int32_t)(since-n*s.period); //negative before the expected end of the first repeat
+    uint32_t repeat = repeatLength(s.protocol);
+    uint32_t m = margin(s);
+    if (offset>=-(int32_t)(m+PREDICT_LEAD+repeat) && offset<=(int32_t)((burstRepeats(s.protocol)-1)*repeat+m)) return true;
+  }
+  return false;
+}
+
+bool predictHold(uint32_t now) {
+  bool open = hold_enabled && windowOpen(now);
+  if (open && !holding) predictStats.holds++;
+  holding = open;
+  return open;
+}
+
+bool predictExpect(uint32_t now) {
+  return windowOpen(now);
+}
+
+void predictActivity(uint32_t start, uint32_t end) {
+  if (end-start<PREDICT_ACTIVITY_MIN) return;
+  activities[activity_next] = {start, end};
+  activity_next = (activity_next+1)%PREDICT_ACTIVITIES;
+}
+
+uint8_t predictLearned() {
+  uint8_t count = 0;
+  for (const predictSensor &s : sensors) count += s.used && s.intervals>=PREDICT_MIN_INTERVALS;
+  return count;
+}
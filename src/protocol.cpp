@@ -0,0 +1,60 @@
+#include "protocol.h"
+
+static const rfProtocol *const protocols[RF_PROTOCOLS] = {&protocolNewentor, &protocolNexus}; //indexed by id
+
+newentorStatus nexusCheck(uint64_t data) { //no checksum, constant nibble and humidity range
+  if (rfFieldGet(data, {8, 4})!=0x0F || rfFieldGet(data, protocolNexus.humidity)>100) return NEWENTOR_INVALID;
+  return NEWENTOR_OK;
+}
+
+const rfProtocol *protocolGet(uint8_t id) {
+  return id<RF_PROTOCOLS ? protocols[id] : NULL;
+}
+
+const char *protocolName(uint8_t id) {
+  return id<RF_PROTOCOLS ? protocols[id]->name : "?";
+}
+
+newentorStatus protocolCheck(uint8_t id, uint64_t data) {
+  const rfProtocol *protocol = protocolGet(id);
+  return protocol ? protocol->check(data) : NEWENTOR_INVALID;
+}
+
+uint16_t protocolSensor(uint8_t id, uint64_t data) {
+  const rfProtocol *protocol = protocolGet(id);
+  if (!protocol) return 0;
+  return rfFieldGet(data, protocol->address) << 8 | rfFieldGet(data, protocol->channel);
+}
+
+void protocolFields(uint8_t id, uint64_t data, sensorReading &reading) {
+  static const char hex[] = "0123456789abcdef";
+  const rfProtocol *protocol = protocolGet(id);
+  if (!protocol) return;
+  reading.protocol = id;
+  reading.battery_low = rfFieldGet(data, protocol->battery);
+  reading.confidence = 1;
+  reading.channel = rfFieldGet(data, protocol->channel) + protocol->channel_offset;
+  uint32_t humidity = rfFieldGet(data, protocol->humidity);
+  reading.humidity = protocol->humidity_coding==RF_HUMIDITY_BCD ? (humidity >> 4)*10 + (humidity & 0x0F) : humidity;
+  uint32_t temperature = rfFieldGet(data, protocol->temperature);
+  if (protocol->temperature_coding==RF_TEMP_F_OFFSET_900) {
+    reading.tempF = temperature-900; // calculate real temperature in tenths of F
+    reading.tempC = newentorFtoC(reading.tempF);
+  }
+  else {
+    uint32_t sign = 1UL << (protocol->temperature.width-1);
+    reading.tempC = (int32_t)(temperature ^ sign) - (int32_t)sign; //sign extension
+    int32_t scaled = reading.tempC*9; //tenths of C to tenths of F, rounded half away from zero
+    reading.tempF = (scaled + (scaled>=0 ? 2 : -2))/5 + 320;
+  }
+  uint8_t address = rfFieldGet(data, protocol->address);
+  reading.address[0] = hex[address >> 4]; // sensor address HEX representation
+  reading.address[1] = hex[address & 0x0F];
+  reading.address[2] = 0;
+}
+
+newentorStatus protocolDecode(uint8_t id, uint64_t data, sensorReading &reading) {
+  newentorStatus status = protocolCheck(id, data);
+  if (status==NEWENTOR_OK) protocolFields(id, data, reading);
+  return status;
+}
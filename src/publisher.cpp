@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+#include "protocol.h"
+#include "outbox.h"
+#include "publisher.h"
+#include "metrics.h"
+#include "boot.h"
+#include "scheduler.h"
+
+publisherStatistics publisherStats = {};
+publishModeStatistics publishModeStats[PUBLISH_MODES] = {};
+static publishMode mode = PUBLISH_JSON;
+static uint32_t batch_period = 10000; //batch_interval setting
+static uint8_t batch_max = 10; //batch_size setting
+static uint32_t rate_start = 0; //halMillis() when the current rate period started
+static uint32_t rate_messages[PUBLISH_MODES], rate_bytes[PUBLISH_MODES]; //counted in the current rate period
+static const char *const mode_names[PUBLISH_MODES] = {"json", "batch", "binary"};
+static uint32_t backoff = 0; //current backoff period, 0 after a successful connect
+static uint32_t next_attempt = 0; //halMillis() of the next connect attempt
+static bool was_connected = false;
+
+static uint32_t jitterRandom() { //xorshift, only used to spread reconnects of several receivers
+  static uint32_t state = 0;
+  if (!state) state = halMicros() | 1;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static bool mqttConnect(uint32_t now) {
+  if ((int32_t)(now-next_attempt)<0) return false; //backing off
+  #if DEBUG
+  halDebug("Connecting to MQTT server %s\n", mqtt_server);
+  #endif
+  if (halMqttConnect(hostname)) { //connect to MQTT broker using hostname
+    #if DEBUG
+    halDebug("MQTT connected\n");
+    #endif
+    publisherStats.connects++;
+    qualityConnected(); //subscriptions do not survive a reconnect
+    bootMark(BOOT_MQTT);
+    backoff = 0;
+    return true;
+  }
+  publisherStats.connect_failures++;
+  backoff = backoff ? backoff*2 : MQTT_BACKOFF_MIN;
+  if (backoff>MQTT_BACKOFF_MAX) backoff = MQTT_BACKOFF_MAX;
+  next_attempt = halMillis() + backoff/2 + jitterRandom()%(backoff/2+1); //random delay within the upper half of the period
+  #if DEBUG
+  halDebug("Failed to connect to MQTT, will try again in %u ms\n", (unsigned)(next_attempt-halMillis()));
+  #endif
+  return false;
+}
+
+const char *publishModeName(publishMode mode) {
+  return mode<PUBLISH_MODES ? mode_names[mode] : "?";
+}
+
+publishMode publisherMode() {
+  return mode;
+}
+
+void publisherBegin() {
+  mode = PUBLISH_JSON;
+  for (uint8_t i=0; i<PUBLISH_MODES; i++) {
+    if (strcmp(publish_mode, mode_names[i])==0) mode = (publishMode)i;
+  }
+  batch_period = strtoul(batch_interval, NULL, 10);
+  long size = atol(batch_size);
+  batch_max = size<1 ? 1 : size>PUBLISH_BATCH_MAX ? PUBLISH_BATCH_MAX : size;
+}
+
+size_t publishBinaryRecord(const outboxRecord &record, uint32_t now, uint8_t *buf) {
+  newentorToBytes(record.data, buf);
+  buf[5] = record.protocol << 5 | (record.confidence & 0x1F);
+  uint32_t age = record.time ? (now-record.time)/1000 : 0xFFFF;
+  if (age>0xFFFF) age = 0xFFFF;
+  buf[6] = age >> 8;
+  buf[7] = age;
+  return PUBLISH_RECORD_SIZE;
+}
+
+static size_t readingJson(const outboxRecord &record, char *msg, size_t size) {
+  sensorReading reading;
+  if (protocolDecode(record.protocol, record.data, reading)!=NEWENTOR_OK) return 0; //e.g. corrupted in the outbox file
+  reading.confidence = record.confidence;
+  size_t len = newentorToJson(reading, msg, size); //convert reading to json message
+  if (!len) return 0;
+  size_t quality = qualityJson(record, msg+len-1, size-len); //replaces the closing brace, one byte is left for it
+  if (!quality) return 0;
+  msg[len+quality-1] = '}';
+  msg[len+quality] = 0;
+  return len+quality;
+}
+
+static void countPublish(size_t readings, size_t bytes) {
+  publishModeStatistics &stats = publishModeStats[mode];
+  stats.messages++;
+  stats.readings += readings;
+  stats.bytes += bytes;
+  rate_messages[mode]++;
+  rate_bytes[mode] += bytes;
+  publisherStats.published++;
+  bootMark(BOOT_PUBLISH);
+}
+
+static bool publishReading(const char *msg, size_t len) { //one JSON message, streamed so the client buffer does not limit its size
+  #if DEBUG
+  halDebug("Publishing message to %s: %s\n", mqtt_topic, msg);
+  #endif
+  bool ok = halMqttBeginPublish(mqtt_topic, len) && halMqttWrite((const uint8_t*)msg, len);
+  ok = halMqttEndPublish() && ok;
+  if (ok) countPublish(1, len);
+  return ok;
+}
+
+static bool publishBatch(const outboxRecord *records, uint8_t count, uint32_t now) { //one message of count readings
+  char msg[PUBLISH_JSON_SIZE];
+  uint8_t readings = count; //readings in the message, the ones that can not be formatted are dropped with the batch
+  size_t len = count*PUBLISH_RECORD_SIZE;
+  if (mode==PUBLISH_BATCH) { //measure first so that the message is streamed without a buffer of the whole array
+    readings = 0;
+    len = 1; //closing bracket, every reading is preceded by '[' or ','
+    for (uint8_t i=0; i<count; i++) {
+      size_t reading = readingJson(records[i], msg+1, sizeof(msg)-1);
+      if (!reading) continue;
+      len += reading+1;
+      readings++;
+    }
+    if (!readings) {
+      publisherStats.dropped += count;
+      return true;
+    }
+  }
+  bool ok = halMqttBeginPublish(mqtt_topic, len);
+  bool first = true;
+  for (uint8_t i=0; ok && i<count; i++) {
+    if (mode==PUBLISH_BINARY) {
+      uint8_t record[PUBLISH_RECORD_SIZE];
+      ok = halMqttWrite(record, publishBinaryRecord(records[i], now, record));
+      continue;
+    }
+    size_t reading = readingJson(records[i], msg+1, sizeof(msg)-1);
+    if (!reading) continue;
+    msg[0] = first ? '[' : ',';
+    first = false;
+    ok = halMqttWrite((const uint8_t*)msg, reading+1);
+  }
+  if (ok && mode==PUBLISH_BATCH) ok = halMqttWrite((const uint8_t*)"]", 1);
+  ok = halMqttEndPublish() && ok;
+  if (ok) {
+    countPublish(readings, len);
+    publisherStats.dropped += count-readings;
+  }
+  return ok;
+}
+
+static void publishPending() {
+  static outboxRecord records[PUBLISH_BATCH_MAX];
+  uint32_t now = halMillis();
+  for (uint8_t i=0; i<PUBLISH_PER_LOOP; i++) {
+    uint8_t count = outboxPeekMany(records, mode==PUBLISH_JSON ? 1 : batch_max);
+    if (!count) return;
+    if (mode!=PUBLISH_JSON && outboxDepth()<batch_max && (!records[0].time || now-records[0].time<batch_period)) return; //keep collecting
+    bool ok;
+    if (mode==PUBLISH_JSON) {
+      char msg[PUBLISH_JSON_SIZE]; //mqtt message json
+      size_t len = readingJson(records[0], msg, sizeof(msg));
+      if (!len) { //can never be sent, retrying it would block the outbox
+        #if DEBUG
+        halDebug("Dropping a reading that can not be formatted.\n");
+        #endif
+        publisherStats.dropped++;
+        outboxPop(1);
+        continue;
+      }
+      halLed(true); //turn on led to indicate that readings are sent
+      ok = publishReading(msg, len);
+    }
+    else {
+      #if DEBUG
+      halDebug("Publishing %u readings to %s in %s mode\n", count, mqtt_topic, publishModeName(mode));
+      #endif
+      halLed(true);
+      ok = publishBatch(records, count, now);
+    }
+    halLed(false); //turn off led when the message is sent
+    if (!ok) { //keep the readings, they are retried on the next loop or after reconnect
+      #if DEBUG
+      halDebug("Failed to publish message.\n");
+      #endif
+      publisherStats.failed++;
+      return;
+    }
+    for (uint8_t j=0; j<count; j++) {
+      if (records[j].time) metricsPublishLatency(halMillis()-records[j].time); //0 if queued before the reboot
+    }
+    outboxPop(count);
+  }
+}
+
+static void rateUpdate(uint32_t now) {
+  if (now-rate_start<PUBLISH_RATE_PERIOD) return;
+  for (uint8_t i=0; i<PUBLISH_MODES; i++) {
+    publishModeStats[i].messages_per_period = rate_messages[i];
+    publishModeStats[i].bytes_per_period = rate_bytes[i];
+    rate_messages[i] = 0;
+    rate_bytes[i] = 0;
+  }
+  rate_start = now;
+}
+
+void publisherLoop() {
+  uint32_t now = halMillis();
+  rateUpdate(now);
+  if (!halMqttConnected()) {
+    if (was_connected) {
+      #if DEBUG
+      halDebug("MQTT client is not connected!\n");
+      #endif
+      was_connected = false;
+      next_attempt = now; //first reconnect attempt is immediate
+    }
+    if (schedulerHolding() || !mqttConnect(now)) return; //a connect attempt blocks for up to MQTT_CONNECT_TIMEOUT, not during a burst
+  }
+  was_connected = true;
+  halMqttLoop();
+  publishPending();
+}
+
+uint32_t publisherBackoff() {
+  if (halMqttConnected()) return 0;
+  int32_t wait = next_attempt-halMillis();
+  return wait>0 ? wait : 0;
+}
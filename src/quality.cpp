@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+#include "protocol.h"
+#include "quality.h"
+
+struct qualityClaim { //reading announced by another receiver
+  uint32_t fingerprint;
+  uint32_t receiver; //hash of the receiver ID, breaks ties
+  uint32_t time; //halMillis() of reception
+  uint8_t quality;
+  bool used;
+};
+
+struct qualityPending { //reading held for the election
+  outboxRecord record;
+  uint32_t fingerprint;
+  uint32_t start; //halMillis() when the election started
+  bool used;
+};
+
+static qualityClaim claims[QUALITY_CLAIMS];
+static uint8_t claim_next = 0;
+static qualityPending pending[QUALITY_PENDING];
+static char receiver[sizeof(hostname)] = "";
+static uint32_t receiver_hash = 0;
+static char claims_topic[sizeof(mqtt_topic)+sizeof(QUALITY_TOPIC)] = "";
+static bool electing = false;
+qualityStatistics qualityStats = {};
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, size_t len) {
+  for (size_t i=0;i<len;i++) {
+    hash ^= data[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+void qualityBegin() {
+  const char *id = receiver_id[0] ? receiver_id : hostname;
+  size_t len = 0;
+  for (const char *c=id; *c && len<sizeof(receiver)-1; c++) { //only characters that need no escaping in JSON and claims
+    if ((*c>='a' && *c<='z') || (*c>='A' && *c<='Z') || (*c>='0' && *c<='9') || *c=='-' || *c=='_' || *c=='.') receiver[len++] = *c;
+  }
+  receiver[len] = 0;
+  receiver_hash = fnv1a(2166136261, (const uint8_t*)receiver, len);
+  snprintf(claims_topic, sizeof(claims_topic), "%s" QUALITY_TOPIC, mqtt_topic);
+  electing = leader_election[0]=='1';
+}
+
+const char *qualityReceiver() {
+  return receiver;
+}
+
+bool qualityElecting() {
+  return electing;
+}
+
+uint8_t qualityMargin(const rfFrame &frame) {
+  const rfProtocol *protocol = protocolGet(frame.protocol);
+  rfFrameTiming timing;
+  if (!protocol || !protocol->adaptive || !rfReadFrameTiming(frame, timing)) return BURST_MARGIN_UNKNOWN; //durations are only recorded for the adaptive protocol
+  uint16_t one_min = rfTimings.one_min, one_max = rfTimings.one_max, zero_min = rfTimings.zero_min, zero_max = rfTimings.zero_max;
+  uint32_t sum = 0;
+  for (uint8_t i=0; i<protocol->bits; i++) {
+    bool one = (frame.data >> (protocol->bits-1-i)) & 1;
+    uint16_t min = one ? one_min : zero_min, max = one ? one_max : zero_max;
+    uint16_t gap = timing.gaps[i];
+    if (gap<=min || gap>=max || max-min<2) continue; //no margin
+    uint16_t edge = gap-min<max-gap ? gap-min : max-gap; //distance to the nearer edge of the window
+    sum += edge*100/((max-min)/2);
+  }
+  return sum/protocol->bits;
+}
+
+uint8_t qualityScore(const rfBurst &burst) {
+  const rfProtocol *protocol = protocolGet(burst.protocol);
+  if (!protocol || !burst.repeats) return 0;
+  uint8_t expected = protocol->repeats<BURST_REPEATS ? protocol->repeats : BURST_REPEATS;
+  uint32_t repeats = burst.repeats>=expected ? 100 : burst.repeats*100/expected;
+  uint32_t agree = burst.agree*100/burst.repeats;
+  uint8_t score;
+  if (burst.margin==BURST_MARGIN_UNKNOWN) {
+    score = (QUALITY_WEIGHT_REPEATS*repeats+QUALITY_WEIGHT_AGREE*agree)/(QUALITY_WEIGHT_REPEATS+QUALITY_WEIGHT_AGREE);
+  }
+  else score = (QUALITY_WEIGHT_REPEATS*repeats+QUALITY_WEIGHT_AGREE*agree+QUALITY_WEIGHT_MARGIN*burst.margin)/100;
+  qualityStats.scored++;
+  qualityStats.score_sum += score;
+  return score;
+}
+
+uint32_t qualityFingerprint(uint8_t protocol, uint64_t data) {
+  uint8_t bytes[6];
+  bytes[0] = protocol;
+  newentorToBytes(data, bytes+1);
+  return fnv1a(2166136261, bytes, sizeof(bytes));
+}
+
+size_t qualityJson(const outboxRecord &record, char *buf, size_t size) {
+  int len = snprintf(buf, size, ",\"Quality\":%u,\"Fingerprint\":\"%08lx\",\"Receiver\":\"%s\"", record.quality,
+    (unsigned long)qualityFingerprint(record.protocol, record.data), receiver);
+  return len>0 && (size_t)len<size ? len : 0;
+}
+
+static void claimReceived(const char *topic, const uint8_t *payload, size_t len) {
+  char text[16+sizeof(receiver)];
+  if (strcmp(topic, claims_topic)!=0 || len>=sizeof(text)) return;
+  memcpy(text, payload, len);
+  text[len] = 0;
+  char *p;
+  uint32_t fingerprint = strtoul(text, &p, 16);
+  unsigned long quality = strtoul(p, &p, 10);
+  while (*p==' ') p++;
+  if (!*p || quality>100 || strcmp(p, receiver)==0) return; //malformed or our own claim
+  qualityClaim &claim = claims[claim_next];
+  claim_next = (claim_next+1)%QUALITY_CLAIMS;
+  claim.fingerprint = fingerprint;
+  claim.quality = quality;
+  claim.receiver = fnv1a(2166136261, (const uint8_t*)p, strlen(p));
+  claim.time = halMillis();
+  claim.used = true;
+  qualityStats.claims_received++;
+}
+
+void qualityConnected() {
+  if (electing) halMqttSubscribe(claims_topic, claimReceived);
+}
+
+bool qualityElect(const outboxRecord &record) {
+  if (!electing || !halMqttConnected()) return false;
+  qualityPending *slot = NULL;
+  for (qualityPending &p : pending) {
+    if (!p.used) {
+      slot = &p;
+      break;
+    }
+  }
+  if (!slot) return false;
+  uint32_t fingerprint = qualityFingerprint(record.protocol, record.data);
+  char payload[16+sizeof(receiver)];
+  snprintf(payload, sizeof(payload), "%08lx %u %s", (unsigned long)fingerprint, record.quality, receiver);
+  if (!halMqttPublish(claims_topic, payload)) return false;
+  qualityStats.claims_sent++;
+  slot->record = record;
+  slot->fingerprint = fingerprint;
+  slot->start = halMillis();
+  slot->used = true;
+  return true;
+}
+
+static bool beaten(const qualityPending &reading, uint32_t now) { //another receiver claimed a better copy
+  for (const qualityClaim &claim : claims) {
+    if (!claim.used || claim.fingerprint!=reading.fingerprint || now-claim.time>QUALITY_CLAIM_AGE) continue;
+    if (claim.quality>reading.record.quality || (claim.quality==reading.record.quality && claim.receiver<receiver_hash)) return true;
+  }
+  return false;
+}
+
+void qualityLoop() {
+  uint32_t now = halMillis();
+  for (qualityPending &reading : pending) {
+    if (!reading.used || now-reading.start<QUALITY_ELECTION) continue;
+    reading.used = false;
+    if (beaten(reading, now)) {
+      qualityStats.lost++;
+      #if DEBUG
+      halDebug("Reading %08lx published by another receiver.\n", (unsigned long)reading.fingerprint);
+      #endif
+      continue;
+    }
+    qualityStats.won++;
+    if (!outboxPush(reading.record)) {
+      #if DEBUG
+      halDebug("Outbox is full, reading dropped.\n");
+      #endif
+    }
+  }
+}
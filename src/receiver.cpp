@@ -0,0 +1,69 @@
+#include "hal.h"
+#include "protocol.h"
+#include "dedup.h"
+#include "outbox.h"
+#include "timing.h"
+#include "sensors.h"
+#include "history.h"
+#include "aggregate.h"
+#include "boot.h"
+#include "predict.h"
+#include "quality.h"
+#include "stream.h"
+#include "receiver.h"
+
+void sendDatagram(const rfBurst &burst){
+  #if DEBUG433
+  halDebug("%s burst %010llx, %u repeats, %u agree\n", protocolName(burst.protocol), (unsigned long long)burst.data, burst.repeats, burst.agree);
+  #endif
+  predictBurst(burst); //learn when the sensor transmits
+  if (!burst.valid) { // no repeat or consensus passed validity and CRC check
+    #if DEBUG
+    halDebug("Invalid burst received.\n");
+    #endif
+    return;
+  }
+  sensorsUpdate(burst.protocol, burst.data, burst.agree, halMillis()); //latest reading for /api/sensors, duplicates included
+  if (!dedupIsNew(burst.protocol, burst.data, halMillis())){ //same datagram from the same sensor within 6 sec
+    #if DEBUG
+    halDebug("Same datagram received, skipping.\n");
+    #endif
+    return;
+  }
+  historyAdd(burst.protocol, burst.data, halMillis()); //time series of the sensor
+  aggregateAdd(burst.protocol, burst.data); //sliding window aggregates of the sensor
+  #if DEBUG || DEBUG433
+  sensorReading reading;
+  protocolFields(burst.protocol, burst.data, reading);
+  halDebug("addr:%s ch:%d tempF:%d tempC:%d humid:%d batt:%d (temperatures in tenths)\n",
+    reading.address, reading.channel, reading.tempF, reading.tempC, reading.humidity, reading.battery_low);
+  #endif
+  outboxRecord record = {};
+  record.data = burst.data;
+  record.time = halMillis();
+  record.confidence = burst.agree;
+  record.protocol = burst.protocol;
+  record.quality = qualityScore(burst);
+  if (qualityElect(record)) return; //queued by qualityLoop() unless another receiver has a better copy
+  if (!outboxPush(record)){ //published from the outbox by publisherLoop()
+    #if DEBUG
+    halDebug("Outbox is full, reading dropped.\n");
+    #endif
+  }
+}
+
+void processFrames() { //drain the datagrams received by the interrupt, assemble them to bursts and queue them
+  halSamplePoll(); //decode the samples of the sampled edge source, nothing to do for the edge interrupt
+  rfFrame frame;
+  while (rfReadFrame(frame)){
+    bootMark(BOOT_FRAME);
+    uint8_t margin = qualityMargin(frame);
+    streamFrame(frame, margin); //low latency transport, does not wait for the burst to complete
+    timingLearn(frame); //adapt the decoder windows to the sensor timing
+    burstAdd(frame, margin, sendDatagram);
+  }
+  uint32_t now = halMicros();
+  burstPoll(now, sendDatagram);
+  rfGovernorExpect(predictExpect(now)); //no edge storm backoff while a burst of a learned sensor is due
+  rfGovernorPoll(now); //edge interrupt back on after a storm
+}
@@ -0,0 +1,231 @@
+#include <atomic>
+#include "rf_decoder.h"
+
+//single-producer (interrupt) single-consumer (loop) lock-free ring buffer of received datagrams.
+//head is only written by the interrupt and tail only by loop(), indexes are free running and masked on access.
+rfFrame frameQueue[FRAMEQUEUE_SIZE];
+volatile uint8_t frameQueueHead = 0; //next slot to be written by the interrupt
+volatile uint8_t frameQueueTail = 0; //next slot to be read by loop()
+volatile rfStatistics rfStats = {};
+volatile uint8_t frameQueueHighWater = 0;
+volatile uint32_t frameQueueOverflows = 0;
+volatile rfTiming rfTimings = {NEWDATA_MIN, NEWDATA_MAX, ONE_MIN, ONE_MAX, ZERO_MIN, ZERO_MAX, PULSE_MIN, PULSE_MAX};
+rfEdgeRates rfRates = {};
+
+//edge rate governor, written by the interrupt while it is on and by loop() only while it is off
+static uint16_t governor_limit = (uint32_t)RF_EDGE_RATE_DEFAULT*RF_GOVERNOR_WINDOW/1000000; //edges per window, 0 if off
+static uint32_t window_start = 0;
+static uint16_t window_edges = 0;
+static uint32_t window_preambles = 0; //preambles and restarts at the start of the window
+static bool grace = false; //datagram received recently
+static uint32_t grace_until = 0;
+static volatile bool expected = false; //a burst is predicted, written by loop()
+static volatile bool backed_off = false;
+static uint32_t backoff_start = 0;
+static uint16_t storm_edges = 0; //edges in the window that caused the backoff
+
+//durations of the last two datagrams. The interrupt fills frameTiming[timingWrite] and hands it over on completion
+//by setting its sequence number. A buffer is invalidated (sequence 0) before the interrupt starts overwriting it,
+//so loop() can detect that its copy was torn.
+static rfFrameTiming frameTiming[2];
+static volatile uint32_t frameTimingSeq[2] = {0, 0};
+static uint8_t timingWrite = 0;
+
+struct rfQueueOutput { //hands the datagrams of the decoders over to loop()
+  static RF_ALWAYS_INLINE rfFrameTiming *timing() {
+    return &frameTiming[timingWrite];
+  }
+
+  static RF_ALWAYS_INLINE void frame(uint64_t data, uint8_t protocol, uint32_t time, bool adaptive) {
+    uint32_t seq=++rfStats.frames;
+    grace=true; //repeats of the burst follow
+    grace_until=time+RF_GRACE;
+    if (adaptive){
+      frameTimingSeq[timingWrite]=seq; //hand the durations over
+      timingWrite^=1;
+      frameTimingSeq[timingWrite]=0; //invalidate the other buffer before it is overwritten
+    }
+    uint8_t head=frameQueueHead;
+    uint8_t queued=head-frameQueueTail; //number of datagrams waiting in the queue
+    if (queued<FRAMEQUEUE_SIZE){
+      rfFrame &frame=frameQueue[head & (FRAMEQUEUE_SIZE-1)];
+      frame.data=data;
+      frame.time=time;
+      frame.seq=seq;
+      frame.protocol=protocol;
+      std::atomic_signal_fence(std::memory_order_release); //make sure the slot is filled before it is handed over to loop()
+      frameQueueHead=head+1;
+      if (queued+1>frameQueueHighWater) frameQueueHighWater=queued+1;
+    }
+    else {
+      frameQueueOverflows++; //loop() is not keeping up, drop the datagram
+    }
+  }
+};
+
+#if RF_ENABLE_NEXUS
+static rfDecoderSet<rfQueueOutput, protocolNewentor, protocolNexus> decoders;
+#else
+static rfDecoderSet<rfQueueOutput, protocolNewentor> decoders;
+#endif
+
+static RF_ALWAYS_INLINE void governorEdges(uint16_t count, uint32_t time) {
+  window_edges+=count;
+  if (time-window_start<RF_GOVERNOR_WINDOW) return;
+  uint32_t preambles=rfStats.preambles+rfStats.restarts;
+  if (grace && (int32_t)(time-grace_until)>=0) grace=false;
+  if (governor_limit && window_edges>governor_limit && preambles==window_preambles && !grace && !expected){ //noise, nobody transmits
+    backed_off=true;
+    backoff_start=time;
+    storm_edges=window_edges;
+    rfStats.backoffs++;
+    halEdgeSourceEnable(false);
+  }
+  window_start=time;
+  window_edges=0;
+  window_preambles=preambles;
+}
+
+static RF_ALWAYS_INLINE void decodeEdge(bool state, uint32_t time) {
+  static uint32_t lastTime = 0;
+  uint32_t duration = time - lastTime;
+  lastTime = time;
+  decoders.edge(state, duration, time);
+}
+
+#if RF_GLITCH_MIN
+static bool pending = false; //edge held back until the next one shows it is not the start of a spike
+static bool pending_state;
+static uint32_t pending_time;
+#endif
+
+//sampled edge source, written by rfSamplesBegin() and rfHandleSamples() only
+static uint32_t sample_ns = 0; //sample period
+static uint32_t word_us = 0, word_ns = 0; //duration of a word of 32 samples, us and the remaining ns
+static uint32_t sample_time = 0; //us, time of the first sample of the next word
+static uint32_t sample_fraction = 0; //ns after sample_time
+static bool sample_level = false; //last sample of the previous word
+
+static RF_ALWAYS_INLINE void filterEdge(bool state, uint32_t time) {
+  #if RF_GLITCH_MIN
+  if (pending){
+    if (time-pending_time<RF_GLITCH_MIN){ //spike, the interval before the pending edge continues
+      pending=false;
+      rfStats.glitches+=2;
+      return;
+    }
+    decodeEdge(pending_state, pending_time);
+  }
+  pending=true;
+  pending_state=state;
+  pending_time=time;
+  #else
+  decodeEdge(state, time);
+  #endif
+}
+
+IRAM_ATTR void rfHandleEdge(bool state, uint32_t time) {
+  rfStats.edges++;
+  governorEdges(1, time);
+  filterEdge(state, time);
+}
+
+void rfSamplesBegin(uint32_t time, uint32_t period_ns) {
+  sample_ns=period_ns;
+  word_us=32*period_ns/1000;
+  word_ns=32*period_ns%1000;
+  sample_time=time;
+  sample_fraction=0;
+}
+
+void rfHandleSamples(const uint32_t *words, size_t count) {
+  for (size_t i=0; i<count; i++){
+    uint32_t word=words[i];
+    uint32_t changes=word^(word>>1 | (uint32_t)sample_level<<31); //bit set where a sample differs from the one before it
+    sample_level=word&1;
+    if (changes && !backed_off){ //a word without edges costs this compare only
+      uint8_t edges=__builtin_popcount(changes);
+      rfStats.edges+=edges;
+      governorEdges(edges, sample_time);
+      do {
+        uint8_t bit=__builtin_clz(changes); //samples before it continue the run of the previous edge
+        changes^=0x80000000u>>bit;
+        filterEdge((word>>(31-bit))&1, sample_time+(sample_fraction+bit*sample_ns)/1000);
+      } while (changes);
+    }
+    sample_time+=word_us;
+    sample_fraction+=word_ns;
+    if (sample_fraction>=1000){
+      sample_fraction-=1000;
+      sample_time++;
+    }
+  }
+}
+
+uint32_t rfSamplesTime() {
+  return sample_time;
+}
+
+void rfGovernorBegin(uint32_t edge_rate_max) {
+  uint32_t limit=(uint64_t)edge_rate_max*RF_GOVERNOR_WINDOW/1000000;
+  governor_limit=limit>0xFFFF ? 0xFFFF : limit;
+}
+
+void rfGovernorExpect(bool burst) {
+  expected=burst;
+}
+
+void rfGovernorPoll(uint32_t now) {
+  if (backed_off && (now-backoff_start>=RF_BACKOFF || expected)){ //the interrupt is off, its state can be changed here
+    uint32_t off=now-backoff_start;
+    rfStats.backoff_ms+=off/1000;
+    rfStats.suppressed+=(uint64_t)storm_edges*off/RF_GOVERNOR_WINDOW;
+    window_start=now;
+    window_edges=0;
+    #if RF_GLITCH_MIN
+    pending=false; //the level may have changed meanwhile
+    #endif
+    backed_off=false;
+    halEdgeSourceEnable(true);
+  }
+  static uint32_t rate_start = 0;
+  static uint32_t last_edges = 0, last_glitches = 0, last_suppressed = 0;
+  if (now-rate_start<1000000) return;
+  uint32_t edges=rfStats.edges, glitches=rfStats.glitches, suppressed=rfStats.suppressed;
+  uint32_t elapsed=now-rate_start;
+  rfRates.glitches=(uint64_t)(glitches-last_glitches)*1000000/elapsed;
+  rfRates.accepted=(uint64_t)((edges-last_edges)-(glitches-last_glitches))*1000000/elapsed;
+  rfRates.suppressed=(uint64_t)(suppressed-last_suppressed)*1000000/elapsed;
+  last_edges=edges;
+  last_glitches=glitches;
+  last_suppressed=suppressed;
+  rate_start=now;
+}
+
+bool rfBackedOff() {
+  return backed_off;
+}
+
+bool rfReadFrame(rfFrame &frame) {
+  uint8_t tail=frameQueueTail;
+  if (tail==frameQueueHead) return false;
+  std::atomic_signal_fence(std::memory_order_acquire); //read the slot only after seeing the head update
+  frame=frameQueue[tail & (FRAMEQUEUE_SIZE-1)]; //copy the datagram out so the slot can be reused
+  frameQueueTail=tail+1;
+  return true;
+}
+
+bool rfReadFrameTiming(const rfFrame &frame, rfFrameTiming &timing) {
+  for (uint8_t i=0; i<2; i++) {
+    if (frameTimingSeq[i]!=frame.seq) continue;
+    std::atomic_signal_fence(std::memory_order_acquire);
+    timing=frameTiming[i];
+    std::atomic_signal_fence(std::memory_order_acquire);
+    return frameTimingSeq[i]==frame.seq; //not invalidated by the interrupt while copying
+  }
+  return false;
+}
+
+uint8_t rfQueuedFrames() {
+  return frameQueueHead-frameQueueTail;
+}
@@ -0,0 +1,83 @@
+#include "hal.h"
+#include "scheduler.h"
+
+static schedulerTask tasks[SCHEDULER_TASKS];
+static uint8_t task_count = 0;
+static schedulerHoldFunction hold_function = NULL;
+static schedulerActivityFunction activity_function = NULL;
+
+bool schedulerAdd(const char *name, schedulerFunction run, uint32_t period, uint32_t budget, uint8_t flags) {
+  if (task_count>=SCHEDULER_TASKS) return false;
+  schedulerTask &task = tasks[task_count++];
+  task = {};
+  task.name = name;
+  task.run = run;
+  task.period = period;
+  task.budget = budget;
+  task.critical = flags & SCHEDULER_CRITICAL;
+  task.deferrable = flags & SCHEDULER_DEFERRABLE;
+  task.next = halMicros();
+  return true;
+}
+
+void schedulerSetHold(schedulerHoldFunction hold, schedulerActivityFunction activity) {
+  hold_function = hold;
+  activity_function = activity;
+}
+
+bool schedulerHolding() {
+  return hold_function && hold_function(halMicros());
+}
+
+static void runTask(schedulerTask &task, uint32_t now) {
+  uint32_t latency = now-task.next;
+  if ((int32_t)latency>0 && latency>task.max_latency) task.max_latency = latency;
+  task.run();
+  uint32_t end = halMicros();
+  uint32_t runtime = end-now;
+  task.runs++;
+  task.runtime += runtime;
+  if (runtime>task.max_runtime) task.max_runtime = runtime;
+  if (runtime>task.budget) task.overruns++;
+  task.next = task.period ? now+task.period : end; //a task run on every pass is due again right away
+  task.deferred = false;
+  task.held = false;
+  if (task.deferrable && activity_function) activity_function(now, end);
+}
+
+static void runCritical() {
+  for (uint8_t i=0;i<task_count;i++) {
+    if (tasks[i].critical) runTask(tasks[i], halMicros());
+  }
+}
+
+void schedulerRun() {
+  uint32_t start = halMicros();
+  runCritical();
+  bool holding = schedulerHolding();
+  for (uint8_t i=0;i<task_count;i++) {
+    schedulerTask &task = tasks[i];
+    uint32_t now = halMicros();
+    if (task.critical || (int32_t)(now-task.next)<0) continue; //not due
+    if (task.deferrable && holding && now-task.next<SCHEDULER_HOLD_MAX) {
+      if (!task.held) task.holds++;
+      task.held = true;
+      continue;
+    }
+    if (now-start>SCHEDULER_PASS_BUDGET && !task.deferred) { //pass budget used up, runs on the next pass
+      task.deferred = true;
+      task.deferrals++;
+      continue;
+    }
+    runTask(task, now);
+    runCritical();
+  }
+}
+
+uint8_t schedulerCount() {
+  return task_count;
+}
+
+const schedulerTask &schedulerGet(uint8_t index) {
+  return tasks[index];
+}
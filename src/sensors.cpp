@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "protocol.h"
+#include "sensors.h"
+
+static sensorEntry sensors[SENSORS_MAX];
+static char json[SENSORS_JSON_SIZE] = "[]";
+static size_t json_len = 2;
+static char etag[SENSORS_ETAG_SIZE] = "\"0\"";
+static uint32_t version = 0; //incremented on every change of the table
+static uint32_t rendered = 0; //version of the cached body
+static uint32_t boot_id = 0; //keeps the ETags of different boots apart
+
+void sensorsUpdate(uint8_t protocol, uint64_t data, uint8_t confidence, uint32_t now) {
+  uint16_t sensor = protocolSensor(protocol, data);
+  sensorEntry *entry = NULL;
+  sensorEntry *oldest = &sensors[0];
+  for (sensorEntry &candidate : sensors) {
+    if (candidate.used && candidate.protocol==protocol && candidate.sensor==sensor) {
+      entry = &candidate;
+      break;
+    }
+    if (!candidate.used) {
+      if (oldest->used) oldest = &candidate; //free slot is taken before any used one
+    }
+    else if (oldest->used && now-candidate.last_seen > now-oldest->last_seen) oldest = &candidate;
+  }
+  if (!entry) { //new sensor
+    entry = oldest;
+    *entry = {};
+    entry->used = true;
+    entry->sensor = sensor;
+    entry->protocol = protocol;
+  }
+  entry->data = data;
+  entry->last_seen = now;
+  entry->confidence = confidence;
+  entry->receives++;
+  version++;
+}
+
+static void render() {
+  if (!boot_id) boot_id = halMicros() | 1;
+  size_t len = 0;
+  json[len++] = '[';
+  for (const sensorEntry &entry : sensors) {
+    if (!entry.used) continue;
+    sensorReading reading;
+    protocolFields(entry.protocol, entry.data, reading);
+    reading.confidence = entry.confidence;
+    if (len>1) json[len++] = ',';
+    size_t reading_len = newentorToJson(reading, json+len, sizeof(json)-len);
+    if (!reading_len) break;
+    len += reading_len-1; //extend the object, its '}' is overwritten
+    len += snprintf(json+len, sizeof(json)-len, ",\"LastSeen\":%lu,\"Receives\":%lu}", (unsigned long)(entry.last_seen/1000),
+      (unsigned long)entry.receives);
+  }
+  json[len++] = ']';
+  json[len] = 0;
+  json_len = len;
+  snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)boot_id, (unsigned long)version);
+  rendered = version;
+}
+
+const char *sensorsJson(size_t &len) {
+  if (rendered!=version) render();
+  len = json_len;
+  return json;
+}
+
+const char *sensorsEtag() {
+  if (rendered!=version) render();
+  return etag;
+}
+
+bool sensorsNotModified(const char *if_none_match) {
+  return if_none_match && strcmp(if_none_match, sensorsEtag())==0;
+}
+
+uint8_t sensorsCount() {
+  uint8_t count = 0;
+  for (const sensorEntry &entry : sensors) count += entry.used;
+  return count;
+}
@@ -0,0 +1,95 @@
+#include <string.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "config.h"
+#include "protocol.h"
+#include "burst.h"
+#include "stream.h"
+
+struct streamRecent { //datagram sent lately, its later repeats are skipped
+  uint64_t data;
+  uint32_t time; //micros() of the last repeat
+  uint8_t protocol;
+  bool used;
+};
+
+static streamMode mode = STREAM_OFF;
+static uint32_t sequence = 0;
+static streamRecent recent[STREAM_RECENT];
+static uint8_t recent_next = 0;
+static uint32_t clock_high = 0, clock_last = 0; //64 bit extension of halMicros()
+static const char *const mode_names[] = {"off", "udp", "tcp"};
+streamStatistics streamStats = {};
+
+static uint32_t clockUpdate() { //called more often than micros() wraps
+  uint32_t now = halMicros();
+  if (now<clock_last) clock_high++;
+  clock_last = now;
+  return now;
+}
+
+static uint64_t micros64(uint32_t time) { //64 bit time of a micros() time in the recent past
+  uint32_t now = clockUpdate();
+  return ((uint64_t)clock_high << 32 | now) - (uint32_t)(now-time);
+}
+
+void streamBegin() {
+  mode = STREAM_OFF;
+  for (uint8_t i=0; i<3; i++) {
+    if (strcmp(stream_mode, mode_names[i])==0) mode = (streamMode)i;
+  }
+  if (mode!=STREAM_OFF && !halStreamBegin(mode==STREAM_TCP, stream_address, atoi(stream_port))) {
+    #if DEBUG
+    halDebug("Frame stream could not be opened.\n");
+    #endif
+    mode = STREAM_OFF;
+  }
+}
+
+streamMode streamGetMode() {
+  return mode;
+}
+
+const char *streamModeName(streamMode mode) {
+  return mode<=STREAM_TCP ? mode_names[mode] : "?";
+}
+
+uint8_t streamClients() {
+  return mode==STREAM_TCP ? halStreamClients() : 0;
+}
+
+void streamRecord(uint32_t seq, uint8_t protocol, uint64_t time, uint32_t age, uint64_t data, uint8_t margin, uint8_t *buf) {
+  buf[0] = STREAM_VERSION;
+  buf[1] = protocol;
+  for (uint8_t i=0; i<4; i++) buf[2+i] = seq >> (24-8*i);
+  for (uint8_t i=0; i<8; i++) buf[6+i] = time >> (56-8*i);
+  for (uint8_t i=0; i<4; i++) buf[14+i] = age >> (24-8*i);
+  newentorToBytes(data, buf+18);
+  buf[23] = margin;
+}
+
+void streamFrame(const rfFrame &frame, uint8_t margin) {
+  const rfProtocol *protocol = protocolGet(frame.protocol);
+  if (mode==STREAM_OFF || !protocol) return;
+  uint64_t data = frame.data & rfProtocolMask(*protocol);
+  for (streamRecent &r : recent) {
+    if (r.used && r.protocol==frame.protocol && r.data==data && frame.time-r.time<=BURST_GAP) { //later repeat of a burst
+      r.time = frame.time;
+      streamStats.repeats++;
+      return;
+    }
+  }
+  if (protocolCheck(frame.protocol, data)!=NEWENTOR_OK) return;
+  streamRecent &r = recent[recent_next];
+  recent_next = (recent_next+1)%STREAM_RECENT;
+  r = {data, frame.time, frame.protocol, true};
+  uint8_t record[STREAM_RECORD_SIZE];
+  streamRecord(sequence++, frame.protocol, micros64(frame.time), halMicros()-frame.time, data, margin, record);
+  if (halStreamSend(record, sizeof(record))) streamStats.records++;
+  else streamStats.failed++;
+}
+
+void streamLoop() {
+  clockUpdate();
+  if (mode==STREAM_TCP) halStreamAccept();
+}
@@ -0,0 +1,245 @@
+#include <string.h>
+#include "hal.h"
+#include "protocol.h"
+#include "timing.h"
+
+#define TIMING_VERSION 1
+
+struct timingLimits { //safe bounds and default window half width of a class, us
+  uint16_t low, high, half_width;
+  uint8_t bin_width; //histogram bin width
+};
+
+static const timingLimits limits[TIMING_CLASSES] = {
+  {200, 1200, (PULSE_MAX-PULSE_MIN)/2, 25}, //pulse
+  {800, 3200, (ZERO_MAX-ZERO_MIN)/2, 50}, //zero
+  {2400, 6400, (ONE_MAX-ONE_MIN)/2, 100}, //one
+  {5600, 12000, (NEWDATA_MAX-NEWDATA_MIN)/2, 200}, //preamble
+};
+static const char *const class_names[TIMING_CLASSES] = {"pulse", "zero", "one", "preamble"};
+
+static timingSensor sensors[TIMING_SENSORS];
+static uint16_t histogram[TIMING_CLASSES][TIMING_BINS]; //observed durations, halved when a class gets full
+static uint32_t histogram_total[TIMING_CLASSES];
+static rfTiming saved; //windows at the last save
+static uint32_t last_save = 0;
+static bool save_pending = false; //written by timingLoop(), not in the middle of a burst
+static bool adaptive = true;
+timingStatistics timingStats = {};
+
+const char *timingClassName(timingClass cls) {
+  return cls<TIMING_CLASSES ? class_names[cls] : "?";
+}
+
+static void histogramAdd(uint8_t cls, uint16_t duration) {
+  uint16_t bin = duration/limits[cls].bin_width;
+  if (bin>=TIMING_BINS) bin = TIMING_BINS-1;
+  if (histogram[cls][bin]==0xFFFF) { //running histogram, old observations fade out
+    histogram_total[cls] = 0;
+    for (uint16_t &count : histogram[cls]) {
+      count >>= 1;
+      histogram_total[cls] += count;
+    }
+  }
+  histogram[cls][bin]++;
+  histogram_total[cls]++;
+}
+
+uint16_t timingPercentile(timingClass cls, uint8_t percent) {
+  if (cls>=TIMING_CLASSES || !histogram_total[cls]) return 0;
+  uint32_t target = (histogram_total[cls]*percent+99)/100, count = 0;
+  for (uint8_t bin=0; bin<TIMING_BINS; bin++) {
+    count += histogram[cls][bin];
+    if (count>=target) return bin*limits[cls].bin_width + limits[cls].bin_width/2;
+  }
+  return (TIMING_BINS-1)*limits[cls].bin_width;
+}
+
+static timingSensor *sensorFind(const rfProtocol &protocol, uint64_t data, uint32_t now) { //same replacement as the duplicate filter
+  uint8_t address = rfFieldGet(data, protocol.address);
+  uint8_t channel = rfFieldGet(data, protocol.channel);
+  timingSensor *oldest = &sensors[0];
+  for (timingSensor &s : sensors) {
+    if (s.used && s.address==address && s.channel==channel) return &s;
+    if (!s.used || (oldest->used && now-s.last_seen > now-oldest->last_seen)) oldest = &s;
+  }
+  memset(oldest, 0, sizeof(*oldest));
+  oldest->address = address;
+  oldest->channel = channel;
+  oldest->used = true;
+  return oldest;
+}
+
+static uint16_t clampLimit(int32_t value, uint8_t cls) {
+  if (value<limits[cls].low) return limits[cls].low;
+  if (value>limits[cls].high) return limits[cls].high;
+  return value;
+}
+
+static rfTiming windowsCompute() { //envelope of the windows of all learned sensors
+  int32_t low[TIMING_CLASSES], high[TIMING_CLASSES];
+  bool learned = false;
+  for (uint8_t cls=0; cls<TIMING_CLASSES; cls++) {
+    low[cls] = INT32_MAX;
+    high[cls] = INT32_MIN;
+  }
+  for (const timingSensor &s : sensors) {
+    if (!s.used || s.frames<TIMING_MIN_FRAMES) continue;
+    learned = true;
+    for (uint8_t cls=0; cls<TIMING_CLASSES; cls++) {
+      int32_t half = s.deviation[cls]*TIMING_SPREAD/16;
+      if (half<limits[cls].half_width) half = limits[cls].half_width;
+      int32_t mean = s.mean[cls]/16;
+      if (mean-half<low[cls]) low[cls] = mean-half;
+      if (mean+half>high[cls]) high[cls] = mean+half;
+    }
+  }
+  rfTiming t = {NEWDATA_MIN, NEWDATA_MAX, ONE_MIN, ONE_MAX, ZERO_MIN, ZERO_MAX, PULSE_MIN, PULSE_MAX};
+  if (!learned || !adaptive) return t;
+  t.pulse_min = clampLimit(low[TIMING_PULSE], TIMING_PULSE);
+  t.pulse_max = clampLimit(high[TIMING_PULSE], TIMING_PULSE);
+  t.zero_min = clampLimit(low[TIMING_ZERO], TIMING_ZERO);
+  t.zero_max = clampLimit(high[TIMING_ZERO], TIMING_ZERO);
+  t.one_min = clampLimit(low[TIMING_ONE], TIMING_ONE);
+  t.one_max = clampLimit(high[TIMING_ONE], TIMING_ONE);
+  t.newdata_min = clampLimit(low[TIMING_PREAMBLE], TIMING_PREAMBLE);
+  t.newdata_max = clampLimit(high[TIMING_PREAMBLE], TIMING_PREAMBLE);
+  if (t.zero_max>t.one_min) t.zero_max = t.one_min = (t.zero_max+t.one_min)/2; //windows overlap, split in the middle
+  if (t.one_max>t.newdata_min) t.one_max = t.newdata_min = (t.one_max+t.newdata_min)/2;
+  return t;
+}
+
+static bool windowsMoved(const rfTiming &a, const rfTiming &b, uint16_t delta) {
+  const uint16_t *x = (const uint16_t*)&a, *y = (const uint16_t*)&b;
+  for (uint8_t i=0; i<sizeof(rfTiming)/sizeof(uint16_t); i++) {
+    if (x[i]>y[i]+delta || y[i]>x[i]+delta) return true;
+  }
+  return false;
+}
+
+static rfTiming windowsCurrent() {
+  rfTiming t;
+  t.newdata_min = rfTimings.newdata_min;
+  t.newdata_max = rfTimings.newdata_max;
+  t.one_min = rfTimings.one_min;
+  t.one_max = rfTimings.one_max;
+  t.zero_min = rfTimings.zero_min;
+  t.zero_max = rfTimings.zero_max;
+  t.pulse_min = rfTimings.pulse_min;
+  t.pulse_max = rfTimings.pulse_max;
+  return t;
+}
+
+static void windowsApply(const rfTiming &t, uint16_t delta) { //an edge classified during the update may see old and new limits mixed
+  if (!windowsMoved(t, windowsCurrent(), delta)) return;
+  rfTimings.pulse_min = t.pulse_min;
+  rfTimings.pulse_max = t.pulse_max;
+  rfTimings.zero_min = t.zero_min;
+  rfTimings.zero_max = t.zero_max;
+  rfTimings.one_min = t.one_min;
+  rfTimings.one_max = t.one_max;
+  rfTimings.newdata_min = t.newdata_min;
+  rfTimings.newdata_max = t.newdata_max;
+  timingStats.updates++;
+  #if DEBUG
+  halDebug("Timing: pulse %u-%u zero %u-%u one %u-%u preamble %u-%u\n", t.pulse_min, t.pulse_max, t.zero_min, t.zero_max,
+    t.one_min, t.one_max, t.newdata_min, t.newdata_max);
+  #endif
+}
+
+static void timingSave() {
+  uint8_t buf[2+sizeof(sensors)];
+  buf[0] = TIMING_VERSION;
+  buf[1] = TIMING_SENSORS;
+  memcpy(buf+2, sensors, sizeof(sensors));
+  if (halFileWrite(TIMING_FILE, (const char*)buf, sizeof(buf))) timingStats.saves++;
+}
+
+void timingBegin() {
+  uint8_t buf[2+sizeof(sensors)];
+  if (halFileRead(TIMING_FILE, (char*)buf, sizeof(buf))==(int)sizeof(buf) && buf[0]==TIMING_VERSION && buf[1]==TIMING_SENSORS) {
+    memcpy(sensors, buf+2, sizeof(sensors));
+    for (timingSensor &s : sensors) s.last_seen = 0;
+  }
+  saved = windowsCompute();
+  windowsApply(saved, 0);
+}
+
+void timingReset() {
+  memset(sensors, 0, sizeof(sensors));
+  memset(histogram, 0, sizeof(histogram));
+  memset(histogram_total, 0, sizeof(histogram_total));
+  halFileRemove(TIMING_FILE);
+  save_pending = false;
+  saved = windowsCompute();
+  windowsApply(saved, 0);
+}
+
+void timingLoop() {
+  if (!save_pending) return;
+  save_pending = false;
+  timingSave();
+}
+
+void timingSetAdaptive(bool enable) {
+  adaptive = enable;
+  windowsApply(windowsCompute(), 0);
+}
+
+static void emaUpdate(int32_t &avg, int32_t value, bool first) { //exponential moving average, values are us*16
+  if (first) avg = value;
+  else avg += (value-avg) >> TIMING_EMA_SHIFT;
+}
+
+void timingLearn(const rfFrame &frame) {
+  const rfProtocol *protocol = protocolGet(frame.protocol);
+  if (!protocol || !protocol->adaptive) return; //decoders of the other protocols use fixed windows
+  timingStats.frames++;
+  if (protocol->check(frame.data)!=NEWENTOR_OK) return;
+  timingStats.valid++;
+  rfFrameTiming timing;
+  if (!rfReadFrameTiming(frame, timing)) return; //loop() was too late, the interrupt reused the buffer
+  timingStats.learned++;
+  uint8_t bits = protocol->bits;
+  uint8_t classes[2*DATAGRAM+1]; //class of every duration below
+  uint16_t durations[2*DATAGRAM+1];
+  for (uint8_t i=0; i<bits; i++) {
+    classes[2*i] = TIMING_PULSE;
+    durations[2*i] = timing.pulses[i];
+    classes[2*i+1] = (frame.data >> (bits-1-i)) & 1 ? TIMING_ONE : TIMING_ZERO;
+    durations[2*i+1] = timing.gaps[i];
+  }
+  classes[2*bits] = TIMING_PREAMBLE;
+  durations[2*bits] = timing.preamble;
+  uint32_t sum[TIMING_CLASSES] = {}, count[TIMING_CLASSES] = {};
+  for (uint8_t i=0; i<2*bits+1; i++) {
+    sum[classes[i]] += durations[i];
+    count[classes[i]]++;
+    histogramAdd(classes[i], durations[i]);
+  }
+  uint32_t now = halMillis();
+  timingSensor *s = sensorFind(*protocol, frame.data, now);
+  int32_t mean[TIMING_CLASSES];
+  uint32_t spread[TIMING_CLASSES] = {};
+  for (uint8_t cls=0; cls<TIMING_CLASSES; cls++) {
+    mean[cls] = count[cls] ? sum[cls]*16/count[cls] : s->mean[cls];
+  }
+  for (uint8_t i=0; i<2*bits+1; i++) { //deviation from the mean of the sensor, includes the drift of this datagram
+    int32_t diff = durations[i]*16 - (s->frames ? s->mean[classes[i]] : mean[classes[i]]);
+    spread[classes[i]] += diff<0 ? -diff : diff;
+  }
+  for (uint8_t cls=0; cls<TIMING_CLASSES; cls++) {
+    if (!count[cls]) continue; //datagram of all zeros or all ones
+    emaUpdate(s->mean[cls], mean[cls], s->frames==0);
+    emaUpdate(s->deviation[cls], spread[cls]/count[cls], s->frames==0);
+  }
+  s->frames++;
+  s->last_seen = now;
+  rfTiming t = windowsCompute();
+  windowsApply(t, TIMING_UPDATE_DELTA);
+  if (windowsMoved(t, saved, TIMING_SAVE_DELTA) && (timingStats.saves==0 || now-last_save>=TIMING_SAVE_INTERVAL)) {
+    save_pending = true;
+    saved = t;
+    last_save = now;
+  }
+}
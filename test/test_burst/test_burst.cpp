@@ -0,0 +1,81 @@
+// Burst assembler against interleaved repeats of sensors whose datagrams are only a few bits apart
+#include <unity.h>
+#include "newentor.h"
+#include "protocol.h"
+#include "burst.h"
+
+static rfBurst bursts[BURST_SLOTS*2];
+static uint8_t burst_count;
+
+void setUp() {
+  burst_count = 0;
+}
+void tearDown() {}
+
+static void collect(const rfBurst &burst) {
+  if (burst_count<sizeof(bursts)/sizeof(bursts[0])) bursts[burst_count] = burst;
+  burst_count++;
+}
+
+static uint64_t frame(uint8_t address, int tempF, uint8_t humidity, uint8_t channel) { //valid datagram, tempF in tenths
+  uint64_t data = (uint64_t)address << 32 | (uint64_t)(tempF+900) << 12 | (uint64_t)(humidity/10) << 8
+    | (uint64_t)(humidity%10) << 4 | channel;
+  uint32_t body = ((data >> 8) & 0xFF0FFFFF) | (uint32_t)(data & 0x0F) << 20;
+  return data | (uint64_t)(newentorCrc4(body) ^ ((data >> 4) & 0x0F)) << 28;
+}
+
+static void add(uint64_t data, uint32_t time) {
+  rfFrame received = {};
+  received.data = data;
+  received.time = time;
+  received.protocol = RF_PROTOCOL_NEWENTOR;
+  burstAdd(received, BURST_MARGIN_UNKNOWN, collect);
+}
+
+static const rfBurst *find(uint64_t data) {
+  for (uint8_t i=0; i<burst_count; i++) {
+    if (bursts[i].data==data) return &bursts[i];
+  }
+  return NULL;
+}
+
+static void test_interleaved_near_identical_sensors() { //addresses one bit apart, same channel and reading
+  uint64_t a = frame(0x5a, 675, 38, 1), b = frame(0x5b, 675, 38, 1);
+  TEST_ASSERT_TRUE(__builtin_popcountll(a ^ b)<=BURST_MAX_DISTANCE);
+  uint32_t time = 1000000;
+  for (uint8_t repeat=0; repeat<BURST_REPEATS; repeat++) {
+    add(a, time += 70000);
+    add(b, time += 70000);
+  }
+  burstPoll(time+BURST_GAP+1, collect);
+  TEST_ASSERT_EQUAL(2, burst_count);
+  const rfBurst *burst_a = find(a), *burst_b = find(b);
+  TEST_ASSERT_NOT_NULL(burst_a);
+  TEST_ASSERT_NOT_NULL(burst_b);
+  TEST_ASSERT_TRUE(burst_a->valid && burst_b->valid);
+  TEST_ASSERT_EQUAL(BURST_REPEATS, burst_a->agree);
+  TEST_ASSERT_EQUAL(BURST_REPEATS, burst_b->agree);
+}
+
+static void test_broken_repeat_joins_nearest() { //datagrams failing the check still join by distance
+  uint64_t a = frame(0x5a, 675, 38, 1), b = frame(0x5b, 675, 38, 1);
+  uint32_t time = 10000000;
+  for (uint8_t repeat=0; repeat<BURST_REPEATS; repeat++) {
+    add(repeat==2 ? a ^ 1ULL << 20 : a, time += 70000); //a temperature bit, fails the CRC check
+    add(b, time += 70000);
+  }
+  burstPoll(time+BURST_GAP+1, collect);
+  TEST_ASSERT_EQUAL(2, burst_count);
+  const rfBurst *burst_a = find(a);
+  TEST_ASSERT_NOT_NULL(burst_a);
+  TEST_ASSERT_EQUAL(BURST_REPEATS, burst_a->repeats);
+  TEST_ASSERT_EQUAL(BURST_REPEATS-1, burst_a->agree);
+  TEST_ASSERT_NOT_NULL(find(b));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_interleaved_near_identical_sensors);
+  RUN_TEST(test_broken_repeat_joins_nearest);
+  return UNITY_END();
+}
@@ -0,0 +1,60 @@
+// Table driven CRC against the bitwise rtl_433 reference. A sample of the message bodies is checked by default,
+// -D CRC_EXHAUSTIVE in build_flags checks all 2^32 of them, which takes a few minutes
+#include <stdlib.h>
+#include <unity.h>
+#include "newentor.h"
+#include "reference.h"
+
+void setUp() {}
+void tearDown() {}
+
+static uint8_t crcBitwise(uint32_t body) {
+  uint8_t msg[4] = {(uint8_t)(body >> 24), (uint8_t)(body >> 16), (uint8_t)(body >> 8), (uint8_t)body};
+  return crc4(msg, 4, 0x13, 0);
+}
+
+static void test_every_byte_value() { //each byte position through all values, the others fixed
+  for (uint8_t shift=0; shift<32; shift+=8) {
+    for (uint32_t value=0; value<256; value++) {
+      uint32_t body = (0x5a3c96e1 & ~(0xFFu << shift)) | value << shift;
+      TEST_ASSERT_EQUAL_UINT8(crcBitwise(body), newentorCrc4(body));
+    }
+  }
+}
+
+static void test_random_bodies() {
+  srand(2);
+  #ifdef CRC_EXHAUSTIVE
+  uint32_t body = 0;
+  do {
+    TEST_ASSERT_EQUAL_UINT8(crcBitwise(body), newentorCrc4(body));
+  } while (++body!=0);
+  #else
+  for (uint32_t i=0; i<(1UL << 22); i++) {
+    uint32_t body = ((uint32_t)rand() << 16) ^ rand();
+    TEST_ASSERT_EQUAL_UINT8(crcBitwise(body), newentorCrc4(body));
+  }
+  #endif
+}
+
+static void test_datagram_check() { //packed datagram check against the byte array check of rtl_433
+  srand(3);
+  for (uint32_t i=0; i<(1UL << 18); i++) {
+    uint64_t data = (((uint64_t)rand() << 31) ^ rand()) & 0xFFFFFFFFFFULL;
+    if (i&1) { //half of them with a valid CRC
+      uint32_t body = ((data >> 8) & 0xFF0FFFFF) | (uint32_t)(data & 0x0F) << 20;
+      data = (data & ~(0xFULL << 28)) | (uint64_t)(newentorCrc4(body) ^ ((data >> 4) & 0x0F)) << 28;
+    }
+    uint8_t bytes[5];
+    newentorToBytes(data, bytes);
+    TEST_ASSERT_EQUAL(infactory_crc_check_bitwise(bytes), newentorCrcCheck(data));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_byte_value);
+  RUN_TEST(test_random_bodies);
+  RUN_TEST(test_datagram_check);
+  return UNITY_END();
+}
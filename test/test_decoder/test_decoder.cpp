@@ -0,0 +1,103 @@
+// Newentor datagram decoding against known frames: checks, field extraction and the MQTT message
+#include <string.h>
+#include <unity.h>
+#include "newentor.h"
+
+void setUp() {}
+void tearDown() {}
+
+static uint64_t withCrc(uint64_t data) { //replace the CRC nibble so that the datagram passes the check
+  uint32_t body = ((data >> 8) & 0xFF0FFFFF) | (uint32_t)(data & 0x0F) << 20;
+  uint8_t crc = newentorCrc4(body) ^ ((data >> 4) & 0x0F);
+  return (data & ~(0xFULL << 28)) | (uint64_t)crc << 28;
+}
+
+static uint64_t frame(uint8_t address, bool battery_low, int tempF, uint8_t humidity, uint8_t channel) { //tempF in tenths
+  uint64_t data = (uint64_t)address << 32 | (uint64_t)battery_low << 26 | (uint64_t)(tempF+900) << 12
+    | (uint64_t)(humidity/10) << 8 | (uint64_t)(humidity%10) << 4 | channel;
+  return withCrc(data);
+}
+
+static void test_readme_frame() {
+  sensorReading reading;
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(0x1d79627381ULL, reading));
+  TEST_ASSERT_EQUAL_STRING("1d", reading.address);
+  TEST_ASSERT_EQUAL(1, reading.channel);
+  TEST_ASSERT_EQUAL(675, reading.tempF);
+  TEST_ASSERT_EQUAL(197, reading.tempC);
+  TEST_ASSERT_EQUAL(38, reading.humidity);
+  TEST_ASSERT_EQUAL(0, reading.battery_low);
+  reading.confidence = 6;
+  char msg[NEWENTOR_JSON_SIZE];
+  TEST_ASSERT_NOT_EQUAL(0, newentorToJson(reading, msg, sizeof(msg)));
+  TEST_ASSERT_EQUAL_STRING("{\"SensorAddress\":\"1d\",\"Channel\":1,\"TemperatureF\":67.5,\"TemperatureC\":19.7,\"Humidity\":38,"
+    "\"BatteryLow\":0,\"Confidence\":6}", msg);
+}
+
+static void test_corrupted_frames_rejected() { //every single bit error, the channel nibble becoming empty is invalid
+  sensorReading reading;
+  for (uint8_t bit=0; bit<40; bit++) {
+    uint64_t data = 0x1d79627381ULL ^ (1ULL << bit);
+    newentorStatus expected = (data & 0x0F) ? NEWENTOR_BAD_CRC : NEWENTOR_INVALID;
+    TEST_ASSERT_EQUAL_MESSAGE(expected, newentorDecode(data, reading), "single bit error not rejected");
+  }
+}
+
+static void test_crc_nibble_rejected() {
+  for (uint8_t crc=0; crc<16; crc++) {
+    uint64_t data = (0x1d79627381ULL & ~(0xFULL << 28)) | (uint64_t)crc << 28;
+    TEST_ASSERT_EQUAL(crc==7 ? NEWENTOR_OK : NEWENTOR_BAD_CRC, newentorCheck(data));
+  }
+}
+
+static void test_empty_channel_invalid() {
+  sensorReading reading;
+  TEST_ASSERT_EQUAL(NEWENTOR_INVALID, newentorDecode(withCrc(0x1d79627380ULL), reading));
+}
+
+static void test_temperature_sign() {
+  sensorReading reading;
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(frame(0xa5, false, 100, 38, 1), reading)); //10.0 F
+  TEST_ASSERT_EQUAL(100, reading.tempF);
+  TEST_ASSERT_EQUAL(-122, reading.tempC);
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(frame(0xa5, false, -100, 38, 1), reading)); //below 0 F
+  TEST_ASSERT_EQUAL(-100, reading.tempF);
+  TEST_ASSERT_EQUAL(-233, reading.tempC);
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(frame(0xa5, false, 320, 38, 1), reading)); //freezing point
+  TEST_ASSERT_EQUAL(320, reading.tempF);
+  TEST_ASSERT_EQUAL(0, reading.tempC);
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(frame(0xa5, false, -900, 38, 1), reading)); //lowest encodable
+  TEST_ASSERT_EQUAL(-900, reading.tempF);
+  TEST_ASSERT_EQUAL(-678, reading.tempC);
+  char msg[NEWENTOR_JSON_SIZE];
+  reading.confidence = 1;
+  newentorToJson(reading, msg, sizeof(msg));
+  TEST_ASSERT_NOT_NULL(strstr(msg, "\"TemperatureF\":-90,\"TemperatureC\":-67.8"));
+}
+
+static void test_humidity_channel_battery() {
+  sensorReading reading;
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(frame(0x00, true, 700, 5, 3), reading));
+  TEST_ASSERT_EQUAL_STRING("00", reading.address);
+  TEST_ASSERT_EQUAL(5, reading.humidity);
+  TEST_ASSERT_EQUAL(3, reading.channel);
+  TEST_ASSERT_EQUAL(1, reading.battery_low);
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(frame(0xff, false, 700, 99, 2), reading));
+  TEST_ASSERT_EQUAL_STRING("ff", reading.address);
+  TEST_ASSERT_EQUAL(99, reading.humidity);
+  TEST_ASSERT_EQUAL(2, reading.channel);
+  TEST_ASSERT_EQUAL(0, reading.battery_low);
+  TEST_ASSERT_EQUAL(NEWENTOR_OK, newentorDecode(withCrc(0x5a000bca01ULL), reading)); //BCD 'A0' is 100 %rH
+  TEST_ASSERT_EQUAL(100, reading.humidity);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_readme_frame);
+  RUN_TEST(test_corrupted_frames_rejected);
+  RUN_TEST(test_crc_nibble_rejected);
+  RUN_TEST(test_empty_channel_invalid);
+  RUN_TEST(test_temperature_sign);
+  RUN_TEST(test_humidity_channel_battery);
+  return UNITY_END();
+}
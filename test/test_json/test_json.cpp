@@ -0,0 +1,39 @@
+// Integer message encoder against the double math + ArduinoJson message it replaced: identical output over the whole
+// 12 bit temperature range, with addresses, battery, channels and BCD humidity digits around it
+#include <string.h>
+#include <unity.h>
+#include "newentor.h"
+#include "reference.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_same_message() {
+  for (uint32_t temp_raw=0; temp_raw<4096; temp_raw++) {
+    for (uint32_t variant=0; variant<64; variant++) {
+      uint64_t data = (uint64_t)(variant*37 & 0xFF) << 32 | (uint64_t)(variant & 1) << 26 | (uint64_t)temp_raw << 12
+        | (uint64_t)(variant*7 & 0xFF) << 4 | (variant & 3);
+      char expected[NEWENTOR_JSON_SIZE], actual[NEWENTOR_JSON_SIZE];
+      size_t expected_len = jsonArduinoJson(data, variant%7, expected, sizeof(expected));
+      size_t len = jsonInteger(data, variant%7, actual, sizeof(actual));
+      TEST_ASSERT_EQUAL_STRING(expected, actual);
+      TEST_ASSERT_EQUAL(expected_len, len);
+    }
+  }
+}
+
+static void test_buffer_too_small() {
+  sensorReading reading;
+  newentorFields(0x1d79627381ULL, reading);
+  reading.confidence = 6;
+  char msg[NEWENTOR_JSON_SIZE];
+  TEST_ASSERT_NOT_EQUAL(0, newentorToJson(reading, msg, sizeof(msg)));
+  TEST_ASSERT_EQUAL(0, newentorToJson(reading, msg, NEWENTOR_JSON_SIZE-1)); //needs room for the longest message
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_same_message);
+  RUN_TEST(test_buffer_too_small);
+  return UNITY_END();
+}